@@ -1,5 +1,7 @@
 #include <deai/c++/conv.hh>
 #include <limits>
+#include <tuple>
+#include <utility>
 
 extern "C" {
 #include <deai/type.h>
@@ -315,7 +317,7 @@ DeaiVariantConverter<borrow>::operator std::optional<::di_weak_object *>() {
 	}
 	if (type == di_type::OBJECT || type == di_type::EMPTY_OBJECT) {
 		if constexpr (borrow) {
-			return reinterpret_cast<::di_weak_object *>(value().object);
+			return ::di_borrow_weak_ref(value().object);
 		}
 		return ::di_weakly_ref_object(value().object);
 	}
@@ -410,6 +412,122 @@ auto di_type_conversion_impl(DeaiVariantConverter<borrow> &&converter, ::di_type
 #undef CONVERT_TO
 	return 0;
 }        // namespace
+
+/// Converts a number of type `From` in `from` to type `To` in `to`.
+using ConversionKernel = int (*)(const ::di_value *from, ::di_value *to);
+
+template <typename From, typename To>
+auto convert_number(const ::di_value *from, ::di_value *to) -> int {
+	From value;
+	::memcpy(&value, from, sizeof(From));
+	if constexpr (!std::is_floating_point_v<To>) {
+		if (!std::in_range<To>(value)) {
+			return -EINVAL;
+		}
+	}
+	To converted = static_cast<To>(value);
+	::memcpy(to, &converted, sizeof(To));
+	return 0;
+}
+
+/// Number types that are converted by the kernels in `conversion_kernels`
+using NumberTypes = std::tuple<int, unsigned int, int64_t, uint64_t, double>;
+
+template <typename From, size_t... J>
+constexpr void add_number_kernels(auto &table, std::index_sequence<J...> /*to*/) {
+	(
+	    [&table]<typename To>() {
+		    // Floats are never implicitly converted to integers
+		    if constexpr (!std::is_same_v<From, To> &&
+		                  !(std::is_floating_point_v<From> && !std::is_floating_point_v<To>)) {
+			    table[static_cast<size_t>(::deai::typeinfo::of<From>::value)]
+			         [static_cast<size_t>(::deai::typeinfo::of<To>::value)] = &convert_number<From, To>;
+		    }
+	    }.template operator()<std::tuple_element_t<J, NumberTypes>>(),
+	    ...);
+}
+
+template <size_t... I>
+constexpr auto make_conversion_kernels(std::index_sequence<I...> seq) {
+	constexpr auto ntypes = static_cast<size_t>(di_type::DI_LAST_TYPE);
+	std::array<std::array<ConversionKernel, ntypes>, ntypes> table{};
+	(add_number_kernels<std::tuple_element_t<I, NumberTypes>>(table, seq), ...);
+	return table;
+}
+
+/// `[from][to]` table of the conversions that don't need the general converter. The ones
+/// not in the table are NULL.
+constexpr auto conversion_kernels =
+    make_conversion_kernels(std::make_index_sequence<std::tuple_size_v<NumberTypes>>{});
+
+/// Converts `length` integers of type `From` to type `To`.
+using IntArrayKernel = int (*)(const void *from, void *to, size_t length);
+
+template <typename From, typename To>
+auto convert_int_array(const void *from_, void *to_, size_t length) -> int {
+	const auto *from = static_cast<const From *>(from_);
+	auto *to = static_cast<To *>(to_);
+	constexpr bool always_in_range =
+	    std::cmp_less_equal(std::numeric_limits<To>::min(), std::numeric_limits<From>::min()) &&
+	    std::cmp_greater_equal(std::numeric_limits<To>::max(), std::numeric_limits<From>::max());
+	if constexpr (!always_in_range) {
+		// No early exit, so the compiler can vectorize the check.
+		bool out_of_range = false;
+		for (size_t i = 0; i < length; i++) {
+			out_of_range |= !std::in_range<To>(from[i]);
+		}
+		if (out_of_range) {
+			return -EINVAL;
+		}
+	}
+	if constexpr (std::is_same_v<From, To>) {
+		::memcpy(to, from, sizeof(From) * length);
+	} else {
+		for (size_t i = 0; i < length; i++) {
+			to[i] = static_cast<To>(from[i]);
+		}
+	}
+	return 0;
+}
+
+/// Integer types indexed by `int_type_index`
+using IntTypes =
+    std::tuple<int8_t, int16_t, int32_t, int64_t, uint8_t, uint16_t, uint32_t, uint64_t>;
+
+auto int_type_index(int bits, bool is_unsigned) -> int {
+	int index = 0;
+	switch (bits) {
+	case 8:
+		index = 0;
+		break;
+	case 16:
+		index = 1;
+		break;
+	case 32:
+		index = 2;
+		break;
+	case 64:
+		index = 3;
+		break;
+	default:
+		return -1;
+	}
+	return is_unsigned ? index + 4 : index;
+}
+
+template <typename From, size_t... J>
+constexpr auto make_int_array_kernels_from(std::index_sequence<J...> /*to*/) {
+	return std::array<IntArrayKernel, sizeof...(J)>{
+	    &convert_int_array<From, std::tuple_element_t<J, IntTypes>>...};
+}
+
+template <size_t... I>
+constexpr auto make_int_array_kernels(std::index_sequence<I...> seq) {
+	return std::array{make_int_array_kernels_from<std::tuple_element_t<I, IntTypes>>(seq)...};
+}
+
+constexpr auto int_array_kernels =
+    make_int_array_kernels(std::make_index_sequence<std::tuple_size_v<IntTypes>>{});
 }        // namespace
 
 extern "C" {
@@ -419,6 +537,14 @@ auto di_type_conversion(di_type from_type, di_value *from, di_type to_type, di_v
 		::memcpy(to, from, ::deai::c_api::type::sizeof_(from_type));
 		return 0;
 	}
+	if (from_type < di_type::DI_LAST_TYPE && to_type < di_type::DI_LAST_TYPE) {
+		auto kernel = conversion_kernels[static_cast<size_t>(from_type)]
+		                                [static_cast<size_t>(to_type)];
+		if (kernel != nullptr) {
+			// Numbers don't own anything, so borrowing doesn't matter.
+			return kernel(from, to);
+		}
+	}
 	if (borrowing) {
 		return di_type_conversion_impl<true>(
 		    DeaiVariantConverter<true>{std::ref(*from), from_type}, to_type, *to);
@@ -469,4 +595,13 @@ auto di_int_conversion(di_type from_type, di_value *from, int to_bits, bool to_u
 #undef X
 	return 0;
 }
+auto di_int_array_conversion(const void *from, int from_bits, bool from_unsigned, void *to,
+                             int to_bits, bool to_unsigned, size_t length) -> int {
+	auto from_index = int_type_index(from_bits, from_unsigned);
+	auto to_index = int_type_index(to_bits, to_unsigned);
+	if (from_index < 0 || to_index < 0) {
+		return -EINVAL;
+	}
+	return int_array_kernels[from_index][to_index](from, to, length);
+}
 }
@@ -9,19 +9,30 @@
 
 #include <deai/callable.h>
 #include <deai/object.h>
+#include <deai/trace.h>
 #include <deai/type.h>
 #include <deai/helper.h>
 
 #include "di_internal.h"
 
+/// A closure calling `raw_fn` with the captures prepended to the arguments. The captures
+/// are stored in the same allocation, after the closure, and are pointed to by
+/// `obj.inline_values`.
 struct di_raw_closure {
 	di_object_internal obj;
 	di_call_fn raw_fn;
 };
 
+/// Calls `fn` with `args`, casting `fn` to the exact type of the function. See
+/// `di_closure_thunk`.
+typedef void (*di_thunk_fn)(void (*nonnull fn)(void), di_value *nonnull ret,
+                            di_value *nonnull const *nonnull args);
+
 struct di_closure {
 	struct di_raw_closure raw;
 	void (*nonnull fn)(void);
+	/// Direct call thunk matching the signature of `fn`, NULL if libffi has to be used.
+	di_thunk_fn nullable thunk;
 
 	/// Number of actual arguments
 	int nargs;
@@ -33,30 +44,228 @@ struct di_closure {
 };
 
 static_assert(sizeof(di_value) >= sizeof(ffi_arg), "ffi_arg is too big");
+static_assert(alignof(di_value) <= alignof(struct di_variant),
+              "captured values would be misaligned");
+
+// Closures with the most common signatures are called through thunks, which cast the
+// function pointer to the right type and call it directly, instead of through libffi.
+// Thunks are generated for up to 3 arguments of these types, and these return types.
+#define DI_THUNK_CTYPE_NIL void
+#define DI_THUNK_CTYPE_OBJECT di_object *
+#define DI_THUNK_CTYPE_INT int64_t
+#define DI_THUNK_CTYPE_STRING di_string
+#define DI_THUNK_CTYPE_BOOL bool
+#define DI_THUNK_CTYPE_FLOAT double
+#define DI_THUNK_RETURN_NIL(call) call
+#define DI_THUNK_RETURN_OBJECT(call) ret->object = call
+#define DI_THUNK_RETURN_INT(call) ret->int_ = call
+#define DI_THUNK_RETURN_STRING(call) ret->string = call
+
+// The preprocessor doesn't expand a macro inside of itself, so each level of nesting
+// needs its own copy of the list.
+#define DI_THUNK_RET_TYPES(X) X(NIL) X(OBJECT) X(INT) X(STRING)
+#define DI_THUNK_ARG_TYPES_1(X, ...)                                                     \
+	X(__VA_ARGS__, OBJECT) X(__VA_ARGS__, INT) X(__VA_ARGS__, STRING)                    \
+	X(__VA_ARGS__, BOOL) X(__VA_ARGS__, FLOAT)
+#define DI_THUNK_ARG_TYPES_2(X, ...)                                                     \
+	X(__VA_ARGS__, OBJECT) X(__VA_ARGS__, INT) X(__VA_ARGS__, STRING)                    \
+	X(__VA_ARGS__, BOOL) X(__VA_ARGS__, FLOAT)
+#define DI_THUNK_ARG_TYPES_3(X, ...)                                                     \
+	X(__VA_ARGS__, OBJECT) X(__VA_ARGS__, INT) X(__VA_ARGS__, STRING)                    \
+	X(__VA_ARGS__, BOOL) X(__VA_ARGS__, FLOAT)
+
+// Arguments are loaded with their own types, they don't have to be aligned as `di_value`,
+// e.g. a bool can be at any address.
+#define DI_THUNK_ARG(i, T) (*(DI_THUNK_CTYPE_##T *)args[i])
+#define DI_DEFINE_THUNK0(R)                                                              \
+	static void di_thunk_##R(void (*fn)(void), di_value *unused ret,                     \
+	                         di_value *const *unused args) {                             \
+		DI_THUNK_RETURN_##R(((DI_THUNK_CTYPE_##R(*)(void))fn)());                        \
+	}
+#define DI_DEFINE_THUNK1(R, A)                                                           \
+	static void di_thunk_##R##_##A(void (*fn)(void), di_value *unused ret,               \
+	                               di_value *const *args) {                              \
+		DI_THUNK_RETURN_##R(                                                             \
+		    ((DI_THUNK_CTYPE_##R(*)(DI_THUNK_CTYPE_##A))fn)(DI_THUNK_ARG(0, A)));        \
+	}
+#define DI_DEFINE_THUNK2(R, A, B)                                                        \
+	static void di_thunk_##R##_##A##_##B(void (*fn)(void), di_value *unused ret,         \
+	                                     di_value *const *args) {                        \
+		DI_THUNK_RETURN_##R(((DI_THUNK_CTYPE_##R(*)(DI_THUNK_CTYPE_##A,                  \
+		                                            DI_THUNK_CTYPE_##B))fn)(             \
+		    DI_THUNK_ARG(0, A), DI_THUNK_ARG(1, B)));                                    \
+	}
+#define DI_DEFINE_THUNK3(R, A, B, C)                                                     \
+	static void di_thunk_##R##_##A##_##B##_##C(void (*fn)(void), di_value *unused ret,   \
+	                                           di_value *const *args) {                  \
+		DI_THUNK_RETURN_##R(((DI_THUNK_CTYPE_##R(*)(                                     \
+		    DI_THUNK_CTYPE_##A, DI_THUNK_CTYPE_##B, DI_THUNK_CTYPE_##C))fn)(             \
+		    DI_THUNK_ARG(0, A), DI_THUNK_ARG(1, B), DI_THUNK_ARG(2, C)));                \
+	}
+
+#define DI_DEFINE_THUNKS1(R) DI_THUNK_ARG_TYPES_1(DI_DEFINE_THUNK1, R)
+#define DI_DEFINE_THUNKS2_(R, A) DI_THUNK_ARG_TYPES_2(DI_DEFINE_THUNK2, R, A)
+#define DI_DEFINE_THUNKS2(R) DI_THUNK_ARG_TYPES_1(DI_DEFINE_THUNKS2_, R)
+#define DI_DEFINE_THUNKS3__(R, A, B) DI_THUNK_ARG_TYPES_3(DI_DEFINE_THUNK3, R, A, B)
+#define DI_DEFINE_THUNKS3_(R, A) DI_THUNK_ARG_TYPES_2(DI_DEFINE_THUNKS3__, R, A)
+#define DI_DEFINE_THUNKS3(R) DI_THUNK_ARG_TYPES_1(DI_DEFINE_THUNKS3_, R)
+
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNK0)
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNKS1)
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNKS2)
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNKS3)
+
+#define DI_THUNK_NAME0(R) di_thunk_##R,
+#define DI_THUNK_NAME1(R, A) di_thunk_##R##_##A,
+#define DI_THUNK_NAME2(R, A, B) di_thunk_##R##_##A##_##B,
+#define DI_THUNK_NAME3(R, A, B, C) di_thunk_##R##_##A##_##B##_##C,
+#define DI_THUNK_NAMES1(R) {DI_THUNK_ARG_TYPES_1(DI_THUNK_NAME1, R)},
+#define DI_THUNK_NAMES2_(R, A) {DI_THUNK_ARG_TYPES_2(DI_THUNK_NAME2, R, A)},
+#define DI_THUNK_NAMES2(R) {DI_THUNK_ARG_TYPES_1(DI_THUNK_NAMES2_, R)},
+#define DI_THUNK_NAMES3__(R, A, B) {DI_THUNK_ARG_TYPES_3(DI_THUNK_NAME3, R, A, B)},
+#define DI_THUNK_NAMES3_(R, A) {DI_THUNK_ARG_TYPES_2(DI_THUNK_NAMES3__, R, A)},
+#define DI_THUNK_NAMES3(R) {DI_THUNK_ARG_TYPES_1(DI_THUNK_NAMES3_, R)},
+
+#define DI_NTHUNK_RTYPES 4
+#define DI_NTHUNK_ATYPES 5
+static const di_thunk_fn thunks0[DI_NTHUNK_RTYPES] = {DI_THUNK_RET_TYPES(DI_THUNK_NAME0)};
+static const di_thunk_fn thunks1[DI_NTHUNK_RTYPES][DI_NTHUNK_ATYPES] = {
+    DI_THUNK_RET_TYPES(DI_THUNK_NAMES1)};
+static const di_thunk_fn thunks2[DI_NTHUNK_RTYPES][DI_NTHUNK_ATYPES][DI_NTHUNK_ATYPES] = {
+    DI_THUNK_RET_TYPES(DI_THUNK_NAMES2)};
+static const di_thunk_fn
+    thunks3[DI_NTHUNK_RTYPES][DI_NTHUNK_ATYPES][DI_NTHUNK_ATYPES][DI_NTHUNK_ATYPES] = {
+        DI_THUNK_RET_TYPES(DI_THUNK_NAMES3)};
+
+/// Index of `type` in `DI_THUNK_RET_TYPES`, or -1
+static int di_thunk_ret_index(di_type type) {
+	switch (type) {
+	case DI_TYPE_NIL:
+		return 0;
+	case DI_TYPE_OBJECT:
+		return 1;
+	case DI_TYPE_INT:
+		return 2;
+	case DI_TYPE_STRING:
+		return 3;
+	case DI_TYPE_ANY:
+	case DI_TYPE_EMPTY_OBJECT:
+	case DI_TYPE_BOOL:
+	case DI_TYPE_NINT:
+	case DI_TYPE_NUINT:
+	case DI_TYPE_UINT:
+	case DI_TYPE_FLOAT:
+	case DI_TYPE_POINTER:
+	case DI_TYPE_WEAK_OBJECT:
+	case DI_TYPE_STRING_LITERAL:
+	case DI_TYPE_ARRAY:
+	case DI_TYPE_TUPLE:
+	case DI_TYPE_VARIANT:
+	case DI_LAST_TYPE:
+		break;
+	}
+	return -1;
+}
+
+/// Index of `type` in `DI_THUNK_ARG_TYPES_*`, or -1
+static int di_thunk_arg_index(di_type type) {
+	switch (type) {
+	case DI_TYPE_OBJECT:
+		return 0;
+	case DI_TYPE_INT:
+		return 1;
+	case DI_TYPE_STRING:
+		return 2;
+	case DI_TYPE_BOOL:
+		return 3;
+	case DI_TYPE_FLOAT:
+		return 4;
+	case DI_TYPE_NIL:
+	case DI_TYPE_ANY:
+	case DI_TYPE_EMPTY_OBJECT:
+	case DI_TYPE_NINT:
+	case DI_TYPE_NUINT:
+	case DI_TYPE_UINT:
+	case DI_TYPE_POINTER:
+	case DI_TYPE_WEAK_OBJECT:
+	case DI_TYPE_STRING_LITERAL:
+	case DI_TYPE_ARRAY:
+	case DI_TYPE_TUPLE:
+	case DI_TYPE_VARIANT:
+	case DI_LAST_TYPE:
+		break;
+	}
+	return -1;
+}
+
+/// Find the thunk for a function with the given signature, NULL if there isn't one.
+static di_thunk_fn nullable
+di_closure_thunk(di_type rtype, int nargs, const di_type *atypes) {
+	int r = di_thunk_ret_index(rtype);
+	int a[3];
+	if (r < 0 || nargs > 3) {
+		return NULL;
+	}
+	for (int i = 0; i < nargs; i++) {
+		a[i] = di_thunk_arg_index(atypes[i]);
+		if (a[i] < 0) {
+			return NULL;
+		}
+	}
+	switch (nargs) {
+	case 0:
+		return thunks0[r];
+	case 1:
+		return thunks1[r][a[0]];
+	case 2:
+		return thunks2[r][a[0]][a[1]];
+	case 3:
+		return thunks3[r][a[0]][a[1]][a[2]];
+	default:
+		unreachable();
+	}
+}
 
-static int di_typed_trampoline(ffi_cif *cif, void (*fn)(void), di_type *ret_type,
-                               void *ret, const di_type *fnats, di_tuple args) {
+/// Call the function of `cl` with its captures, followed by `args`.
+static int di_typed_trampoline(struct di_closure *cl, void *ret, di_tuple args) {
 	assert(args.length == 0 || args.elements != NULL);
-	assert(args.length >= 0);
 	assert(args.length <= MAX_NARGS);
 
-	struct di_variant *vars = args.elements;
-	auto xargs = (di_value **)alloca(args.length * sizeof(void *));
+	// Captures always have the exact types expected.
+	auto captures = cl->raw.obj.inline_values;
+	di_value *xargs[MAX_NARGS];
+	for (int i = 0; i < captures.length; i++) {
+		xargs[i] = captures.elements[i].value;
+	}
 
+	struct di_variant *vars = args.elements;
+	const di_type *atypes = cl->atypes + captures.length;
+	di_value **xvargs = xargs + captures.length;
 	int rc = 0;
 	for (int i = 0; i < args.length; i++) {
+		if (vars[i].type == atypes[i]) {
+			// Arguments are only borrowed, no need to copy them if no conversion
+			// is needed.
+			xvargs[i] = vars[i].value;
+			continue;
+		}
+
 		// Type check and implicit conversion
 		// conversion between all types of integers are allowed
 		// as long as there's no overflow
-		xargs[i] = alloca(di_sizeof_type(fnats[i]));
-		rc = di_type_conversion(vars[i].type, vars[i].value, fnats[i], xargs[i], true);
+		xvargs[i] = alloca(di_sizeof_type(atypes[i]));
+		rc = di_type_conversion(vars[i].type, vars[i].value, atypes[i], xvargs[i], true);
 		if (rc != 0) {
 			// Conversion failed
 			return rc;
 		}
 	}
 
-	ffi_call(cif, fn, ret, (void **)xargs);
+	if (cl->thunk != NULL) {
+		cl->thunk(cl->fn, ret, xargs);
+	} else {
+		ffi_call(&cl->cif, cl->fn, ret, (void **)xargs);
+	}
 	return rc;
 }
 static const char closure_type[] = "deai:closure";
@@ -66,19 +275,20 @@ static int closure_trampoline(di_object *o, di_type *rtype, di_value *ret, di_tu
 	}
 
 	struct di_closure *cl = (void *)o;
-	if (t.length != cl->nargs) {
+	if (t.length + cl->raw.obj.inline_values.length != cl->nargs) {
 		return -EINVAL;
 	}
 
 	*rtype = cl->rtype;
-	return di_typed_trampoline(&cl->cif, cl->fn, rtype, ret, cl->atypes, t);
+	return di_typed_trampoline(cl, ret, t);
 }
 
 static int raw_closure_trampoline(di_object *o, di_type *rtype, di_value *ret, di_tuple t) {
 	struct di_raw_closure *cl = (void *)o;
-
-	di_tuple captures = DI_TUPLE_INIT;
-	di_rawget_borrowed(o, "captures", captures);
+	auto captures = cl->obj.inline_values;
+	if (captures.length == 0) {
+		return cl->raw_fn(o, rtype, ret, t);
+	}
 
 	di_tuple args_with_captures = {
 	    .length = captures.length + t.length,
@@ -91,11 +301,55 @@ static int raw_closure_trampoline(di_object *o, di_type *rtype, di_value *ret, d
 	return cl->raw_fn(o, rtype, ret, args_with_captures);
 }
 
+static void free_raw_closure(di_object *o) {
+	struct di_raw_closure *cl = (void *)o;
+	auto captures = cl->obj.inline_values;
+	cl->obj.inline_values = DI_TUPLE_INIT;
+	for (int i = 0; i < captures.length; i++) {
+		di_free_value(captures.elements[i].type, captures.elements[i].value);
+	}
+}
+
 static void free_closure(di_object *o) {
 	assert(di_check_type(o, closure_type));
 
 	struct di_closure *cl = (void *)o;
 	free((void *)cl->cif.arg_types);
+	free_raw_closure(o);
+}
+
+static inline size_t di_capture_value_size(di_type type) {
+	return (di_sizeof_type(type) + alignof(di_value) - 1) & ~(alignof(di_value) - 1);
+}
+
+/// Allocate a raw closure of `size` bytes, with the captures stored right after it,
+/// without setting its type.
+static struct di_raw_closure *
+di_alloc_raw_closure(di_call_fn fn, di_tuple captures, size_t size, size_t align) {
+	size_t offset = (size + alignof(struct di_variant) - 1) & ~(alignof(struct di_variant) - 1);
+	size_t total = offset + sizeof(struct di_variant) * captures.length;
+	for (int i = 0; i < captures.length; i++) {
+		total += di_capture_value_size(captures.elements[i].type);
+	}
+
+	struct di_raw_closure *cl = (void *)di_new_object(total, align);
+	cl->raw_fn = fn;
+	cl->obj.call = raw_closure_trampoline;
+	cl->obj.dtor = free_raw_closure;
+	if (captures.length == 0) {
+		return cl;
+	}
+
+	struct di_variant *vars = (void *)((char *)cl + offset);
+	char *values = (char *)&vars[captures.length];
+	for (int i = 0; i < captures.length; i++) {
+		vars[i].type = captures.elements[i].type;
+		vars[i].value = (di_value *)values;
+		di_copy_value(vars[i].type, vars[i].value, captures.elements[i].value);
+		values += di_capture_value_size(vars[i].type);
+	}
+	cl->obj.inline_values = (di_tuple){.length = captures.length, .elements = vars};
+	return cl;
 }
 
 /// Create a di_object that when called, calls the given function with the given captures
@@ -112,11 +366,7 @@ di_create_raw_closure(di_call_fn fn, di_tuple captures, size_t size, size_t alig
 		}
 	}
 
-	struct di_raw_closure *cl = (void *)di_new_object(size, align);
-	cl->raw_fn = fn;
-	cl->obj.call = raw_closure_trampoline;
-
-	di_member_clone(cl, "captures", captures);
+	struct di_raw_closure *cl = di_alloc_raw_closure(fn, captures, size, align);
 	DI_OK_OR_RET_PTR(di_set_type((void *)cl, "deai:raw_closure"));
 
 	return cl;
@@ -140,10 +390,13 @@ struct di_closure *di_create_closure(void (*fn)(void), di_type rtype, di_tuple c
 		}
 	}
 
-	struct di_closure *cl = (void *)di_create_raw_closure(
-	    closure_trampoline, captures,
-	    offsetof(struct di_closure, atypes[captures.length + nargs]),
+	// Arguments are type checked above, so there's no need to go through
+	// `di_create_raw_closure`.
+	struct di_closure *cl = (void *)di_alloc_raw_closure(
+	    NULL, captures, offsetof(struct di_closure, atypes[captures.length + nargs]),
 	    alignof(struct di_closure));
+	// The captures are passed to `fn` directly, without going through `raw_fn`
+	cl->raw.obj.call = closure_trampoline;
 
 	cl->rtype = rtype;
 	cl->fn = fn;
@@ -156,8 +409,10 @@ struct di_closure *di_create_closure(void (*fn)(void), di_type rtype, di_tuple c
 		memcpy(cl->atypes + captures.length, arg_types, sizeof(di_type) * nargs);
 	}
 
-	auto ffiret = di_ffi_prep_cif(&cl->cif, cl->nargs, cl->rtype, cl->atypes);
-	if (ffiret != FFI_OK) {
+	// libffi is only needed if there's no thunk for this signature
+	cl->thunk = di_closure_thunk(cl->rtype, cl->nargs, cl->atypes);
+	if (cl->thunk == NULL &&
+	    di_ffi_prep_cif(&cl->cif, cl->nargs, cl->rtype, cl->atypes) != FFI_OK) {
 		di_unref_object((di_object *)cl);
 		return ERR_PTR(-EINVAL);
 	}
@@ -168,28 +423,53 @@ struct di_closure *di_create_closure(void (*fn)(void), di_type rtype, di_tuple c
 	return cl;
 }
 
-int di_add_method(di_object *o, di_string name, void (*fn)(void), di_type rtype, int nargs, ...) {
+static struct di_closure *nullable di_create_method(void (*fn)(void), di_type rtype, int nargs,
+                                                    va_list ap) {
 	if (nargs < 0 || nargs + 1 > MAX_NARGS) {
-		return -EINVAL;
+		return ERR_PTR(-EINVAL);
 	}
 
 	// Get argument types
 	di_type *ats = alloca(sizeof(di_type) * (nargs + 1));
-	va_list ap;
-	va_start(ap, nargs);
 	for (unsigned int i = 0; i < nargs; i++) {
 		ats[i + 1] = va_arg(ap, di_type);
 		if (ats[i + 1] == DI_TYPE_NIL) {
-			return -EINVAL;
+			return ERR_PTR(-EINVAL);
 		}
 	}
-	va_end(ap);
 
 	ats[0] = DI_TYPE_OBJECT;
-	auto f = di_create_closure(fn, rtype, DI_TUPLE_INIT, nargs + 1, ats);
+	return di_create_closure(fn, rtype, DI_TUPLE_INIT, nargs + 1, ats);
+}
+
+int di_add_method(di_object *o, di_string name, void (*fn)(void), di_type rtype, int nargs, ...) {
+	va_list ap;
+	va_start(ap, nargs);
+	auto f = di_create_method(fn, rtype, nargs, ap);
+	va_end(ap);
+	if (IS_ERR(f)) {
+		return (int)PTR_ERR(f);
+	}
 	return di_add_member_move(o, name, (di_type[]){DI_TYPE_OBJECT}, (void *)&f);
 }
 
+int di_add_type_method(const char *type, di_string name, void (*fn)(void), di_type rtype,
+                       int nargs, ...) {
+	va_list ap;
+	va_start(ap, nargs);
+	auto f = di_create_method(fn, rtype, nargs, ap);
+	va_end(ap);
+	if (IS_ERR(f)) {
+		return (int)PTR_ERR(f);
+	}
+	di_type t = DI_TYPE_OBJECT;
+	int ret = di_add_type_member_move(type, name, &t, (void *)&f);
+	if (ret != 0) {
+		di_unref_object((di_object *)f);
+	}
+	return ret;
+}
+
 struct di_field_getter {
 	di_object_internal;
 	di_type type;
@@ -225,5 +505,216 @@ di_object *di_new_field_getter(di_type type, ptrdiff_t offset) {
 
 int di_call_object(di_object *obj, di_type *rt, di_value *ret, di_tuple args) {
 	auto internal = (di_object_internal *)obj;
-	return internal->call(obj, rt, ret, args);
+	auto start = di_trace_begin();
+	if (start == 0) {
+		return internal->call(obj, rt, ret, args);
+	}
+	// The object could be gone after the call. Types are string literals.
+	auto type = di_get_type(obj);
+	int rc = internal->call(obj, rt, ret, args);
+	di_trace_end("call", IS_ERR(type) ? DI_STRING_INIT : di_string_borrow(type), start);
+	return rc;
+}
+
+#ifdef UNITTESTS
+// Functions for every signature that has a thunk. They record their arguments, and return
+// a fixed value, so the thunks can be checked against libffi.
+static di_value thunk_test_args[3];
+static di_object *thunk_test_object;
+
+#define DI_THUNK_TEST_RETURN_NIL
+#define DI_THUNK_TEST_RETURN_OBJECT return di_ref_object(thunk_test_object);
+#define DI_THUNK_TEST_RETURN_INT return INT64_C(-0x123456789);
+#define DI_THUNK_TEST_RETURN_STRING return di_string_borrow_literal("returned");
+#define DI_THUNK_TEST_RECORD(i, a) memcpy(&thunk_test_args[i], &a, sizeof(a));
+
+#define DI_DEFINE_THUNK_TEST0(R)                                                         \
+	static DI_THUNK_CTYPE_##R di_thunk_test_##R(void) {                                  \
+		DI_THUNK_TEST_RETURN_##R                                                         \
+	}
+#define DI_DEFINE_THUNK_TEST1(R, A)                                                      \
+	static DI_THUNK_CTYPE_##R di_thunk_test_##R##_##A(DI_THUNK_CTYPE_##A a) {            \
+		DI_THUNK_TEST_RECORD(0, a)                                                       \
+		DI_THUNK_TEST_RETURN_##R                                                         \
+	}
+#define DI_DEFINE_THUNK_TEST2(R, A, B)                                                   \
+	static DI_THUNK_CTYPE_##R di_thunk_test_##R##_##A##_##B(DI_THUNK_CTYPE_##A a,        \
+	                                                        DI_THUNK_CTYPE_##B b) {      \
+		DI_THUNK_TEST_RECORD(0, a)                                                       \
+		DI_THUNK_TEST_RECORD(1, b)                                                       \
+		DI_THUNK_TEST_RETURN_##R                                                         \
+	}
+#define DI_DEFINE_THUNK_TEST3(R, A, B, C)                                                \
+	static DI_THUNK_CTYPE_##R di_thunk_test_##R##_##A##_##B##_##C(                       \
+	    DI_THUNK_CTYPE_##A a, DI_THUNK_CTYPE_##B b, DI_THUNK_CTYPE_##C c) {              \
+		DI_THUNK_TEST_RECORD(0, a)                                                       \
+		DI_THUNK_TEST_RECORD(1, b)                                                       \
+		DI_THUNK_TEST_RECORD(2, c)                                                       \
+		DI_THUNK_TEST_RETURN_##R                                                         \
+	}
+
+#define DI_DEFINE_THUNK_TESTS1(R) DI_THUNK_ARG_TYPES_1(DI_DEFINE_THUNK_TEST1, R)
+#define DI_DEFINE_THUNK_TESTS2_(R, A) DI_THUNK_ARG_TYPES_2(DI_DEFINE_THUNK_TEST2, R, A)
+#define DI_DEFINE_THUNK_TESTS2(R) DI_THUNK_ARG_TYPES_1(DI_DEFINE_THUNK_TESTS2_, R)
+#define DI_DEFINE_THUNK_TESTS3__(R, A, B)                                                \
+	DI_THUNK_ARG_TYPES_3(DI_DEFINE_THUNK_TEST3, R, A, B)
+#define DI_DEFINE_THUNK_TESTS3_(R, A) DI_THUNK_ARG_TYPES_2(DI_DEFINE_THUNK_TESTS3__, R, A)
+#define DI_DEFINE_THUNK_TESTS3(R) DI_THUNK_ARG_TYPES_1(DI_DEFINE_THUNK_TESTS3_, R)
+
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNK_TEST0)
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNK_TESTS1)
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNK_TESTS2)
+DI_THUNK_RET_TYPES(DI_DEFINE_THUNK_TESTS3)
+
+static bool di_thunk_test_value_eq(di_type type, const di_value *a, const di_value *b) {
+	switch (type) {
+	case DI_TYPE_NIL:
+		return true;
+	case DI_TYPE_OBJECT:
+		return a->object == b->object;
+	case DI_TYPE_INT:
+		return a->int_ == b->int_;
+	case DI_TYPE_STRING:
+		return a->string.data == b->string.data && a->string.length == b->string.length;
+	case DI_TYPE_BOOL:
+		return a->bool_ == b->bool_;
+	case DI_TYPE_FLOAT:
+		return a->float_ == b->float_;
+	case DI_TYPE_ANY:
+	case DI_TYPE_EMPTY_OBJECT:
+	case DI_TYPE_NINT:
+	case DI_TYPE_NUINT:
+	case DI_TYPE_UINT:
+	case DI_TYPE_POINTER:
+	case DI_TYPE_WEAK_OBJECT:
+	case DI_TYPE_STRING_LITERAL:
+	case DI_TYPE_ARRAY:
+	case DI_TYPE_TUPLE:
+	case DI_TYPE_VARIANT:
+	case DI_LAST_TYPE:
+		// Not used by any thunk
+		break;
+	}
+	unreachable();
+}
+
+/// Call `cl` with a distinct value of the right type for each argument, and record what
+/// the function received.
+static void di_thunk_test_call(struct di_closure *cl, di_type *rtype, di_value *ret,
+                               di_value received[static 3]) {
+	// Each argument lives in its own buffer, bools are put at odd addresses.
+	alignas(di_value) uint8_t storage[3][sizeof(di_value) * 2];
+	struct di_variant vars[3];
+	for (int i = 0; i < cl->nargs; i++) {
+		di_value *value = (di_value *)storage[i];
+		switch (cl->atypes[i]) {
+		case DI_TYPE_OBJECT:
+			value->object = thunk_test_object;
+			break;
+		case DI_TYPE_INT:
+			value->int_ = INT64_C(0x0123456789abcdef) + i;
+			break;
+		case DI_TYPE_STRING:
+			value->string = di_string_borrow_literal("argument");
+			value->string.length -= i;
+			break;
+		case DI_TYPE_BOOL:
+			value = (di_value *)(storage[i] + 1);
+			*(bool *)value = i % 2 == 0;
+			break;
+		case DI_TYPE_FLOAT:
+			value->float_ = 0.5 + i;
+			break;
+		case DI_TYPE_NIL:
+		case DI_TYPE_ANY:
+		case DI_TYPE_EMPTY_OBJECT:
+		case DI_TYPE_NINT:
+		case DI_TYPE_NUINT:
+		case DI_TYPE_UINT:
+		case DI_TYPE_POINTER:
+		case DI_TYPE_WEAK_OBJECT:
+		case DI_TYPE_STRING_LITERAL:
+		case DI_TYPE_ARRAY:
+		case DI_TYPE_TUPLE:
+		case DI_TYPE_VARIANT:
+		case DI_LAST_TYPE:
+			// Not an argument type of any thunk
+			unreachable();
+		}
+		vars[i] = (struct di_variant){.type = cl->atypes[i], .value = value};
+	}
+
+	memset(thunk_test_args, 0, sizeof(thunk_test_args));
+	memset(ret, 0, sizeof(*ret));
+	DI_CHECK_OK(closure_trampoline((di_object *)cl, rtype, ret,
+	                               (di_tuple){.length = cl->nargs, .elements = vars}));
+	memcpy(received, thunk_test_args, sizeof(thunk_test_args));
+	for (int i = 0; i < cl->nargs; i++) {
+		auto arg = (di_value *)storage[i];
+		if (cl->atypes[i] == DI_TYPE_BOOL) {
+			// Compare the bool as loaded by its own type
+			DI_CHECK(received[i].bool_ == *(bool *)(storage[i] + 1));
+		} else {
+			DI_CHECK(di_thunk_test_value_eq(cl->atypes[i], &received[i], arg));
+		}
+	}
+}
+
+/// Check the thunk of `fn` passes the same arguments, and returns the same value, as
+/// libffi.
+static void
+di_check_thunk(void (*fn)(void), di_type rtype, int nargs, const di_type *atypes) {
+	auto thunked = di_create_closure(fn, rtype, DI_TUPLE_INIT, nargs, atypes);
+	auto ffi = di_create_closure(fn, rtype, DI_TUPLE_INIT, nargs, atypes);
+	DI_CHECK(!IS_ERR_OR_NULL(thunked) && !IS_ERR_OR_NULL(ffi));
+	DI_CHECK(thunked->thunk != NULL);
+	ffi->thunk = NULL;
+	DI_CHECK(di_ffi_prep_cif(&ffi->cif, ffi->nargs, ffi->rtype, ffi->atypes) == FFI_OK);
+
+	di_type thunk_rtype, ffi_rtype;
+	di_value thunk_ret, ffi_ret;
+	di_value thunk_args[3], ffi_args[3];
+	di_thunk_test_call(thunked, &thunk_rtype, &thunk_ret, thunk_args);
+	di_thunk_test_call(ffi, &ffi_rtype, &ffi_ret, ffi_args);
+	DI_CHECK(thunk_rtype == rtype && ffi_rtype == rtype);
+	DI_CHECK(di_thunk_test_value_eq(rtype, &thunk_ret, &ffi_ret));
+	for (int i = 0; i < nargs; i++) {
+		DI_CHECK(di_thunk_test_value_eq(atypes[i], &thunk_args[i], &ffi_args[i]));
+	}
+	if (rtype == DI_TYPE_OBJECT) {
+		DI_CHECK(thunk_ret.object == thunk_test_object);
+		di_unref_object(thunk_ret.object);
+		di_unref_object(ffi_ret.object);
+	}
+	di_unref_object((di_object *)thunked);
+	di_unref_object((di_object *)ffi);
+}
+
+#define DI_CHECK_THUNK0(R)                                                               \
+	di_check_thunk((void (*)(void))di_thunk_test_##R, DI_TYPE_##R, 0, NULL);
+#define DI_CHECK_THUNK1(R, A)                                                            \
+	di_check_thunk((void (*)(void))di_thunk_test_##R##_##A, DI_TYPE_##R, 1,              \
+	               (di_type[]){DI_TYPE_##A});
+#define DI_CHECK_THUNK2(R, A, B)                                                         \
+	di_check_thunk((void (*)(void))di_thunk_test_##R##_##A##_##B, DI_TYPE_##R, 2,        \
+	               (di_type[]){DI_TYPE_##A, DI_TYPE_##B});
+#define DI_CHECK_THUNK3(R, A, B, C)                                                      \
+	di_check_thunk((void (*)(void))di_thunk_test_##R##_##A##_##B##_##C, DI_TYPE_##R, 3,  \
+	               (di_type[]){DI_TYPE_##A, DI_TYPE_##B, DI_TYPE_##C});
+#define DI_CHECK_THUNKS1(R) DI_THUNK_ARG_TYPES_1(DI_CHECK_THUNK1, R)
+#define DI_CHECK_THUNKS2_(R, A) DI_THUNK_ARG_TYPES_2(DI_CHECK_THUNK2, R, A)
+#define DI_CHECK_THUNKS2(R) DI_THUNK_ARG_TYPES_1(DI_CHECK_THUNKS2_, R)
+#define DI_CHECK_THUNKS3__(R, A, B) DI_THUNK_ARG_TYPES_3(DI_CHECK_THUNK3, R, A, B)
+#define DI_CHECK_THUNKS3_(R, A) DI_THUNK_ARG_TYPES_2(DI_CHECK_THUNKS3__, R, A)
+#define DI_CHECK_THUNKS3(R) DI_THUNK_ARG_TYPES_1(DI_CHECK_THUNKS3_, R)
+
+void di_closure_unit_tests(void) {
+	thunk_test_object = di_new_object_with_type(di_object);
+	DI_THUNK_RET_TYPES(DI_CHECK_THUNK0)
+	DI_THUNK_RET_TYPES(DI_CHECK_THUNKS1)
+	DI_THUNK_RET_TYPES(DI_CHECK_THUNKS2)
+	DI_THUNK_RET_TYPES(DI_CHECK_THUNKS3)
+	di_unref_object(thunk_test_object);
+	thunk_test_object = NULL;
 }
+#endif
@@ -17,32 +17,112 @@
 #include "uthash.h"
 
 struct di_member {
+	/// Name of the member, `name.data` is NULL if this member has been removed.
 	di_string name;
-	di_value *nonnull data;
+	/// Hash of `name`, see `struct di_atom`
+	unsigned int hash;
 	di_type type;
+	/// Whether `name` is borrowed from an atom, instead of owned.
+	bool name_interned;
+	/// The value is stored inline, so pointers to it are only valid until the member
+	/// table is modified.
+	di_value value;
+};
+
+enum {
+	/// Member tables with at most this many entries don't have a hash index, lookups
+	/// simply compare the hashes of all the entries.
+	DI_MEMBER_TABLE_SMALL = 8,
+};
+
+/// Members of an object, in a single allocation. Members are stored in insertion order in
+/// `entries`, removed members are left as holes until the table is compacted, which only
+/// happens when a member is added. Tables with more than `DI_MEMBER_TABLE_SMALL` entries
+/// have an open addressing, linear probing hash index after the entries.
+struct di_member_table {
+	/// Number of allocated entries
+	uint32_t capacity;
+	/// Number of used entries, including the removed ones
+	uint32_t nentries;
+	/// Number of live members
+	uint32_t count;
+	/// log2 of the size of the hash index, 0 if there is no index
+	uint32_t index_bits;
+	/// Changed whenever a member is added or removed, never reused by another table. Lets
+	/// `di_member_cache` tell if the member it remembers is still where it was.
+	uint64_t stamp;
+	/// Bit `hash % 64` is set for every member that has been added since the table was
+	/// last rebuilt, a clear bit means there is no member with that hash.
+	uint64_t name_filter;
+	struct di_member entries[];
+};
+
+/// Members shared by all objects of the same type. An object's own members are looked up
+/// first, members of its type are only used as a fallback.
+struct di_type_table {
+	char *nonnull name;
+	struct di_member_table *nullable members;
+	/// Number of objects that have been given this type
+	uint64_t allocated;
+	/// Number of objects that have been finalized, or lost this type
+	uint64_t freed;
+	/// `signal_filter` of the members of this type, see `di_object_internal`
+	uint64_t signal_filter;
 	UT_hash_handle hh;
 };
 
+/// Weak references point to this small control block instead of to the object, so the
+/// object's memory can be freed as soon as it's destroyed.
+struct di_weak_object {
+	/// The referenced object, NULL once it has been destroyed.
+	struct di_object_internal *nullable object;
+	/// Number of weak references, plus one while the object is alive.
+	uint64_t ref_count;
+};
+
 typedef struct di_object_internal {
-	struct di_member *nullable members;
+	struct di_member_table *nullable members;
+	/// Shared members for the "__type" of this object, kept in sync with the "__type"
+	/// member.
+	struct di_type_table *nullable type_table;
 
 	di_dtor_fn nullable dtor;
 	di_call_fn nullable call;
 
 	uint64_t ref_count;
-	uint64_t weak_ref_count;
+	/// Control block for weak references to this object, created when the object is
+	/// first weakly referenced. The object holds a reference to it while alive.
+	struct di_weak_object *nullable weak_ref;
 	/// A temporary ref count variable used for object tracking and reference cycle
 	/// collection.
 	uint64_t ref_count_scan;
 	struct list_head unreferred_siblings;
+	/// Bloom filter over the names of the members that could provide signals: one bit
+	/// for each "__signal_" member, all bits if there is a getter that could return
+	/// signals. Emitting a signal that is not in the filter returns immediately.
+	uint64_t signal_filter;
+	/// Number of members accounted for in `signal_filter`. The filter can't remove
+	/// names, so it is only reset once this drops to 0.
+	uint32_t nsignal_members;
+	/// Values held by the object outside of its members, e.g. the captures of closures.
+	/// The garbage collector scans them like members, freeing them is left to `dtor`.
+	di_tuple inline_values;
 
 #ifdef TRACK_OBJECTS
 	struct list_head siblings;
-	char padding[46];
 #else
 	// Reserved for future use
-	char padding[62];
+	char padding[16];
 #endif
+	/// Position of this object in the pinned objects of the roots, plus 1. 0 if this
+	/// object is not pinned.
+	uint32_t pin_index;
+	/// Number of garbage collections this object has survived, saturates at
+	/// `DI_GC_OLD_AGE`.
+	uint8_t gc_age;
+	/// Size class of the slab pool this object is allocated from, 0 if it's allocated
+	/// with malloc.
+	uint8_t slab_class;
 	uint8_t mark;
 	uint8_t destroyed;
 } di_object_internal;
@@ -51,14 +131,14 @@ typedef struct di_object_internal {
 extern thread_local struct list_head all_objects;
 #endif
 
-struct di_anonymous_root {
-	di_object *nonnull obj;
-	UT_hash_handle hh;
-};
-
 struct di_roots {
 	di_object_internal;
-	struct di_anonymous_root *nullable anonymous_roots;
+	/// Objects pinned with `di_pin_object`, in no particular order
+	di_object *nonnull *nullable pinned;
+	uint32_t npinned;
+	uint32_t pinned_capacity;
+	/// Set when the roots are dropped by di:exit, no more objects can be pinned after that.
+	bool dropped;
 };
 
 struct di_ref_tracked_object {
@@ -168,7 +248,36 @@ static inline ffi_status unused di_ffi_prep_cif(ffi_cif *nonnull cif, unsigned i
 struct di_module *nullable di_new_module_with_size(di_object *nonnull di, size_t size);
 
 di_object *nullable di_try(void (*nonnull func)(void *nullable), void *nullable args);
+/// Collect all garbage in cyclic references.
 void di_collect_garbage(void);
+/// Do a bounded amount of garbage collection work, meant to be called once per event loop
+/// iteration. Might not collect all garbage, returns true if there are candidates left
+/// for later.
+bool di_collect_garbage_step(void);
+/// Deliver the emissions collected by batched signal handlers, meant to be called once per
+/// event loop iteration. Emissions collected while doing this are left for the next call.
+void di_flush_batched_signals(void);
+/// Whether there are emissions waiting for `di_flush_batched_signals`
+bool di_has_batched_signals(void);
+/// Create an object that reports the garbage collector and object lifetime statistics.
+di_object *nonnull di_new_gc_stats(void);
+/// Create the `di.trace` object, which starts and stops tracing.
+di_object *nonnull di_new_trace(void);
+/// Stop tracing, if it is started, and write out the trace file
+void di_trace_stop(void);
+/// Register the shared methods of the core types, like errors and signals.
+void di_init_object_types(void);
+/// Free all the per-type member tables. Objects that still exist after this will lose their
+/// shared members.
+void di_free_type_tables(void);
+#ifdef UNITTESTS
+/// Check that closures called through thunks get the same arguments, and return the same
+/// values, as when called through libffi.
+void di_closure_unit_tests(void);
+/// Check that steps of the garbage collector stay within their budget, and still collect
+/// cycles larger than it.
+void di_gc_unit_tests(void);
+#endif
 #if defined(TRACK_OBJECTS) || defined(ENABLE_STACK_TRACE)
 #include <elfutils/libdwfl.h>
 struct stack_annotate_context;
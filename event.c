@@ -9,13 +9,22 @@
 #include <deai/deai.h>
 #include <deai/error.h>
 #include <deai/helper.h>
+#include <deai/trace.h>
 #include <deai/type.h>
 
+#include <errno.h>
 #include <ev.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include "di_internal.h"
 #include "event.h"
+#include "loop_stats.h"
+#include "stream.h"
+#include "timer_wheel.h"
+#include "worker.h"
 
 struct di_ioev {
 	di_object_internal;
@@ -25,7 +34,10 @@ struct di_ioev {
 
 struct di_timer {
 	di_object_internal;
-	ev_timer evt;
+	/// In the timer wheel of the event module while there are listeners, in which case
+	/// the wheel holds a reference to this timer.
+	struct di_timer_wheel_entry entry;
+	di_weak_object *nonnull event_module;
 	double at;
 	bool spent;
 };
@@ -36,11 +48,42 @@ struct di_periodic {
 	bool running;
 };
 
+/// Promises waiting to have their handlers called, in the order they were settled. This
+/// is a ring buffer, which grows when full.
+struct di_microtask_queue {
+	struct di_promise *nonnull *nullable promises;
+	uint32_t head;
+	uint32_t count;
+	uint32_t capacity;
+};
+
 typedef struct di_event_module {
 	di_object_internal;
 	ev_idle idlew;
+	/// Started on the first `di_offload`
+	struct di_worker_pool *workers;
+	struct di_microtask_queue microtasks;
+
+	struct ev_loop *loop;
+	/// All the started timers. Timers due in the same tick are fired together.
+	struct di_timer_wheel timers;
+	/// Fires at the next tick `timers` has work to do
+	ev_timer timers_watcher;
+	/// The tick `timers_watcher` is set to fire at, UINT64_MAX if it's not started
+	uint64_t timers_watcher_tick;
+	/// Time of tick 0 of `timers`
+	double timers_origin;
+	/// Length of a tick of `timers`, in seconds
+	double timer_slack;
+	/// An anonymous root that keeps the event module alive while there are started timers
+	di_weak_object *nullable timers_keep_alive;
+	/// Signals posted from other threads
+	struct di_message_queue *messages;
 } di_event_module;
 
+/// Default length of a timer wheel tick, in seconds
+#define DI_TIMER_DEFAULT_SLACK 0.001
+
 static const char promise_type[] = "deai:Promise";
 
 /// SIGNAL: deai.builtin.event:IoEv.read() File descriptor became readable
@@ -51,19 +94,29 @@ static const char promise_type[] = "deai:Promise";
 /// readable or writable
 static void di_ioev_callback(EV_P_ ev_io *w, int revents) {
 	auto ev = container_of(w, struct di_ioev, evh);
+	auto start = di_loop_stats_begin();
+	auto trace_start = di_trace_begin();
 	if (revents & EV_READ) {
 		di_emit(ev, "read");
 	}
 	if (revents & EV_WRITE) {
 		di_emit(ev, "write");
 	}
+	if (trace_start != 0) {
+		char detail[16];
+		int len = snprintf(detail, sizeof(detail), "%d", w->fd);
+		di_trace_end("fd", (di_string){detail, (size_t)len}, trace_start);
+	}
+	di_loop_stats_end(DI_LOOP_SOURCE_IOEV, start);
 }
 
 /// SIGNAL: deai.builtin.event:Periodic.triggered(now: :float) Timeout was reached
 static void di_periodic_callback(EV_P_ ev_periodic *w, int revents) {
 	auto p = container_of(w, struct di_periodic, pt);
+	auto start = di_loop_stats_begin();
 	double now = ev_now(EV_A);
 	di_emit(p, "triggered", now);
+	di_loop_stats_end(DI_LOOP_SOURCE_PERIODIC, start);
 }
 
 /// Start the event source
@@ -84,9 +137,8 @@ static void di_start_ioev(struct di_ioev *ev) {
 	ev_io_start(di->loop, &ev->evh);
 
 	// Add event source to roots when it's running
-	auto roots = di_get_roots();
-	DI_CHECK_OK(di_callr(roots, "add_anonymous", ev->running, (di_object *)ev));
-	DI_CHECK(ev->running);
+	ev->running = true;
+	di_pin_object((di_object *)ev);
 }
 
 /// Stop the event source
@@ -108,9 +160,8 @@ static void di_stop_ioev(struct di_ioev *ev) {
 		ev->running = false;
 	}
 
-	auto roots = di_get_roots();
 	// Ignore error here, if someone called di:exit, we would've been removed already.
-	di_call(roots, "remove_anonymous", (di_object *)ev);
+	di_unpin_object((di_object *)ev);
 }
 
 /// Change monitored file descriptor events
@@ -210,20 +261,107 @@ static di_object *di_create_ioev(di_object *obj, int fd) {
 	return (void *)ret;
 }
 
+/// The first tick at or after time `at`
+static uint64_t di_timer_tick_of(di_event_module *em, double at) {
+	double ticks = (at - em->timers_origin) / em->timer_slack;
+	if (!(ticks > 0)) {
+		return 0;
+	}
+	auto tick = (uint64_t)ticks;
+	return (double)tick < ticks ? tick + 1 : tick;
+}
+
+/// Make sure `timers_watcher` fires when the timer wheel next has work to do.
+static void di_timers_update_watcher(di_event_module *em) {
+	uint64_t next = di_timer_wheel_next(&em->timers);
+	if (next == em->timers_watcher_tick) {
+		return;
+	}
+	ev_timer_stop(em->loop, &em->timers_watcher);
+	em->timers_watcher_tick = next;
+	if (next == UINT64_MAX) {
+		return;
+	}
+	double after = em->timers_origin + (double)next * em->timer_slack - ev_now(em->loop);
+	ev_timer_set(&em->timers_watcher, after > 0 ? after : 0, 0.0);
+	ev_timer_start(em->loop, &em->timers_watcher);
+}
+
+static void di_timers_keep_alive_dtor(di_object *obj);
+
+/// Keep the event module alive if there are started timers, and let it go otherwise.
+static int di_timers_update_keep_alive(di_event_module *em) {
+	if (em->timers.count > 0 && em->timers_keep_alive == NULL) {
+		scoped_di_object *keep_alive = di_new_object_with_type_name(
+		    sizeof(di_object), alignof(di_object), "deai.event:PendingTimers");
+		di_member_clone(keep_alive, "event_module", (di_object *)em);
+		di_set_object_dtor(keep_alive, di_timers_keep_alive_dtor);
+		if (!di_pin_object(keep_alive)) {
+			return -ENOENT;
+		}
+		em->timers_keep_alive = di_weakly_ref_object(keep_alive);
+	} else if (em->timers.count == 0 && em->timers_keep_alive != NULL) {
+		scoped_di_object *keep_alive = di_upgrade_weak_ref(em->timers_keep_alive);
+		di_drop_weak_ref(&em->timers_keep_alive);
+		em->timers_keep_alive = NULL;
+		if (keep_alive != NULL) {
+			// Ignore error because roots might have been removed by di:exit
+			di_unpin_object(keep_alive);
+		}
+	}
+	return 0;
+}
+
+static void di_timer_delete_signal(di_object *o);
+
+/// Stop all the timers in `entries`, which have been taken out of the wheel.
+static void di_timers_stop_all(di_event_module *em, struct list_head *entries) {
+	while (!list_empty(entries)) {
+		auto t = list_first_entry(entries, struct di_timer, entry.siblings);
+		di_timer_wheel_remove(&em->timers, &t->entry);
+		di_timer_delete_signal((di_object *)t);
+		di_unref_object((di_object *)t);
+	}
+}
+
+/// The anonymous root is dropped on di:exit, stop all the timers then, like the old
+/// per-timer roots would.
+static void di_timers_keep_alive_dtor(di_object *obj) {
+	scoped_di_object *event_module = NULL;
+	if (di_get(obj, "event_module", event_module) != 0) {
+		return;
+	}
+	auto em = (di_event_module *)event_module;
+	struct list_head entries;
+	INIT_LIST_HEAD(&entries);
+	di_timer_wheel_drain(&em->timers, &entries);
+	di_timers_stop_all(em, &entries);
+	di_timers_update_watcher(em);
+	if (em->timers_keep_alive != NULL) {
+		di_drop_weak_ref(&em->timers_keep_alive);
+		em->timers_keep_alive = NULL;
+	}
+}
+
 static void di_timer_delete_signal(di_object *o) {
 	if (di_delete_member_raw(o, di_string_borrow_literal("__signal_elapsed")) != 0) {
 		return;
 	}
 
 	auto t = (struct di_timer *)o;
-	auto roots = di_get_roots();
-
-	// Ignore error because roots might have been removed by di:exit
-	di_call(roots, "remove_anonymous", o);
+	if (!di_timer_wheel_entry_pending(&t->entry)) {
+		return;
+	}
 
-	di_object *di_obj = di_object_borrow_deai(o);
-	auto di = (struct deai *)di_obj;
-	ev_timer_stop(di->loop, &t->evt);
+	// Armed timers keep the event module alive
+	scoped_di_object *event_module = di_upgrade_weak_ref(t->event_module);
+	DI_CHECK(event_module != NULL);
+	auto em = (di_event_module *)event_module;
+	di_timer_wheel_remove(&em->timers, &t->entry);
+	di_timers_update_watcher(em);
+	di_timers_update_keep_alive(em);
+	// Drop the reference held by the wheel
+	di_unref_object(o);
 }
 
 static void di_timer_add_signal(di_object *o, di_object *sig) {
@@ -232,8 +370,8 @@ static void di_timer_add_signal(di_object *o, di_object *sig) {
 		return;
 	}
 
-	di_object *di_obj = di_object_borrow_deai(o);
-	if (di_obj == NULL) {
+	scoped_di_object *event_module = di_upgrade_weak_ref(t->event_module);
+	if (event_module == NULL || di_object_borrow_deai(o) == NULL) {
 		return;
 	}
 
@@ -241,39 +379,59 @@ static void di_timer_add_signal(di_object *o, di_object *sig) {
 		return;
 	}
 
-	// Add ourselve to GC root
-	auto roots = di_get_roots();
-	bool added = false;
-	if (di_callr(roots, "add_anonymous", added, o) != 0) {
+	auto em = (di_event_module *)event_module;
+	di_timer_wheel_add(&em->timers, &t->entry, di_timer_tick_of(em, t->at));
+	di_ref_object(o);
+	if (di_timers_update_keep_alive(em) != 0) {
 		// Could happen if di:exit is called
 		di_timer_delete_signal(o);
 		return;
 	}
-	DI_CHECK(added);
-	auto di = (struct deai *)di_obj;
-
-	// Recalculate timeout
-	double after = t->at - ev_now(di->loop);
-	ev_timer_set(&t->evt, after, 0.0);
-	ev_timer_start(di->loop, &t->evt);
+	di_timers_update_watcher(em);
 }
 
 /// SIGNAL: deai.builtin.event:Timer.elapsed(now: :float) Timeout was reached
-static void di_timer_callback(EV_P_ ev_timer *t, int revents) {
-	auto d = container_of(t, struct di_timer, evt);
-	// Keep timer alive because we will still be using it after emission.
-	scoped_di_object unused *obj = di_ref_object((di_object *)d);
+static void di_timers_callback(EV_P_ ev_timer *w, int revents) {
+	auto em = container_of(w, di_event_module, timers_watcher);
+	// Keep the event module alive, the last timer could be stopped during emission.
+	scoped_di_object unused *obj = di_ref_object((di_object *)em);
+	auto start = di_loop_stats_begin();
+	if (start != 0) {
+		double due =
+		    em->timers_origin + (double)em->timers_watcher_tick * em->timer_slack;
+		di_loop_stats_lag(ev_time() - due);
+	}
+	em->timers_watcher_tick = UINT64_MAX;
 
+	// The last tick that has fully passed. The watcher could fire a tiny bit early
+	// because of rounding errors, so allow for that.
 	double now = ev_now(EV_A);
-	di_object *di_obj = di_object_borrow_deai((di_object *)d);
-	DI_CHECK(di_obj);
-
-	auto di = (struct deai *)di_obj;
-	ev_timer_stop(di->loop, t);
-	d->spent = true;
-	di_emit(d, "elapsed", now);
+	double ticks = (now - em->timers_origin) / em->timer_slack + 1e-6;
+	uint64_t tick = ticks > 0 ? (uint64_t)ticks : 0;
+	struct list_head expired;
+	INIT_LIST_HEAD(&expired);
+	di_timer_wheel_advance(&em->timers, tick, &expired);
+	// Expired timers could be stopped by the handlers of the other timers, in which case
+	// they are removed from `expired`.
+	while (!list_empty(&expired)) {
+		auto t = list_first_entry(&expired, struct di_timer, entry.siblings);
+		di_timer_wheel_remove(&em->timers, &t->entry);
+		t->spent = true;
+		di_emit(t, "elapsed", now);
+		di_timer_delete_signal((di_object *)t);
+		// Drop the reference held by the wheel
+		di_unref_object((di_object *)t);
+	}
+	di_timers_update_watcher(em);
+	di_timers_update_keep_alive(em);
+	di_loop_stats_end(DI_LOOP_SOURCE_TIMER, start);
+}
 
-	di_timer_delete_signal((void *)d);
+static void di_timer_dtor(di_object *o) {
+	auto t = (struct di_timer *)o;
+	// The wheel holds a reference, so the timer can't be pending here.
+	DI_CHECK(!di_timer_wheel_entry_pending(&t->entry));
+	di_drop_weak_ref(&t->event_module);
 }
 
 /// Timer events
@@ -287,6 +445,9 @@ static void di_timer_callback(EV_P_ ev_timer *t, int revents) {
 /// Create a timer that emits a signal after timeout is reached. Note that signals will
 /// only be emitted if listeners exist. If no listeners existed during the timeout window,
 /// the singal will be emitted when the first listener is attached.
+///
+/// The signal could be emitted up to :lua:attr:`timer_slack` seconds late, so timers
+/// due around the same time are handled together.
 static di_object *di_create_timer(di_object *obj, double timeout) {
 	struct di_module *em = (void *)obj;
 	auto ret = di_new_object_with_type(struct di_timer);
@@ -299,11 +460,12 @@ static di_object *di_create_timer(di_object *obj, double timeout) {
 	auto di = (struct deai *)di_obj;
 
 	ret->spent = false;
-	ret->dtor = di_timer_delete_signal;
+	ret->event_module = di_weakly_ref_object(obj);
+	di_timer_wheel_entry_init(&ret->entry);
+	ret->dtor = di_timer_dtor;
 	di_signal_setter_deleter(ret, "elapsed", di_timer_add_signal, di_timer_delete_signal);
 
 	ret->at = ev_now(di->loop) + timeout;
-	ev_timer_init(&ret->evt, di_timer_callback, timeout, 0.0);
 
 	// Started timers have strong references to di
 	// Stopped ones have weak ones
@@ -311,6 +473,40 @@ static di_object *di_create_timer(di_object *obj, double timeout) {
 	return (di_object *)ret;
 }
 
+/// Timer slack
+///
+/// EXPORT: event.timer_slack: :float
+///
+/// Read/write property for how late, in seconds, timers are allowed to fire. Timers due
+/// within the same slack interval are fired together. Defaults to 1 millisecond.
+static double di_get_timer_slack(di_event_module *em) {
+	return em->timer_slack;
+}
+
+static int di_set_timer_slack(di_event_module *em, double slack) {
+	if (!(slack > 0)) {
+		return -EINVAL;
+	}
+	// Put the started timers into a new wheel, with ticks of the new length.
+	struct list_head entries;
+	INIT_LIST_HEAD(&entries);
+	di_timer_wheel_drain(&em->timers, &entries);
+	em->timers_origin = ev_now(em->loop);
+	em->timer_slack = slack;
+	di_timer_wheel_init(&em->timers, 0);
+
+	struct di_timer *t, *nt;
+	list_for_each_entry_safe (t, nt, &entries, entry.siblings) {
+		di_timer_wheel_remove(&em->timers, &t->entry);
+		di_timer_wheel_add(&em->timers, &t->entry, di_timer_tick_of(em, t->at));
+	}
+	// Ticks are counted from the new origin now, the tick the watcher was started for
+	// means something else.
+	em->timers_watcher_tick = UINT64_MAX;
+	di_timers_update_watcher(em);
+	return 0;
+}
+
 /// Update timer interval and offset
 ///
 /// EXPORT: deai.builtin.event:Periodic.set(interval: :float, offset: :float): :void
@@ -329,10 +525,7 @@ static void di_periodic_signal_setter(di_object *o, di_object *sig) {
 	if (di_member_clone(o, di_signal_member_of("triggered"), sig) != 0) {
 		return;
 	}
-	auto roots = di_get_roots();
-	bool added = false;
-	DI_CHECK_OK(di_callr(roots, "add_anonymous", added, o));
-	DI_CHECK(added);
+	di_pin_object(o);
 }
 
 static void di_periodic_signal_deleter(di_object *o) {
@@ -342,8 +535,7 @@ static void di_periodic_signal_deleter(di_object *o) {
 		return;
 	}
 
-	auto roots = di_get_roots();
-	di_call(roots, "remove_anonymous", o);
+	di_unpin_object(o);
 }
 
 /// Periodic timer event
@@ -372,21 +564,53 @@ static di_object *di_create_periodic(struct di_module *evm, double interval, dou
 
 struct di_prepare {
 	ev_prepare;
+	/// Active when garbage collection has been deferred, to finish it once the loop is
+	/// idle.
+	ev_idle gc_idle;
+	/// Active when there are batched emissions left, so the loop doesn't block before
+	/// delivering them.
+	ev_idle batch_idle;
 	struct di_module *evm;
 };
 
+static void di_gc_idle(EV_P_ ev_idle *w, int revents) {
+	ev_idle_stop(EV_A_ w);
+	di_collect_garbage();
+}
+
+static void di_batch_idle(EV_P_ ev_idle *w, int revents) {
+	// Nothing to do, the emissions are delivered in the next `di_prepare`
+	ev_idle_stop(EV_A_ w);
+}
+
 static void di_prepare(EV_P_ ev_prepare *w, int revents) {
 	struct di_prepare *dep = (void *)w;
+	auto start = di_loop_stats_begin();
 	// Event module could be freed by garbage collector (because here we don't
 	// increment the reference count). Use a weak reference to detect when it's freed.
 	scoped_di_weak_object *weak_eventm = di_weakly_ref_object((void *)dep->evm);
-	di_collect_garbage();
+	// Everything emitted during this iteration has been emitted by now.
+	di_flush_batched_signals();
+
+	// Only do a bounded amount of work here, so the cost of collection doesn't grow with
+	// the rate of events. Whatever is left is collected when there is nothing else to do.
+	if (di_collect_garbage_step()) {
+		ev_idle_start(EV_A_ & dep->gc_idle);
+	} else {
+		ev_idle_stop(EV_A_ & dep->gc_idle);
+	}
 
 	// Keep event module alive during emission
 	scoped_di_object *obj = di_upgrade_weak_ref(weak_eventm);
 	if (obj) {
 		di_emit(obj, "prepare");
 	}
+
+	// Deliver emissions batched since the flush in the next iteration
+	if (di_has_batched_signals()) {
+		ev_idle_start(EV_A_ & dep->batch_idle);
+	}
+	di_loop_stats_end(DI_LOOP_SOURCE_PREPARE, start);
 }
 
 /// A pending value
@@ -396,9 +620,53 @@ static void di_prepare(EV_P_ ev_prepare *w, int revents) {
 /// This encapsulates a pending value. Once this value become available, a "resolved"
 /// signal will be emitted with the value. Each promise should resolve only once ever.
 struct di_promise {
-	di_object;
+	di_object_internal;
+	enum {
+		DI_PROMISE_PENDING,
+		DI_PROMISE_RESOLVED,
+		DI_PROMISE_REJECTED,
+	} state;
+	/// Whether the promise is in the microtask queue of the event module
+	bool queued;
+	di_weak_object *nonnull event_module;
+	/// The value resolved to, or the error rejected with
+	di_type result_type;
+	di_value result;
+	/// Handlers to call once the promise is settled, an array of objects
+	di_array handlers;
+	int handlers_capacity;
+	/// `handlers` and the result, pointed to by `inline_values` so the garbage collector
+	/// can see them.
+	struct di_variant gc_values[2];
 };
 
+static void
+di_microtask_queue_push(struct di_microtask_queue *q, struct di_promise *promise) {
+	if (q->count == q->capacity) {
+		uint32_t capacity = q->capacity ? q->capacity * 2 : 16;
+		auto promises = tmalloc(struct di_promise *, capacity);
+		for (uint32_t i = 0; i < q->count; i++) {
+			promises[i] = q->promises[(q->head + i) % q->capacity];
+		}
+		free(q->promises);
+		q->promises = promises;
+		q->head = 0;
+		q->capacity = capacity;
+	}
+	q->promises[(q->head + q->count) % q->capacity] = promise;
+	q->count++;
+}
+
+static struct di_promise *nullable di_microtask_queue_pop(struct di_microtask_queue *q) {
+	if (q->count == 0) {
+		return NULL;
+	}
+	auto promise = q->promises[q->head];
+	q->head = (q->head + 1) % q->capacity;
+	q->count--;
+	return promise;
+}
+
 /// Call an array of handlers with a value. Consumes the handlers array.
 static void di_handlers_dispatch(di_array handlers, int type, di_variant value) {
 	DI_CHECK(handlers.length == 0 || handlers.elem_type == DI_TYPE_OBJECT);
@@ -434,35 +702,43 @@ static void di_handlers_dispatch(di_array handlers, int type, di_variant value)
 	}
 	free(handlers.arr);
 }
-static int di_promise_dispatch(di_promise *promise) {
-	scoped_di_variant resolved = DI_VARIANT_INIT;
-	di_object *rejected = NULL;
-	di_variant handlers_v;
-	di_array handlers = DI_ARRAY_INIT;
-	if (di_remove_member_raw((di_object *)promise,
-	                         di_string_borrow_literal("___handlers"), &handlers_v) == 0) {
-		handlers = handlers_v.value->array;
-		free(handlers_v.value);
-	}
-	if (di_get(promise, "___resolved", resolved) == 0) {
-		di_handlers_dispatch(handlers, 0, resolved);
-	} else if (di_get(promise, "___rejected", rejected) == 0 && handlers.length > 0) {
-		di_variant var = {
-		    .type = DI_TYPE_OBJECT,
-		    .value = (di_value *)&rejected,
-		};
-		di_handlers_dispatch(handlers, 1, var);
-		di_unref_object(rejected);
-		rejected = NULL;
+
+static void di_promise_dispatch(struct di_promise *promise) {
+	// Handlers added from now on need another dispatch
+	promise->queued = false;
+	di_array handlers = promise->handlers;
+	promise->handlers = (di_array){.elem_type = DI_TYPE_OBJECT};
+	promise->handlers_capacity = 0;
+
+	di_variant result = {.type = promise->result_type, .value = &promise->result};
+	if (promise->result_type == DI_TYPE_VARIANT) {
+		result = promise->result.variant;
 	}
-	di_delete_member_raw((void *)promise, di_string_borrow_literal("is_pending"));
-	if (rejected) {
-		scoped_di_string error_message = di_object_to_string(rejected, NULL);
+	if (promise->state == DI_PROMISE_RESOLVED) {
+		di_handlers_dispatch(handlers, 0, result);
+	} else if (handlers.length > 0) {
+		di_handlers_dispatch(handlers, 1, result);
+	} else {
+		free(handlers.arr);
+		scoped_di_string error_message =
+		    di_object_to_string(promise->result.object, NULL);
 		log_error("Unhandled promise rejection: %.*s", (int)error_message.length,
 		          error_message.data);
-		di_unref_object(rejected);
 	}
-	return 0;
+}
+
+static void di_promise_dtor(di_object *obj) {
+	auto promise = (struct di_promise *)obj;
+	promise->inline_values = DI_TUPLE_INIT;
+	auto arr = (di_object **)promise->handlers.arr;
+	for (int i = 0; i < promise->handlers.length; i++) {
+		di_unref_object(arr[i]);
+	}
+	free(arr);
+	promise->handlers = DI_ARRAY_INIT;
+	di_free_value(promise->result_type, &promise->result);
+	promise->result_type = DI_TYPE_NIL;
+	di_drop_weak_ref(&promise->event_module);
 }
 
 /// Create a new promise object
@@ -470,27 +746,25 @@ static int di_promise_dispatch(di_promise *promise) {
 /// EXPORT: event.new_promise(): deai:Promise
 di_object *di_new_promise(di_object *event_module) {
 	struct di_promise *ret = di_new_object_with_type(struct di_promise);
-	auto weak_event = di_weakly_ref_object(event_module);
+	ret->event_module = di_weakly_ref_object(event_module);
+	ret->result_type = DI_TYPE_NIL;
+	ret->handlers = (di_array){.elem_type = DI_TYPE_OBJECT};
+	ret->gc_values[0] =
+	    (struct di_variant){.type = DI_TYPE_ARRAY, .value = (di_value *)&ret->handlers};
+	ret->gc_values[1] = (struct di_variant){.type = DI_TYPE_NIL, .value = &ret->result};
+	ret->inline_values = (di_tuple){.length = 2, .elements = ret->gc_values};
+	di_set_object_dtor((void *)ret, di_promise_dtor);
 	di_set_type((void *)ret, promise_type);
-	di_member(ret, "___weak_event_module", weak_event);
-	di_method(ret, "then", di_promise_then, di_object *);
-	di_method(ret, "catch", di_promise_catch, di_object *);
-	// "then" is a keyword in lua
-	di_method(ret, "then_", di_promise_then, di_object *);
-	di_method(ret, "resolve", di_promise_resolve, struct di_variant);
-	di_method(ret, "reject", di_promise_reject, di_object *);
 	return (void *)ret;
 }
 
 static void di_promise_start_dispatch(struct di_promise *promise) {
-	if (di_lookup((void *)promise, di_string_borrow_literal("is_pending"))) {
+	if (promise->queued) {
 		// Already started dispatch
 		return;
 	}
 
-	scoped_di_weak_object *weak_event = NULL;
-	DI_CHECK_OK(di_get(promise, "___weak_event_module", weak_event));
-	scoped_di_object *event_module = di_upgrade_weak_ref(weak_event);
+	scoped_di_object *event_module = di_upgrade_weak_ref(promise->event_module);
 	if (event_module == NULL) {
 		return;
 	}
@@ -501,23 +775,16 @@ static void di_promise_start_dispatch(struct di_promise *promise) {
 		return;
 	}
 	auto di = (struct deai *)di_obj;
-	ev_idle_start(di->loop, &((di_event_module *)event_module)->idlew);
+	auto em = (di_event_module *)event_module;
+	ev_idle_start(di->loop, &em->idlew);
 
-	int pending_count = 0;
-	DI_CHECK_OK(di_get(event_module, "pending_count", pending_count));
-	scoped_di_string key = di_string_printf("pending_promise_%d", pending_count);
-
-	di_rawsetx((void *)event_module, di_string_borrow_literal("pending_count"),
-	           DI_TYPE_NINT, (int[]){pending_count + 1});
-
-	if (pending_count == 0) {
+	if (em->microtasks.count == 0) {
 		// Add event_module to roots
-		auto roots = di_get_roots();
-		di_call(roots, "add_anonymous", event_module);
+		di_pin_object(event_module);
 	}
 
-	di_add_member_clone(event_module, key, DI_TYPE_OBJECT, &promise);
-	di_member_clone(promise, "is_pending", true);
+	di_microtask_queue_push(&em->microtasks, (void *)di_ref_object((void *)promise));
+	promise->queued = true;
 }
 
 static int di_promise_handler_closure(di_object *closure, di_type * /*type*/,
@@ -525,35 +792,69 @@ static int di_promise_handler_closure(di_object *closure, di_type * /*type*/,
 
 /// Add a listener to a promise, if the promise is already resolved, call the listener
 /// during the next main loop iteration.
-static void di_promise_add_handler(di_object *promise, di_object *handler) {
-	auto const key = di_string_borrow_literal("___handlers");
-	struct di_member *handlers_member = di_lookup(promise, key);
+static void di_promise_add_handler(di_object *promise_, di_object *handler) {
+	auto promise = (struct di_promise *)promise_;
+	auto handlers = &promise->handlers;
+	if (handlers->length == promise->handlers_capacity) {
+		promise->handlers_capacity =
+		    promise->handlers_capacity ? promise->handlers_capacity * 2 : 2;
+		handlers->arr = trealloc((di_object **)handlers->arr, promise->handlers_capacity);
+	}
+	((di_object **)handlers->arr)[handlers->length++] = di_ref_object(handler);
+
+	if (promise->state != DI_PROMISE_PENDING) {
+		di_promise_start_dispatch(promise);
+	}
+}
+
+/// The handler `then` adds to a promise. It calls `resolve` or `reject`, depending on how
+/// the promise settles, and settles `promise` with what they return.
+struct di_promise_then_closure {
+	di_object_internal;
+	di_object *nullable promise;
+	di_object *nullable resolve;
+	di_object *nullable reject;
+	/// The objects above, for the garbage collector. See `inline_values`.
+	struct di_variant gc_values[3];
+};
 
-	if (handlers_member == NULL) {
-		handlers_member = di_add_member_move2(promise, key, (di_type[]){DI_TYPE_ARRAY},
-		                                      (di_array[]){{
-		                                          .arr = NULL,
-		                                          .length = 0,
-		                                          .elem_type = DI_TYPE_OBJECT,
-		                                      }});
+/// Update the types in `gc_values` after some of the objects are taken from `closure`.
+static void di_promise_then_closure_sync(struct di_promise_then_closure *closure) {
+	di_object **objects[] = {&closure->promise, &closure->resolve, &closure->reject};
+	for (int i = 0; i < 3; i++) {
+		closure->gc_values[i] = (struct di_variant){
+		    .type = *objects[i] != NULL ? DI_TYPE_OBJECT : DI_TYPE_NIL,
+		    .value = (di_value *)objects[i],
+		};
 	}
-	di_array *handlers = &handlers_member->data->array;
-	di_object **arr = handlers->arr;
-	handlers->arr = arr = trealloc(arr, handlers->length + 1);
-	arr[handlers->length++] = di_ref_object(handler);
+}
 
-	if (di_has_member(promise, "___resolved") || di_has_member(promise, "___rejected")) {
-		di_promise_start_dispatch((struct di_promise *)promise);
+static void
+di_promise_then_closure_release_promise(struct di_promise_then_closure *closure) {
+	scoped_di_object *promise = closure->promise;
+	closure->promise = NULL;
+	di_promise_then_closure_sync(closure);
+}
+
+static void di_promise_then_closure_dtor(di_object *obj) {
+	auto closure = (struct di_promise_then_closure *)obj;
+	closure->inline_values = DI_TUPLE_INIT;
+	di_object *objects[] = {closure->promise, closure->resolve, closure->reject};
+	closure->promise = closure->resolve = closure->reject = NULL;
+	for (int i = 0; i < 3; i++) {
+		if (objects[i] != NULL) {
+			di_unref_object(objects[i]);
+		}
 	}
 }
 
-static int di_promise_handler_closure(di_object *closure, di_type * /*type*/,
+static int di_promise_handler_closure(di_object *obj, di_type * /*type*/,
                                       di_value * /*ret*/, di_tuple args) {
 	DI_CHECK(args.length == 2);
 
-	di_object *promise = NULL;
+	auto closure = (struct di_promise_then_closure *)obj;
 	int type;
-	DI_CHECK_OK(di_rawget_borrowed(closure, "promise", promise));
+	DI_CHECK(closure->promise != NULL);
 	DI_CHECK_OK(di_type_conversion(args.elements[0].type, args.elements[0].value,
 	                               DI_TYPE_NINT, (di_value *)&type, true));
 	DI_CHECK(type == 0 || type == 1);
@@ -561,32 +862,29 @@ static int di_promise_handler_closure(di_object *closure, di_type * /*type*/,
 	args.length = 1;
 	args.elements += 1;
 
-	di_object *handler = NULL;
-	scoped_di_variant resolvev = DI_VARIANT_INIT;
-	scoped_di_variant rejectv = DI_VARIANT_INIT;
-	if (di_remove_member_raw(closure, di_string_borrow_literal("resolve"), &resolvev) == 0) {
-		DI_CHECK(resolvev.type == DI_TYPE_OBJECT);
-	}
-	if (di_remove_member_raw(closure, di_string_borrow_literal("reject"), &rejectv) == 0) {
-		DI_CHECK(rejectv.type == DI_TYPE_OBJECT);
-	}
+	di_object *promise = closure->promise;
+	scoped_di_object *resolve = closure->resolve;
+	scoped_di_object *reject = closure->reject;
+	closure->resolve = closure->reject = NULL;
+	di_promise_then_closure_sync(closure);
+
 	// If there is no handler, the resolved value is directly passed to the
 	// subsequent promise, and any rejection will cause the subsequent promise
 	// to be rejected as well. This behavior is also used below if the handler
 	// returns a promise.
-	if (type == 0 && resolvev.type == DI_TYPE_NIL) {
+	if (type == 0 && resolve == NULL) {
 		di_promise_resolve(promise, args.elements[0]);
-		di_delete_member_raw(closure, di_string_borrow_literal("promise"));
+		di_promise_then_closure_release_promise(closure);
 		return 0;
 	}
-	if (type == 1 && rejectv.type == DI_TYPE_NIL) {
+	if (type == 1 && reject == NULL) {
 		DI_CHECK(args.elements[0].type == DI_TYPE_OBJECT);
 		di_promise_reject(promise, args.elements[0].value->object);
-		di_delete_member_raw(closure, di_string_borrow_literal("promise"));
+		di_promise_then_closure_release_promise(closure);
 		return 0;
 	}
 
-	handler = type == 0 ? resolvev.value->object : rejectv.value->object;
+	di_object *handler = type == 0 ? resolve : reject;
 
 	di_type rtype;
 	di_value ret;
@@ -607,41 +905,40 @@ static int di_promise_handler_closure(di_object *closure, di_type * /*type*/,
 		// The handler returned a promise, the subsequent promise should resolve when
 		// the returned promise resolves. We have already removed the handler from the
 		// closure, turning it into a "verbatim" closure, so we just add it to the listeners.
-		di_promise_add_handler(ret.object, closure);
+		di_promise_add_handler(ret.object, obj);
 		pending = true;
 	}
 	di_free_value(rtype, &ret);
 	if (!pending) {
-		di_delete_member_raw(closure, di_string_borrow_literal("promise"));
+		di_promise_then_closure_release_promise(closure);
 	}
 	return 0;
 }
 
 static di_object *
-di_promise_then_inner(di_object *promise, di_object *resolve, di_object *reject) {
-	scoped_di_weak_object *weak_event = NULL;
-	if (di_get(promise, "___weak_event_module", weak_event) != 0) {
-		di_throw(di_new_error("Event module member not found"));
+di_promise_then_inner(di_object *promise_, di_object *resolve, di_object *reject) {
+	if (!di_check_type(promise_, promise_type)) {
+		di_throw(di_new_error("Not a promise"));
 	}
-	scoped_di_object *event_module = di_upgrade_weak_ref(weak_event);
+	auto promise = (struct di_promise *)promise_;
+	scoped_di_object *event_module = di_upgrade_weak_ref(promise->event_module);
 	if (event_module == NULL) {
 		di_throw(di_new_error("deai shutting down?"));
 	}
 
 	di_object *ret = di_new_promise(event_module);
 
-	di_object *closure = di_new_object_with_type_name(
-	    sizeof(di_object), alignof(di_object), "deai.event:PromiseThenClosure");
-	di_set_object_call(closure, di_promise_handler_closure);
-	di_member_clone(closure, "promise", ret);
-	if (resolve != NULL) {
-		di_member_clone(closure, "resolve", resolve);
-	}
-	if (reject != NULL) {
-		di_member_clone(closure, "reject", reject);
-	}
-	di_promise_add_handler(promise, closure);
-	di_unref_object(closure);
+	auto closure = di_new_object_with_type2(struct di_promise_then_closure,
+	                                        "deai.event:PromiseThenClosure");
+	di_set_object_call((void *)closure, di_promise_handler_closure);
+	di_set_object_dtor((void *)closure, di_promise_then_closure_dtor);
+	closure->promise = di_ref_object(ret);
+	closure->resolve = resolve != NULL ? di_ref_object(resolve) : NULL;
+	closure->reject = reject != NULL ? di_ref_object(reject) : NULL;
+	di_promise_then_closure_sync(closure);
+	closure->inline_values = (di_tuple){.length = 3, .elements = closure->gc_values};
+	di_promise_add_handler(promise_, (void *)closure);
+	di_unref_object((void *)closure);
 	return ret;
 }
 
@@ -680,29 +977,42 @@ di_object *di_promise_finally(di_object *promise, di_object *handler) {
 	return di_promise_then_inner(promise, handler, handler);
 }
 
+/// Results collected by `join_promises`
+struct di_promise_join {
+	di_object_internal;
+	/// Number of promises yet to resolve
+	int left;
+	/// The results, in the order of the promises. Also pointed to by `inline_values`.
+	di_tuple results;
+};
+
+static void di_promise_join_dtor(di_object *obj) {
+	auto join = (struct di_promise_join *)obj;
+	join->inline_values = DI_TUPLE_INIT;
+	di_free_tuple(join->results);
+	join->results = DI_TUPLE_INIT;
+}
+
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
 static void di_promise_join_handler(int index, di_object *storage,
-                                    di_object *then_promise, struct di_variant var) {
-	scoped_di_string key = di_string_printf("%d", index);
-	DI_CHECK_OK(di_add_member_clone(storage, key, DI_TYPE_VARIANT, &var));
-
-	int left;
-	DI_CHECK_OK(di_get(storage, "left", left));
-	left -= 1;
-	DI_CHECK_OK(di_setx(storage, di_string_borrow_literal("left"), DI_TYPE_NINT, &left, NULL));
-
-	if (left == 0) {
-		int total;
-		DI_CHECK_OK(di_get(storage, "total", total));
-		scoped_di_tuple results = {.length = total,
-		                           .elements = tmalloc(struct di_variant, total)};
-		for (int i = 0; i < total; i++) {
-			scoped_di_string key = di_string_printf("%d", i);
-			di_variant tmp;
-			DI_CHECK_OK(di_get2(storage, key, tmp));
-			results.elements[i] = tmp;
-		}
-		di_call(then_promise, "resolve", results);
+                                    di_object *then_promise, int type,
+                                    struct di_variant var) {
+	auto join = (struct di_promise_join *)storage;
+	if (type == 1) {
+		// Rejections are passed on, the first one wins.
+		DI_CHECK(var.type == DI_TYPE_OBJECT);
+		di_promise_reject(then_promise, var.value->object);
+		return;
+	}
+	DI_CHECK(index < join->results.length);
+	DI_CHECK(join->results.elements[index].type == DI_TYPE_NIL);
+	di_copy_value(DI_TYPE_VARIANT, &join->results.elements[index], &var);
+
+	join->left -= 1;
+	if (join->left == 0) {
+		di_promise_resolve(then_promise,
+		                   (struct di_variant){.type = DI_TYPE_TUPLE,
+		                                       .value = (di_value *)&join->results});
 	}
 }
 /// Wait for all given promises resolve.
@@ -710,7 +1020,8 @@ static void di_promise_join_handler(int index, di_object *storage,
 /// EXPORT: event.join_promises(promises: [deai:Promise]): deai:Promise
 ///
 /// Returns a promises that resolves into an array, which stores the results of
-/// the promises. The promises can resolve in any order.
+/// the promises. The promises can resolve in any order. If any of the promises is
+/// rejected, the returned promise is rejected with the same error.
 di_object *di_join_promises(di_object *event_module, di_array promises) {
 	if (promises.length > 0 && promises.elem_type != DI_TYPE_OBJECT) {
 		di_throw(di_new_error("promises must all be objects"));
@@ -727,17 +1038,25 @@ di_object *di_join_promises(di_object *event_module, di_array promises) {
 		di_call(ret, "resolve", arg);
 		return ret;
 	}
-	scoped_di_object *storage = di_new_object_with_type(di_object);
+	scoped_di_object *storage = (void *)di_new_object_with_type2(
+	    struct di_promise_join, "deai.event:PromiseJoin");
+	auto join = (struct di_promise_join *)storage;
+	di_set_object_dtor(storage, di_promise_join_dtor);
+	// Handlers are only called from the event loop, so the results can be allocated
+	// after they are all added.
 	int cnt = 0;
 	for (int i = 0; i < promises.length; i++) {
 		scoped_di_object *handler = (void *)di_make_closure(
-		    di_promise_join_handler, (cnt, storage, ret), struct di_variant);
-		if (di_call(arr[i], "then", handler) == 0) {
-			cnt += 1;
-		}
+		    di_promise_join_handler, (cnt, storage, ret), int, struct di_variant);
+		di_promise_add_handler(arr[i], handler);
+		cnt += 1;
 	}
-	DI_CHECK_OK(di_setx(storage, di_string_borrow_literal("left"), DI_TYPE_NINT, &cnt, NULL));
-	DI_CHECK_OK(di_setx(storage, di_string_borrow_literal("total"), DI_TYPE_NINT, &cnt, NULL));
+	join->left = cnt;
+	join->results = (di_tuple){
+	    .length = cnt,
+	    .elements = tmalloc(struct di_variant, cnt),
+	};
+	join->inline_values = join->results;
 	return ret;
 }
 
@@ -770,47 +1089,214 @@ di_object *di_any_promise(di_object *event_module, di_array promises) {
 	return ret;
 }
 
-void di_promise_resolve(di_object *promise, struct di_variant var) {
-	if (di_has_member(promise, "___resolved") || di_has_member(promise, "___rejected")) {
+/// Settle `promise` with `result`. Does nothing if it's already settled.
+static void
+di_promise_settle(di_object *promise_, int state, di_type type, const di_value *result) {
+	DI_CHECK(di_check_type(promise_, promise_type));
+	auto promise = (struct di_promise *)promise_;
+	if (promise->state != DI_PROMISE_PENDING) {
 		// Already resolved
 		return;
 	}
-	di_member_clone(promise, "___resolved", var);
-	di_promise_start_dispatch((struct di_promise *)promise);
+	promise->state = state;
+	promise->result_type = type;
+	di_copy_value(type, &promise->result, result);
+	promise->gc_values[1].type = type;
+	di_promise_start_dispatch(promise);
+}
+
+void di_promise_resolve(di_object *promise, struct di_variant var) {
+	di_promise_settle(promise, DI_PROMISE_RESOLVED, DI_TYPE_VARIANT, (di_value *)&var);
 }
 
 void di_promise_reject(di_object *promise, di_object *error) {
-	if (di_has_member(promise, "___resolved") || di_has_member(promise, "___rejected")) {
-		// Already resolved
-		return;
-	}
-	di_member_clone(promise, "___rejected", error);
-	di_promise_start_dispatch((struct di_promise *)promise);
+	di_promise_settle(promise, DI_PROMISE_REJECTED, DI_TYPE_OBJECT, (di_value *)&error);
 }
 
 void di_idle_cb(EV_P_ ev_idle *w, int revents) {
 	ev_idle_stop(EV_A_ w);
 	auto eventm = container_of(w, di_event_module, idlew);
+	auto start = di_loop_stats_begin();
+	auto trace_start = di_trace_begin();
+	// Promises settled by the handlers are appended to the queue, and handled in this
+	// same loop.
+	struct di_promise *next;
+	while ((next = di_microtask_queue_pop(&eventm->microtasks)) != NULL) {
+		scoped_di_object *promise = (void *)next;
+		di_promise_dispatch(next);
+	}
+
+	di_unpin_object((di_object *)eventm);
+	di_trace_end("promises", DI_STRING_INIT, trace_start);
+	di_loop_stats_end(DI_LOOP_SOURCE_PROMISE, start);
+}
+
+/// A signal emission, or the release of a remote object, posted from another thread
+struct di_posted_message {
+	struct di_posted_message *next;
+	struct di_remote_object *remote;
+	/// Whether this message drops `remote`, instead of emitting a signal
+	bool drop;
+	di_string name;
+	di_tuple args;
+};
+
+/// Put in place of the head of a closed queue, messages posted after that are freed
+/// right away.
+#define DI_QUEUE_CLOSED ((struct di_posted_message *)1)
+
+/// Messages posted to the event loop thread of an event module. This is a lock-free
+/// stack, which is drained as a whole by the event loop thread. Remote objects could
+/// outlive the event module, so this is freed when the module and all the remote objects
+/// are gone.
+struct di_message_queue {
+	ev_async wakeup;
+	struct ev_loop *loop;
+	_Atomic(struct di_posted_message *) head;
+	/// Number of threads in the middle of posting a message
+	atomic_uint posting;
+	/// One for each remote object, plus one for the event module while it's alive
+	atomic_uint refs;
+	/// Remote objects not yet dropped, only touched on the event loop thread
+	struct list_head remotes;
+};
+
+struct di_remote_object {
+	struct di_message_queue *queue;
+	/// Only touched on the event loop thread. NULL if the event module is gone.
+	di_weak_object *nullable weak;
+	/// In `queue->remotes`, only touched on the event loop thread
+	struct list_head siblings;
+};
+
+static void di_unref_message_queue(struct di_message_queue *queue) {
+	if (atomic_fetch_sub_explicit(&queue->refs, 1, memory_order_acq_rel) == 1) {
+		free(queue);
+	}
+}
+
+static void di_free_posted_message(struct di_posted_message *msg) {
+	if (msg->drop) {
+		if (msg->remote->weak != NULL) {
+			di_drop_weak_ref(&msg->remote->weak);
+			list_del(&msg->remote->siblings);
+		}
+		di_unref_message_queue(msg->remote->queue);
+		free(msg->remote);
+	}
+	di_free_string(msg->name);
+	di_free_tuple(msg->args);
+	free(msg);
+}
+
+static void
+di_post_message(struct di_message_queue *queue, struct di_posted_message *msg) {
+	atomic_fetch_add_explicit(&queue->posting, 1, memory_order_acquire);
+	// Acquire, so if the queue is closed, we see the remote objects detached by
+	// `di_close_message_queue`.
+	auto head = atomic_load_explicit(&queue->head, memory_order_acquire);
 	do {
-		int pending_count = 0;
-		DI_CHECK_OK(di_get(eventm, "pending_count", pending_count));
-		if (pending_count == 0) {
-			break;
+		if (head == DI_QUEUE_CLOSED) {
+			// Nothing is going to handle this. The remote object was detached before the
+			// queue was closed, so it's safe to free it here.
+			atomic_fetch_sub_explicit(&queue->posting, 1, memory_order_release);
+			di_free_posted_message(msg);
+			return;
+		}
+		msg->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(&queue->head, &head, msg,
+	                                                memory_order_release,
+	                                                memory_order_acquire));
+	if (head == NULL) {
+		// The stack was empty, so nobody has woken up the event loop for the messages
+		// in it yet.
+		ev_async_send(queue->loop, &queue->wakeup);
+	}
+	atomic_fetch_sub_explicit(&queue->posting, 1, memory_order_release);
+}
+
+/// Handle the posted messages in the stack `msg`. If `deliver` is false, signals are not
+/// emitted, and the messages are only freed.
+static void di_handle_posted_messages(struct di_posted_message *msg, bool deliver) {
+	// Reverse the stack, so messages are handled in the order they were posted
+	struct di_posted_message *ordered = NULL;
+	while (msg != NULL) {
+		auto next = msg->next;
+		msg->next = ordered;
+		ordered = msg;
+		msg = next;
+	}
+
+	while (ordered != NULL) {
+		msg = ordered;
+		ordered = msg->next;
+		if (!msg->drop && deliver) {
+			scoped_di_object *obj = di_upgrade_weak_ref(msg->remote->weak);
+			if (obj != NULL) {
+				di_emitn(obj, msg->name, msg->args);
+			}
 		}
+		di_free_posted_message(msg);
+	}
+}
+
+static void di_posted_messages_cb(EV_P_ ev_async *w, int revents) {
+	struct di_message_queue *queue = (void *)w;
+	auto msg = atomic_exchange_explicit(&queue->head, NULL, memory_order_acquire);
+	di_handle_posted_messages(msg, true);
+}
+
+/// Stop handling posted messages, called when the event module is freed. Messages
+/// already posted are dropped.
+static void di_close_message_queue(struct di_message_queue *queue) {
+	// The watcher was unreferenced when started
+	ev_ref(queue->loop);
+	ev_async_stop(queue->loop, &queue->wakeup);
+
+	// Detach the remote objects before closing the queue. Once it is closed, the threads
+	// owning them free them without going through the event loop thread, and they
+	// can't touch the weak references.
+	struct di_remote_object *remote, *next_remote;
+	list_for_each_entry_safe (remote, next_remote, &queue->remotes, siblings) {
+		di_drop_weak_ref(&remote->weak);
+		remote->weak = NULL;
+		list_del(&remote->siblings);
+	}
+
+	// Release, so threads that see the queue closed also see the remote objects detached
+	auto msg =
+	    atomic_exchange_explicit(&queue->head, DI_QUEUE_CLOSED, memory_order_acq_rel);
+	// Wait for threads that have just posted to the queue to finish waking up the loop
+	while (atomic_load_explicit(&queue->posting, memory_order_acquire) != 0) {
+		thrd_yield();
+	}
+	di_handle_posted_messages(msg, false);
+	di_unref_message_queue(queue);
+}
 
-		// Pop the promise with the highest index
-		scoped_di_string key = di_string_printf("pending_promise_%d", pending_count - 1);
-		scoped_di_object *promise = NULL;
-		DI_CHECK_OK(di_get2(eventm, key, promise));
-		DI_CHECK_OK(di_delete_member_raw((void *)eventm, key));
-		di_rawsetx((void *)eventm, di_string_borrow_literal("pending_count"),
-		           DI_TYPE_NINT, (int[]){pending_count - 1});
+struct di_remote_object *di_new_remote_object(di_object *event_module, di_object *obj) {
+	auto em = (di_event_module *)event_module;
+	auto remote = tmalloc(struct di_remote_object, 1);
+	remote->queue = em->messages;
+	remote->weak = di_weakly_ref_object(obj);
+	list_add(&remote->siblings, &em->messages->remotes);
+	atomic_fetch_add_explicit(&em->messages->refs, 1, memory_order_relaxed);
+	return remote;
+}
 
-		di_promise_dispatch((void *)promise);
-	} while (true);
+void di_post_signal(struct di_remote_object *remote, di_string name, di_tuple args) {
+	auto msg = tmalloc(struct di_posted_message, 1);
+	msg->remote = remote;
+	msg->name = name;
+	msg->args = args;
+	di_post_message(remote->queue, msg);
+}
 
-	auto roots = di_get_roots();
-	di_call(roots, "remove_anonymous", (di_object *)eventm);
+void di_drop_remote_object(struct di_remote_object *remote) {
+	auto msg = tmalloc(struct di_posted_message, 1);
+	msg->remote = remote;
+	msg->drop = true;
+	di_post_message(remote->queue, msg);
 }
 
 void di_event_module_dtor(di_object *obj) {
@@ -820,6 +1306,55 @@ void di_event_module_dtor(di_object *obj) {
 		auto di = (struct deai *)di_obj;
 		ev_idle_stop(di->loop, &em->idlew);
 	}
+	if (em->workers) {
+		di_free_worker_pool(em->workers);
+		em->workers = NULL;
+	}
+
+	struct di_promise *promise;
+	while ((promise = di_microtask_queue_pop(&em->microtasks)) != NULL) {
+		promise->queued = false;
+		di_unref_object((void *)promise);
+	}
+	free(em->microtasks.promises);
+	em->microtasks = (struct di_microtask_queue){};
+
+	// Timers hold references to the event module through the keep alive root, so there
+	// can't be any left.
+	DI_CHECK(em->timers.count == 0);
+	ev_timer_stop(em->loop, &em->timers_watcher);
+	if (em->timers_keep_alive != NULL) {
+		di_drop_weak_ref(&em->timers_keep_alive);
+	}
+
+	di_close_message_queue(em->messages);
+	em->messages = NULL;
+}
+
+di_object *di_offload(di_object *event_module, di_offload_fn fn, void *data) {
+	auto em = (di_event_module *)event_module;
+	auto promise = di_new_promise(event_module);
+	di_object *di_obj = di_object_borrow_deai(event_module);
+	if (di_obj == NULL) {
+		// deai is shutting down, there is no event loop to hand the result back to
+		di_type rtype = DI_TYPE_NIL;
+		di_value ret;
+		int rc = fn(data, &rtype, &ret);
+		if (rc < 0) {
+			scoped_di_object *error = di_new_error("%s", strerror(-rc));
+			di_promise_reject(promise, error);
+		} else {
+			di_promise_resolve(promise, (struct di_variant){.type = rtype, .value = &ret});
+			di_free_value(rtype, &ret);
+		}
+		return promise;
+	}
+
+	if (em->workers == NULL) {
+		em->workers = di_new_worker_pool(((struct deai *)di_obj)->loop, event_module);
+	}
+	di_worker_pool_submit(em->workers, fn, data, promise);
+	return promise;
 }
 
 /// Create a new promise that is already resolved
@@ -847,20 +1382,57 @@ void di_init_event(di_object *di) {
 
 	di_method(em, "fdevent", di_create_ioev, int);
 	di_method(em, "timer", di_create_timer, double);
+	di_getter(em, timer_slack, di_get_timer_slack);
+	di_setter(em, timer_slack, di_set_timer_slack, double);
+	di_object *stats = di_new_loop_stats(((struct deai *)di)->loop);
+	di_member(em, "stats", stats);
 	di_method(em, "periodic", di_create_periodic, double, double);
 	di_method(em, "new_promise", di_new_promise);
 	di_method(em, "ready_promise", di_ready_promise, di_variant);
 	di_method(em, "join_promises", di_join_promises, di_array);
 	di_method(em, "any_promise", di_any_promise, di_array);
+	di_method(em, "debounce", di_event_debounce, di_object *, di_string, double);
+	di_method(em, "throttle", di_event_throttle, di_object *, di_string, double);
+	di_method(em, "coalesce", di_event_coalesce, di_object *, di_string, unsigned int, double);
+	di_method(em, "buffer", di_event_buffer, di_object *, di_string, unsigned int, double);
+	di_method(em, "merge", di_event_merge, di_array, di_string);
+
+	di_object *offload = di_new_object_with_type(di_object);
+	di_set_object_call(offload, di_offload_builtin);
+	di_member(em, "offload", offload);
+
+	di_type_method(promise_type, "then", di_promise_then, di_object *);
+	di_type_method(promise_type, "catch", di_promise_catch, di_object *);
+	// "then" is a keyword in lua
+	di_type_method(promise_type, "then_", di_promise_then, di_object *);
+	di_type_method(promise_type, "resolve", di_promise_resolve, struct di_variant);
+	di_type_method(promise_type, "reject", di_promise_reject, di_object *);
 
 	auto dep = tmalloc(struct di_prepare, 1);
 	dep->evm = em;
 	ev_prepare_init(dep, di_prepare);
+	ev_idle_init(&dep->gc_idle, di_gc_idle);
+	ev_idle_init(&dep->batch_idle, di_batch_idle);
 	ev_prepare_start(((struct deai *)di)->loop, (ev_prepare *)dep);
 
 	ev_idle_init(&eventp->idlew, di_idle_cb);
 
-	di_rawsetx((void *)em, di_string_borrow_literal("pending_count"), DI_TYPE_NINT, (int[]){0});
+	eventp->loop = ((struct deai *)di)->loop;
+	eventp->timer_slack = DI_TIMER_DEFAULT_SLACK;
+	eventp->timers_origin = ev_now(eventp->loop);
+	eventp->timers_watcher_tick = UINT64_MAX;
+	di_timer_wheel_init(&eventp->timers, 0);
+	ev_timer_init(&eventp->timers_watcher, di_timers_callback, 0, 0);
+
+	eventp->messages = tmalloc(struct di_message_queue, 1);
+	eventp->messages->loop = eventp->loop;
+	eventp->messages->refs = 1;
+	INIT_LIST_HEAD(&eventp->messages->remotes);
+	ev_async_init(&eventp->messages->wakeup, di_posted_messages_cb);
+	ev_async_start(eventp->loop, &eventp->messages->wakeup);
+	// Posted messages shouldn't keep the event loop running by themselves
+	ev_unref(eventp->loop);
+
 	di_set_object_dtor((void *)em, di_event_module_dtor);
 	di_register_module(di, di_string_borrow_literal("event"), &em);
 }
@@ -15,3 +15,35 @@ PUBLIC_DEAI_API di_object *di_join_promises(di_object *event_module, di_array pr
 PUBLIC_DEAI_API di_object *di_promise_then(di_object *promise, di_object *handler);
 PUBLIC_DEAI_API di_object *di_promise_catch(di_object *promise, di_object *handler);
 PUBLIC_DEAI_API di_object *di_new_promise(di_object *event_module);
+
+/// A blocking function to be run on a worker thread by `di_offload`. It takes ownership of
+/// `data`, and returns its result in `ret`, with the type of the result in `rtype`. If it
+/// fails, it should return a negative errno instead.
+///
+/// Worker threads can't touch any deai objects, so the result must not contain objects.
+typedef int (*di_offload_fn)(void *data, di_type *rtype, di_value *ret);
+/// Run `fn` with `data` on a worker thread, without blocking the event loop. Returns a
+/// promise which is resolved on the event loop thread with the result of `fn`, or
+/// rejected if `fn` fails.
+PUBLIC_DEAI_API di_object *di_offload(di_object *event_module, di_offload_fn fn, void *data);
+
+/// A reference to an object that can be used from threads other than the event loop
+/// thread, to emit signals on the object. It doesn't keep the object alive.
+struct di_remote_object;
+/// Create a remote reference to `obj`, whose signals are emitted on the event loop of
+/// `event_module`. Must be called on the event loop thread.
+PUBLIC_DEAI_API struct di_remote_object *
+di_new_remote_object(di_object *event_module, di_object *obj);
+/// Emit signal `name` with `args` on the object referenced by `remote`, from the event
+/// loop thread. Can be called from any thread. Posted signals are emitted in order, and
+/// many posts are handled in a single wake up of the event loop. Nothing is emitted if the
+/// object, or the event module, is gone by then.
+///
+/// Takes ownership of `name` and `args`, which are freed on the event loop thread, or
+/// right away if the event module is gone. Same as with `di_offload_fn`, they must not
+/// contain objects.
+PUBLIC_DEAI_API void
+di_post_signal(struct di_remote_object *remote, di_string name, di_tuple args);
+/// Drop a remote reference. Can be called from any thread, after which `remote` must not
+/// be used. Signals already posted through `remote` are still emitted.
+PUBLIC_DEAI_API void di_drop_remote_object(struct di_remote_object *remote);
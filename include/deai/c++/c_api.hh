@@ -45,6 +45,7 @@ constexpr auto init = ::di_init_object;
 constexpr auto set_type = ::di_set_type;
 constexpr auto to_string = ::di_object_to_string;
 constexpr auto listen_to = ::di_listen_to;
+constexpr auto listen_to_batch = ::di_listen_to_batch;
 }        // namespace object
 namespace string {
 constexpr auto borrow = ::di_string_borrow;
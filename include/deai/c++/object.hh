@@ -442,6 +442,11 @@ public:
 	template <typeinfo::DerivedObject Other>
 	auto on(const std::string_view &signal, const Ref<Other> &handler) -> Ref<ListenHandle>;
 
+	/// Listen to signal on this object, `handler` is called with arrays of the emissions
+	/// accumulated during an event loop iteration.
+	template <typeinfo::DerivedObject Other>
+	auto on_batch(const std::string_view &signal, const Ref<Other> &handler) -> Ref<ListenHandle>;
+
 	auto operator[](const std::string_view &key) const -> ObjectMemberProxy<false> {
 		return {raw(), key};
 	}
@@ -454,6 +459,15 @@ auto Ref<T>::on(const std::string_view &signal, const Ref<Other> &handler) -> Re
 	                                   handler.raw(), nullptr))
 	    .value();
 }
+template <typeinfo::DerivedObject T>
+template <typeinfo::DerivedObject Other>
+auto Ref<T>::on_batch(const std::string_view &signal, const Ref<Other> &handler)
+    -> Ref<ListenHandle> {
+	return Ref<ListenHandle>::take(c_api::object::listen_to_batch(
+	                                   &inner->base, conv::string_to_borrowed_deai_value(signal),
+	                                   handler.raw(), nullptr))
+	    .value();
+}
 
 }        // namespace type
 
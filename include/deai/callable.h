@@ -27,6 +27,10 @@ struct di_closure *nullable di_create_closure(void (*nonnull fn)(void), di_type
                                               const di_type *nullable arg_types);
 PUBLIC_DEAI_API int di_add_method(di_object *nonnull object, di_string name,
                                   void (*nonnull fn)(void), di_type rtype, int nargs, ...);
+/// Like `di_add_method`, but the method is shared by all objects of type `type`. See
+/// `di_add_type_member_move`.
+PUBLIC_DEAI_API int di_add_type_method(const char *nonnull type, di_string name,
+                                       void (*nonnull fn)(void), di_type rtype, int nargs, ...);
 
 /// Create a field getter. This field getter can be used as a specialized getter on an
 /// object, to retrieve a member of type `type` stored at `offset` inside the object
@@ -131,14 +131,30 @@
 		di_member((di_object *)(o), "__get_" #name, __deai_tmp_field_getter);            \
 	})
 
+/// Like `di_field`, but register the getter for all objects of type `type`, whose
+/// underlying struct is `struct_type`.
+#define di_type_field(type, struct_type, name)                                           \
+	({                                                                                   \
+		__auto_type __deai_tmp_field_getter = di_new_field_getter(                       \
+		    di_typeof(((struct_type *)0)->name), offsetof(struct_type, name));           \
+		di_type_member(type, "__get_" #name, __deai_tmp_field_getter);                   \
+	})
+
 #define di_member(o, name, v)                                                            \
 	di_add_member_move((di_object *)(o), di_string_borrow(name),                         \
 	                   (di_type[]){di_typeof(v)}, (void *)&(v))
 
+#define di_type_member(type, name, v)                                                    \
+	di_add_type_member_move((type), di_string_borrow(name), (di_type[]){di_typeof(v)},   \
+	                        (void *)&(v))
+
 #define di_member_clone(o, name, v)                                                      \
 	di_add_member_clonev((di_object *)(o), di_string_borrow(name), di_typeof(v), (v))
 
 #define di_getter(o, name, g) di_method(o, STRINGIFY(__get_##name), g)
+#define di_type_getter(type, name, g) di_type_method(type, STRINGIFY(__get_##name), g)
+#define di_type_setter(type, name, s, vtype)                                             \
+	di_type_method(type, STRINGIFY(__set_##name), s, vtype)
 #define di_setter(o, name, s, type) di_method(o, STRINGIFY(__set_##name), s, type);
 #define di_signal_setter_deleter(o, sig, setter, deleter)                                \
 	do {                                                                                 \
@@ -157,6 +173,19 @@
 		di_member(o, di_signal_deleter_of(sig), deleter_closure);                        \
 	} while (0)
 
+#define di_type_getter_setter(type, name, g, s)                                          \
+	({                                                                                   \
+		int rc = 0;                                                                      \
+		do {                                                                             \
+			rc = di_type_getter(type, name, g);                                          \
+			if (rc != 0) {                                                               \
+				break;                                                                   \
+			}                                                                            \
+			rc = di_type_setter(type, name, s, di_return_typeof(g, di_object *));        \
+		} while (0);                                                                     \
+		rc;                                                                              \
+	})
+
 #define di_getter_setter(o, name, g, s)                                                  \
 	({                                                                                   \
 		int rc = 0;                                                                      \
@@ -199,6 +228,10 @@
 	di_add_method((di_object *)(o), di_string_borrow(name), (void *)(fn), (rtype),       \
 	              VA_ARGS_LENGTH(__VA_ARGS__), ##__VA_ARGS__)
 
+#define di_register_typed_type_method(type, name, fn, rtype, ...)                       \
+	di_add_type_method((type), di_string_borrow(name), (void *)(fn), (rtype),            \
+	                   VA_ARGS_LENGTH(__VA_ARGS__), ##__VA_ARGS__)
+
 #define INDIRECT(fn, ...) fn(__VA_ARGS__)
 
 // Need to use INDIRECT because macro(A B) is consider to have only one argument,
@@ -208,6 +241,12 @@
 	         di_return_typeid(fn, di_object *, ##__VA_ARGS__)                            \
 	             LIST_APPLY_pre(di_typeid, SEP_COMMA, ##__VA_ARGS__))
 
+/// Like `di_method`, but the method is shared by all objects whose type is `type`
+#define di_type_method(type, name, fn, ...)                                              \
+	INDIRECT(di_register_typed_type_method, type, name, fn,                              \
+	         di_return_typeid(fn, di_object *, ##__VA_ARGS__)                            \
+	             LIST_APPLY_pre(di_typeid, SEP_COMMA, ##__VA_ARGS__))
+
 define_object_cleanup(di_closure);
 define_object_cleanup(di_promise);
 
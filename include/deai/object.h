@@ -245,6 +245,46 @@ union di_value {
 
 /// Return the roots registry. ref/unref-ing the roots are not needed
 PUBLIC_DEAI_API di_object *nonnull di_get_roots(void);
+/// Keep an object alive as an unnamed root, until it's unpinned. This is what
+/// `deai:Roots.add_anonymous` does, without going through a method call. Returns true if
+/// the object was pinned, false if it was already pinned, or if the roots have been
+/// dropped by di:exit.
+PUBLIC_DEAI_API bool di_pin_object(di_object *nonnull obj);
+/// Stop keeping a pinned object alive. Returns true if the object was unpinned, false if
+/// it wasn't pinned.
+PUBLIC_DEAI_API bool di_unpin_object(di_object *nonnull obj);
+
+/// An interned member name, see `di_intern`.
+struct di_atom {
+	di_string name;
+	/// Hash of `name`, the same hash used for member lookups
+	unsigned int hash;
+};
+
+/// Intern a member name. Interning the same name always returns the same atom, atoms are
+/// never freed. Accessing members with atoms saves hashing the name, and the atoms of the
+/// names derived from it, e.g. "__signal_<name>" and "__get_<name>", are cached too.
+///
+/// Names generated without bound at runtime, e.g. ones containing pointers, shouldn't be
+/// interned.
+PUBLIC_DEAI_API const struct di_atom *nonnull di_intern(di_string name);
+
+/// Like `di_getx`, but `prop` is an atom.
+PUBLIC_DEAI_API int di_getx_atom(di_object *nonnull o, const struct di_atom *nonnull prop,
+                                 di_type *nonnull type, di_value *nonnull ret,
+                                 di_object *nullable *nullable err);
+/// Like `di_getxt`, but `prop` is an atom.
+PUBLIC_DEAI_API int
+di_getxt_atom(di_object *nonnull o, const struct di_atom *nonnull prop, di_type type,
+              di_value *nonnull ret, di_object *nullable *nullable err);
+/// Like `di_setx`, but `prop` is an atom.
+PUBLIC_DEAI_API int di_setx_atom(di_object *nonnull o, const struct di_atom *nonnull prop,
+                                 di_type type, const void *nonnull val,
+                                 di_object *nullable *nullable err);
+/// Like `di_refrawgetx`, but `prop` is an atom.
+PUBLIC_DEAI_API int
+di_refrawgetx_atom(di_object *nonnull o, const struct di_atom *nonnull prop,
+                   di_type *nonnull type, di_value *nullable *nonnull ret);
 
 /// Fetch member object `name` from object `o`, then call the member object with `args`.
 /// The member object may be fetched by calling the getter functions.
@@ -261,6 +301,37 @@ PUBLIC_DEAI_API di_object *nonnull di_get_roots(void);
 PUBLIC_DEAI_API int di_callx(di_object *nonnull self, di_string name, di_type *nonnull rt,
                              di_value *nonnull ret, di_tuple args, bool *nonnull called);
 
+/// Remembers where a member was last found, so looking it up again, on the same object or
+/// on another object of the same type, doesn't need to hash its name. Has to be zero
+/// initialized, and only used on one thread.
+struct di_member_cache {
+	/// Name of the member
+	const struct di_atom *nullable atom;
+	/// Stamp of the member table `member` was found in, 0 if nothing is cached
+	uint64_t stamp;
+	struct di_member *nullable member;
+	/// Whether `member` is shared by the object's type
+	bool shared;
+};
+
+/// Like `di_lookup_atom`, with `cache->atom` as the name. The member found is remembered in
+/// `cache`, which is valid as long as the objects it is used with aren't gaining or losing
+/// members.
+PUBLIC_DEAI_API struct di_member *nullable di_lookup_cached(di_object *nonnull o,
+                                                            struct di_member_cache *nonnull cache);
+
+/// Like `di_getx`, but the member is looked up through `cache`. The cache is meant for a
+/// single call site: if `prop` isn't the name cached, the cache is not used.
+PUBLIC_DEAI_API int di_getx_cached(di_object *nonnull o, struct di_member_cache *nonnull cache,
+                                   di_string prop, di_type *nonnull type, di_value *nonnull ret,
+                                   di_object *nullable *nullable err);
+
+/// Like `di_callx`, but the member is looked up through `cache`. The cache is meant for
+/// a single call site: if `name` isn't the name cached, the cache is not used.
+PUBLIC_DEAI_API int di_callx_cached(di_object *nonnull self, struct di_member_cache *nonnull cache,
+                                    di_string name, di_type *nonnull rt, di_value *nonnull ret,
+                                    di_tuple args, bool *nonnull called);
+
 /// Change the value of member `prop` of object `o`.
 ///
 /// If a specialized setter `__set_<prop>` exists, it will call the setter. If not, it
@@ -352,7 +423,8 @@ PUBLIC_DEAI_API int nonnull_all di_add_member_move(di_object *nonnull o, di_stri
                                                    di_type *nonnull type, void *nonnull address);
 
 /// Like `di_add_member_move`, but also returns a pointer to the new `struct di_member`
-/// object, or an error that can be check with `IS_ERR`.
+/// object, or an error that can be check with `IS_ERR`. Members are stored inline, so the
+/// returned pointer is only valid until members of `o` are added or removed.
 struct di_member *nonnull di_add_member_move2(di_object *nonnull o, di_string name,
                                               di_type *nonnull t, void *nonnull addr);
 
@@ -364,6 +436,16 @@ PUBLIC_DEAI_API int nonnull_all di_add_member_clone(di_object *nonnull o, di_str
 PUBLIC_DEAI_API int nonnull_all di_add_member_clonev(di_object *nonnull o, di_string name,
                                                      di_type, ...);
 
+/// Add value (*address) with type `*type` as a member named `name` shared by all objects
+/// whose "__type" is `type`. Ownership is taken like `di_add_member_move`.
+///
+/// Shared members are found by member lookups after the object's own members, so an
+/// object can shadow them with a member of the same name. They are not part of the raw
+/// member list of the objects, and can't be changed or removed through the objects.
+PUBLIC_DEAI_API int nonnull_all di_add_type_member_move(const char *nonnull type, di_string name,
+                                                        di_type *nonnull t,
+                                                        void *nonnull address);
+
 /// Remove a member of object `o`, without calling the deleter.
 PUBLIC_DEAI_API int di_delete_member_raw(di_object *nonnull o, di_string name);
 
@@ -383,11 +465,14 @@ di_remove_member_raw(di_object *nonnull obj, di_string name, di_variant *nonnull
 PUBLIC_DEAI_API int
 di_delete_member(di_object *nonnull o, di_string name, di_object *nullable *nullable err);
 
-/// Check whether a member with `name` exists in the object, without calling the
-/// getters. Returns non-NULL if the member exists, and NULL otherwise.
+/// Check whether a member with `name` exists in the object, or is shared by its type,
+/// without calling the getters. Returns non-NULL if the member exists, and NULL otherwise.
 ///
 /// This function doesn't retreive the member, no reference counter is incremented.
 PUBLIC_DEAI_API struct di_member *nullable di_lookup(di_object *nonnull, di_string name);
+/// Like `di_lookup`, but `name` is an atom.
+PUBLIC_DEAI_API struct di_member *nullable
+di_lookup_atom(di_object *nonnull, const struct di_atom *nonnull name);
 PUBLIC_DEAI_API di_object *nullable di_new_object(size_t sz, size_t alignment);
 /// Initialized an di_object allocated somewhere else. The allocation must
 /// have been 0 initialized. And the memory must be allocated in a way that it can be
@@ -415,9 +500,51 @@ PUBLIC_DEAI_API di_object *nullable di_listen_to(di_object *nonnull, di_string n
                                                  di_object *nullable h,
                                                  di_object *nullable *nullable err);
 
+/// Like `di_listen_to`, but emissions are delivered in batches. Instead of being called for
+/// each emission, `h` is called once per event loop iteration, with an array of the
+/// argument tuples of all the emissions since the last call.
+///
+/// Return object type: ListenerHandle
+PUBLIC_DEAI_API di_object *nullable di_listen_to_batch(di_object *nonnull, di_string name,
+                                                       di_object *nullable h,
+                                                       di_object *nullable *nullable err);
+
+/// Kinds of checks a signal filter can do on an argument of the emission
+enum di_signal_filter_kind {
+	/// The argument is equal to `value`. `value` can be nil, a bool, an integer, a float
+	/// or a string.
+	DI_SIGNAL_FILTER_EQUAL,
+	/// The argument is a string that starts with the string `value`
+	DI_SIGNAL_FILTER_PREFIX,
+	/// The argument is an integer that has any of the bits of the integer `value` set
+	DI_SIGNAL_FILTER_MASK,
+};
+
+/// A check on one argument of a signal emission, see `di_listen_to_filtered`.
+struct di_signal_filter {
+	enum di_signal_filter_kind kind;
+	/// Index of the checked argument
+	unsigned int arg;
+	di_type type;
+	di_value value;
+};
+
+/// Like `di_listen_to`, but `h` is only called for the emissions whose arguments pass all
+/// of the `nfilters` filters. The filters are checked natively, before the handler is
+/// called. `filters` are copied.
+///
+/// Return object type: ListenerHandle
+PUBLIC_DEAI_API di_object *nullable di_listen_to_filtered(
+    di_object *nonnull, di_string name, di_object *nullable h,
+    const struct di_signal_filter *nullable filters, unsigned int nfilters,
+    di_object *nullable *nullable err);
+
 /// Emit a signal with `name`, and `args`. The emitter of the signal is responsible of
 /// freeing `args`.
 PUBLIC_DEAI_API int di_emitn(di_object *nonnull, di_string name, di_tuple args);
+/// Like `di_emitn`, but `name` is an atom.
+PUBLIC_DEAI_API int
+di_emitn_atom(di_object *nonnull, const struct di_atom *nonnull name, di_tuple args);
 /// Call object dtor, remove all public members from the object. Listeners are not
 /// removed, they can only be removed when the object's strong refcount drop to 0
 PUBLIC_DEAI_API void di_finalize_object(di_object *nonnull);
@@ -428,6 +555,10 @@ PUBLIC_DEAI_API di_object *nonnull allocates(malloc) di_ref_object(di_object *no
 /// empty reference is created.
 PUBLIC_DEAI_API struct di_weak_object *nonnull di_weakly_ref_object(di_object *nullable);
 
+/// Get a weak reference to `obj` without creating a new one. The returned reference must
+/// not be dropped, and is only valid while `obj` is alive.
+PUBLIC_DEAI_API struct di_weak_object *nonnull di_borrow_weak_ref(di_object *nonnull obj);
+
 /// Upgrade a weak object reference to an object reference.
 ///
 /// @return An object reference, or NULL if the object has been freed.
@@ -466,6 +597,45 @@ PUBLIC_DEAI_API di_tuple di_object_next_member(di_object *nonnull obj, di_string
 PUBLIC_DEAI_API void di_free_tuple(di_tuple);
 PUBLIC_DEAI_API void di_free_array(di_array);
 
+/// An immutable array whose storage is reference counted, so it can be copied without
+/// copying its elements, e.g. to hand a large payload to many consumers. Sharing is
+/// opt-in: `di_array`s are never shared, a shared array is made from an owned one with
+/// `di_share_array`, and is a different type, so it can't be freed or modified as a
+/// `di_array` by mistake.
+///
+/// The elements can be read through `array`. Copies are made with `di_shared_array_ref`,
+/// and dropped with `di_shared_array_unref`, on any thread. The elements are freed by the
+/// thread that drops the last copy, so arrays used by more than one thread must not
+/// contain objects.
+typedef struct di_shared_array {
+	di_array array;
+} di_shared_array;
+
+/// Same as `di_shared_array`, for tuples.
+typedef struct di_shared_tuple {
+	di_tuple tuple;
+} di_shared_tuple;
+
+/// Turn owned array `arr` into a shared array, taking its ownership. The elements are
+/// moved, not copied.
+PUBLIC_DEAI_API di_shared_array di_share_array(di_array arr);
+/// Make a copy of `arr`, which shares its storage.
+PUBLIC_DEAI_API di_shared_array di_shared_array_ref(di_shared_array arr);
+/// Drop a copy of `arr`, freeing the elements if it is the last one.
+PUBLIC_DEAI_API void di_shared_array_unref(di_shared_array arr);
+/// Turn a copy of `arr` into an owned `di_array`, e.g. to modify it, or to store it as a
+/// value. The elements are moved if this is the last copy, otherwise they are copied.
+PUBLIC_DEAI_API di_array di_shared_array_take(di_shared_array arr);
+
+/// Same as `di_share_array`, for tuples.
+PUBLIC_DEAI_API di_shared_tuple di_share_tuple(di_tuple t);
+/// Same as `di_shared_array_ref`, for tuples.
+PUBLIC_DEAI_API di_shared_tuple di_shared_tuple_ref(di_shared_tuple t);
+/// Same as `di_shared_array_unref`, for tuples.
+PUBLIC_DEAI_API void di_shared_tuple_unref(di_shared_tuple t);
+/// Same as `di_shared_array_take`, for tuples.
+PUBLIC_DEAI_API di_tuple di_shared_tuple_take(di_shared_tuple t);
+
 /// Free a `value` of type `t`. This function does not free the storage space used by
 /// `value`. This is to make this function usable for values stored on the stack.
 PUBLIC_DEAI_API void di_free_value(di_type t, di_value *nullable value_ptr);
@@ -502,6 +672,24 @@ static inline di_string unused di_clone_string(di_string other) {
 	return di_string_ndup(other.data, other.length);
 }
 
+/// An immutable string whose buffer is reference counted, so it can be copied without
+/// allocating. Like `di_shared_array`, sharing is opt-in: owned `di_string`s are never
+/// shared, and a shared string is a different type, which can't be freed as a
+/// `di_string`.
+///
+/// `string` is a borrowed view of it, which is always null terminated. Copies are made
+/// with `di_shared_string_ref`, and dropped with `di_shared_string_unref`, on any thread.
+typedef struct di_shared_string {
+	di_string string;
+} di_shared_string;
+
+/// Make a shared string with the content of `str`, which can be borrowed or owned.
+PUBLIC_DEAI_API di_shared_string di_share_string(di_string str);
+/// Make a copy of `str`, which shares its buffer.
+PUBLIC_DEAI_API di_shared_string di_shared_string_ref(di_shared_string str);
+/// Drop a copy of `str`, freeing the buffer if it is the last one.
+PUBLIC_DEAI_API void di_shared_string_unref(di_shared_string str);
+
 /// Takes the ownership of a null terminated string `str` into a di_string
 static inline di_string unused di_string_borrow(const char *nonnull str) {
 	return (di_string){
@@ -717,11 +905,13 @@ static inline unused size_t di_sizeof_type(di_type t) {
 	abort();
 }
 
-static inline unused int di_call_void_impl(di_object *nonnull o, di_string name, di_tuple args) {
+static inline unused int di_call_void_impl(di_object *nonnull o,
+                                           struct di_member_cache *nonnull cache,
+                                           di_string name, di_tuple args) {
 	di_type rtype;
 	di_value ret;
 	bool called;
-	int rc = di_callx(o, name, &rtype, &ret, args, &called);
+	int rc = di_callx_cached(o, cache, name, &rtype, &ret, args, &called);
 	if (rc != 0) {
 		return rc;
 	}
@@ -809,6 +999,19 @@ static inline void unused di_free_di_weak_objectpp(di_weak_object *nullable *non
 #define di_emit(o, name, ...)                                                            \
 	di_emitn((di_object *)o, di_string_borrow(name), di_make_tuple(__VA_ARGS__))
 
+/// Intern a string literal, the atom is cached at the call site.
+#define di_atom_of(str)                                                                  \
+	({                                                                                   \
+		static _Thread_local const struct di_atom *__deai_atom_of = NULL;                \
+		if (__deai_atom_of == NULL) {                                                    \
+			__deai_atom_of = di_intern(di_string_borrow_literal(str));                   \
+		}                                                                                \
+		__deai_atom_of;                                                                  \
+	})
+
+#define di_emit_atom(o, atom, ...)                                                       \
+	di_emitn_atom((di_object *)o, (atom), di_make_tuple(__VA_ARGS__))
+
 #define di_make_variant(x)                                                               \
 	((struct di_variant){                                                                \
 	    (di_value *)addressof(x),                                                        \
@@ -831,7 +1034,11 @@ static inline void unused di_free_di_weak_objectpp(di_weak_object *nullable *non
 	            (struct di_variant[]){LIST_APPLY(di_make_variant, SEP_COMMA, __VA_ARGS__)}})
 // call but ignore return
 #define di_call(o, name, ...)                                                            \
-	di_call_void_impl((di_object *)(o), di_string_borrow(name), di_make_tuple(__VA_ARGS__))
+	({                                                                                   \
+		static _Thread_local struct di_member_cache __deai_call_cache;                   \
+		di_call_void_impl((di_object *)(o), &__deai_call_cache, di_string_borrow(name),  \
+		                  di_make_tuple(__VA_ARGS__));                                   \
+	})
 
 #define di_callr(o, name, r, ...)                                                        \
 	/* NOLINTBEGIN(bugprone-assignment-in-if-condition) */                               \
@@ -841,9 +1048,11 @@ static inline void unused di_free_di_weak_objectpp(di_weak_object *nullable *non
 			di_type __deai_callr_rtype;                                                  \
 			di_value __deai_callr_ret;                                                   \
 			bool called;                                                                 \
-			__deai_callr_rc =                                                            \
-			    di_callx((di_object *)(o), di_string_borrow(name), &__deai_callr_rtype,  \
-			             &__deai_callr_ret, di_make_tuple(__VA_ARGS__), &called);        \
+			static _Thread_local struct di_member_cache __deai_callr_cache;              \
+			__deai_callr_rc = di_callx_cached(                                           \
+			    (di_object *)(o), &__deai_callr_cache, di_string_borrow(name),           \
+			    &__deai_callr_rtype, &__deai_callr_ret, di_make_tuple(__VA_ARGS__),      \
+			    &called);                                                                \
 			if (__deai_callr_rc != 0) {                                                  \
 				break;                                                                   \
 			}                                                                            \
@@ -862,6 +1071,9 @@ static inline void unused di_free_di_weak_objectpp(di_weak_object *nullable *non
 
 #define di_get(o, prop, r) di_get2(o, di_string_borrow(prop), r)
 
+#define di_get_atom(o, atom, r)                                                          \
+	di_getxt_atom((void *)(o), (atom), di_typeof(r), (di_value *)&(r), NULL)
+
 /// Get a raw member of an object, returning the value without cloning it.
 /// This is only possible with raw members, because getter returns are temporary values.
 /// And the type of `r` has to match exactly the type of the member, no conversion is performed.
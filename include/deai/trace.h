@@ -0,0 +1,36 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "compiler.h"
+#include "object.h"
+
+/// Tracing of calls, signal emissions and garbage collection, started with `di.trace`.
+/// Spans are recorded into per-thread buffers and written out by a background thread,
+/// as a JSON file in the Trace Event Format, which can be viewed in chrome://tracing or
+/// Perfetto. While tracing is stopped, starting a span costs a branch.
+
+PUBLIC_DEAI_API extern atomic_bool di_tracing;
+
+PUBLIC_DEAI_API uint64_t di_trace_now(void);
+
+/// Start a span, returns 0 if tracing is stopped.
+static inline uint64_t di_trace_begin(void) {
+	if (__builtin_expect(atomic_load_explicit(&di_tracing, memory_order_relaxed), 0)) {
+		return di_trace_now();
+	}
+	return 0;
+}
+
+/// Record a span named `name` that started at `start`, as returned by `di_trace_begin`.
+/// `name` must be a string literal, `detail` is copied, and could be truncated.
+PUBLIC_DEAI_API void
+di_trace_end(const char *nonnull name, di_string detail, uint64_t start);
@@ -26,3 +26,11 @@ PUBLIC_DEAI_API int di_type_conversion(di_type from_type, di_value *from, di_typ
                                        di_value *to, bool borrowing);
 PUBLIC_DEAI_API int
 di_int_conversion(di_type from_type, di_value *from, int to_bits, bool to_unsigned, void *to);
+/// Convert `length` integers at `from`, each `from_bits` wide, to `to_bits` wide integers
+/// stored in `to`. The integers are converted in bulk, without going through `di_value`s.
+///
+/// Returns 0 on success, -EINVAL if the bit widths are not 8, 16, 32 or 64, or if any of the
+/// values is out of range of the destination type, in which case `to` is left untouched.
+PUBLIC_DEAI_API int di_int_array_conversion(const void *from, int from_bits, bool from_unsigned,
+                                            void *to, int to_bits, bool to_unsigned,
+                                            size_t length);
@@ -0,0 +1,292 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <deai/builtins/log.h>
+#include <deai/helper.h>
+
+#include <ev.h>
+
+#include "common.h"
+#include "di_internal.h"
+#include "loop_stats.h"
+
+/// Number of histogram buckets. Bucket 0 counts durations under 1 microsecond, bucket
+/// `i` counts those in [2^(i-1), 2^i) microseconds, and the last one everything longer.
+#define DI_LOOP_STATS_BUCKETS 20
+#define DI_LOOP_STATS_DEFAULT_LOG_INTERVAL 60.0
+/// Callbacks nested deeper than this are counted as part of the one they are nested in
+#define DI_LOOP_STATS_MAX_DEPTH 16
+
+struct di_loop_histogram {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[DI_LOOP_STATS_BUCKETS];
+	/// Same as above, but only since the last summary log line
+	uint64_t window_count;
+	uint64_t window_total_ns;
+	uint64_t window_max_ns;
+};
+
+static const char *const source_names[DI_LOOP_SOURCE_COUNT] = {
+    [DI_LOOP_SOURCE_IOEV] = "ioev",
+    [DI_LOOP_SOURCE_TIMER] = "timer",
+    [DI_LOOP_SOURCE_PERIODIC] = "periodic",
+    [DI_LOOP_SOURCE_PROMISE] = "promise",
+    [DI_LOOP_SOURCE_PREPARE] = "prepare",
+    [DI_LOOP_SOURCE_STREAM] = "stream",
+    [DI_LOOP_SOURCE_CHILD_EXIT] = "child_exit",
+    [DI_LOOP_SOURCE_CHILD_OUTPUT] = "child_output",
+};
+
+/// Only touched on the event loop thread
+static struct di_loop_histogram durations[DI_LOOP_SOURCE_COUNT], lags;
+bool di_loop_stats_enabled = false;
+/// Time spent in nested callbacks, for each of the callbacks being timed
+static uint64_t nested_ns[DI_LOOP_STATS_MAX_DEPTH];
+/// Number of callbacks being timed
+static unsigned int depth = 0;
+
+struct di_loop_stats {
+	di_object_internal;
+	struct ev_loop *loop;
+	/// Logs a summary every `log_interval` seconds while enabled
+	ev_timer summary;
+	double log_interval;
+};
+
+uint64_t di_loop_stats_now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void di_loop_histogram_record(struct di_loop_histogram *h, uint64_t ns) {
+	uint64_t us = ns / 1000;
+	unsigned int bucket = us == 0 ? 0 : 64 - (unsigned int)__builtin_clzll(us);
+	if (bucket >= DI_LOOP_STATS_BUCKETS) {
+		bucket = DI_LOOP_STATS_BUCKETS - 1;
+	}
+	h->buckets[bucket]++;
+	h->count++;
+	h->total_ns += ns;
+	h->window_count++;
+	h->window_total_ns += ns;
+	if (ns > h->max_ns) {
+		h->max_ns = ns;
+	}
+	if (ns > h->window_max_ns) {
+		h->window_max_ns = ns;
+	}
+}
+
+uint64_t di_loop_stats_enter(void) {
+	if (depth >= DI_LOOP_STATS_MAX_DEPTH) {
+		return 0;
+	}
+	nested_ns[depth++] = 0;
+	return di_loop_stats_now_ns();
+}
+
+void di_loop_stats_end(enum di_loop_source source, uint64_t start) {
+	if (start == 0) {
+		return;
+	}
+	uint64_t elapsed = di_loop_stats_now_ns() - start;
+	depth--;
+	uint64_t nested = nested_ns[depth] < elapsed ? nested_ns[depth] : elapsed;
+	if (depth > 0) {
+		nested_ns[depth - 1] += elapsed;
+	}
+	// Instrumentation could be turned off by the callback
+	if (di_loop_stats_enabled) {
+		di_loop_histogram_record(&durations[source], elapsed - nested);
+	}
+}
+
+void di_loop_stats_lag(double lag) {
+	if (!di_loop_stats_enabled) {
+		return;
+	}
+	di_loop_histogram_record(&lags, lag > 0 ? (uint64_t)(lag * 1e9) : 0);
+}
+
+static void di_loop_stats_log_summary(EV_P_ ev_timer *w, int revents) {
+	char line[1024];
+	size_t len = 0;
+	for (int i = 0; i < DI_LOOP_SOURCE_COUNT; i++) {
+		auto h = &durations[i];
+		if (h->window_count == 0 || len >= sizeof(line)) {
+			continue;
+		}
+		len += (size_t)snprintf(
+		    line + len, sizeof(line) - len,
+		    "%s %" PRIu64 " calls, %.2fms total, %.2fms max; ", source_names[i],
+		    h->window_count, (double)h->window_total_ns / 1e6,
+		    (double)h->window_max_ns / 1e6);
+		h->window_count = h->window_total_ns = h->window_max_ns = 0;
+	}
+	if (lags.window_count != 0 && len < sizeof(line)) {
+		len += (size_t)snprintf(
+		    line + len, sizeof(line) - len, "timer lag %.2fms avg, %.2fms max",
+		    (double)lags.window_total_ns / 1e6 / (double)lags.window_count,
+		    (double)lags.window_max_ns / 1e6);
+		lags.window_count = lags.window_total_ns = lags.window_max_ns = 0;
+	}
+	if (len != 0) {
+		log_info("Event loop: %s", line);
+	}
+}
+
+static void di_loop_stats_update_summary(struct di_loop_stats *s) {
+	if (ev_is_active(&s->summary)) {
+		// The watcher was unreferenced when started
+		ev_ref(s->loop);
+		ev_timer_stop(s->loop, &s->summary);
+	}
+	if (di_loop_stats_enabled && s->log_interval > 0) {
+		ev_timer_set(&s->summary, s->log_interval, s->log_interval);
+		ev_timer_start(s->loop, &s->summary);
+		// The summary shouldn't keep the event loop running by itself
+		ev_unref(s->loop);
+	}
+}
+
+static di_object *di_loop_histogram_to_object(const struct di_loop_histogram *h) {
+	auto ret = di_new_object_with_type(di_object);
+	di_set_type(ret, "deai.builtin.event:Histogram");
+	uint64_t count = h->count;
+	double total = (double)h->total_ns / 1e9, max = (double)h->max_ns / 1e9;
+	int rc = di_member_clone(ret, "count", count);
+	rc = rc ?: di_member_clone(ret, "total", total);
+	rc = rc ?: di_member_clone(ret, "max", max);
+	DI_CHECK_OK(rc);
+	di_array buckets = {
+	    .length = DI_LOOP_STATS_BUCKETS,
+	    .elem_type = DI_TYPE_UINT,
+	    .arr = tmalloc(uint64_t, DI_LOOP_STATS_BUCKETS),
+	};
+	memcpy(buckets.arr, h->buckets, sizeof(h->buckets));
+	DI_CHECK_OK(di_add_member_move(ret, di_string_borrow_literal("buckets"),
+	                               (di_type[]){DI_TYPE_ARRAY}, &buckets));
+	return ret;
+}
+
+static bool di_loop_stats_get_enabled(struct di_loop_stats *unused s) {
+	return di_loop_stats_enabled;
+}
+
+static int di_loop_stats_set_enabled(struct di_loop_stats *s, bool enabled) {
+	di_loop_stats_enabled = enabled;
+	di_loop_stats_update_summary(s);
+	return 0;
+}
+
+static double di_loop_stats_get_log_interval(struct di_loop_stats *s) {
+	return s->log_interval;
+}
+
+static int di_loop_stats_set_log_interval(struct di_loop_stats *s, double interval) {
+	if (!(interval >= 0)) {
+		return -EINVAL;
+	}
+	s->log_interval = interval;
+	di_loop_stats_update_summary(s);
+	return 0;
+}
+
+static di_object *di_loop_stats_get_sources(struct di_loop_stats *unused s) {
+	auto ret = di_new_object_with_type(di_object);
+	for (int i = 0; i < DI_LOOP_SOURCE_COUNT; i++) {
+		auto h = di_loop_histogram_to_object(&durations[i]);
+		DI_CHECK_OK(di_add_member_move(ret, di_string_borrow(source_names[i]),
+		                               (di_type[]){DI_TYPE_OBJECT}, &h));
+	}
+	return ret;
+}
+
+static di_object *di_loop_stats_get_lag(struct di_loop_stats *unused s) {
+	return di_loop_histogram_to_object(&lags);
+}
+
+static void di_loop_stats_reset(struct di_loop_stats *unused s) {
+	memset(durations, 0, sizeof(durations));
+	memset(&lags, 0, sizeof(lags));
+}
+
+static void di_loop_stats_dtor(di_object *obj) {
+	auto s = (struct di_loop_stats *)obj;
+	di_loop_stats_enabled = false;
+	di_loop_stats_update_summary(s);
+}
+
+/// Event loop statistics
+///
+/// EXPORT: event.stats: deai.builtin.event:Stats
+///
+/// TYPE: deai.builtin.event:Stats
+///
+/// Instrumentation of the event loop, to find the event handlers that stall it. Nothing
+/// is collected until :lua:attr:`enabled` is set.
+///
+/// EXPORT: deai.builtin.event:Stats.enabled: :bool
+///
+/// Read/write property, whether statistics are being collected.
+///
+/// EXPORT: deai.builtin.event:Stats.log_interval: :float
+///
+/// Read/write property, how often, in seconds, a summary of the callbacks run since the
+/// last summary is logged at the "info" level while enabled. 0 disables the summary.
+/// Defaults to 60.
+///
+/// EXPORT: deai.builtin.event:Stats.sources: :object
+///
+/// How long the callbacks of each kind of event source took, keyed by the kind: "ioev",
+/// "timer", "periodic", "promise", "prepare", "stream", "child_exit" and "child_output".
+/// Handlers of file descriptors watched by plugins are counted as "ioev". Each value is
+/// a `deai.builtin.event:Histogram`.
+///
+/// Time spent in a callback that runs inside of another one is only counted for the
+/// inner one, e.g. output of a child process is handled in the "ioev" callback of its
+/// pipe, but counted as "child_output". "prepare" includes delivering the emissions to
+/// batched signal handlers, and garbage collection.
+///
+/// EXPORT: deai.builtin.event:Stats.lag: deai.builtin.event:Histogram
+///
+/// How late timers fired, compared to when they were due.
+///
+/// EXPORT: deai.builtin.event:Stats.reset(): :void
+///
+/// Clear all collected statistics.
+///
+/// TYPE: deai.builtin.event:Histogram
+///
+/// A snapshot of durations. `count` is the number of samples, `total` and `max` are in
+/// seconds. `buckets` is an array of counts, the first one counts durations under 1
+/// microsecond, the i-th one durations between 2^(i-1) and 2^i microseconds, and the
+/// last one everything longer.
+di_object *di_new_loop_stats(struct ev_loop *loop) {
+	auto s = di_new_object_with_type2(struct di_loop_stats, "deai.builtin.event:Stats");
+	s->loop = loop;
+	s->log_interval = DI_LOOP_STATS_DEFAULT_LOG_INTERVAL;
+	ev_timer_init(&s->summary, di_loop_stats_log_summary, 0, 0);
+	di_set_object_dtor((di_object *)s, di_loop_stats_dtor);
+
+	di_getter(s, enabled, di_loop_stats_get_enabled);
+	di_setter(s, enabled, di_loop_stats_set_enabled, bool);
+	di_getter(s, log_interval, di_loop_stats_get_log_interval);
+	di_setter(s, log_interval, di_loop_stats_set_log_interval, double);
+	di_getter(s, sources, di_loop_stats_get_sources);
+	di_getter(s, lag, di_loop_stats_get_lag);
+	di_method(s, "reset", di_loop_stats_reset);
+	return (di_object *)s;
+}
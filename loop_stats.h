@@ -0,0 +1,52 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <deai/deai.h>
+
+/// Optional instrumentation of the event loop: how long the callbacks of each kind of
+/// event source take, and how late timers fire. Only collected while enabled through
+/// `event.stats`, otherwise timing a callback costs a branch.
+///
+/// Callbacks can be nested, e.g. the output of a child process is handled inside of the
+/// "ioev" callback of its pipe. Time spent in a nested callback is only counted for the
+/// nested one, not for the callbacks around it.
+
+enum di_loop_source {
+	DI_LOOP_SOURCE_IOEV,
+	DI_LOOP_SOURCE_TIMER,
+	DI_LOOP_SOURCE_PERIODIC,
+	DI_LOOP_SOURCE_PROMISE,
+	DI_LOOP_SOURCE_PREPARE,
+	DI_LOOP_SOURCE_STREAM,
+	DI_LOOP_SOURCE_CHILD_EXIT,
+	DI_LOOP_SOURCE_CHILD_OUTPUT,
+	DI_LOOP_SOURCE_COUNT,
+};
+
+struct ev_loop;
+
+extern bool di_loop_stats_enabled;
+
+uint64_t di_loop_stats_now_ns(void);
+uint64_t di_loop_stats_enter(void);
+
+/// Start timing a callback, returns 0 if instrumentation is disabled. Every call that
+/// doesn't return 0 must be matched by a `di_loop_stats_end`.
+static inline uint64_t di_loop_stats_begin(void) {
+	return di_loop_stats_enabled ? di_loop_stats_enter() : 0;
+}
+/// Record a callback of `source` that started at `start`, as returned by
+/// `di_loop_stats_begin`, minus the time spent in the callbacks nested in it.
+void di_loop_stats_end(enum di_loop_source source, uint64_t start);
+/// Record that a timer fired `lag` seconds after it was due.
+void di_loop_stats_lag(double lag);
+
+/// Create the `event.stats` object
+di_object *di_new_loop_stats(struct ev_loop *loop);
@@ -31,6 +31,7 @@
 #include "event.h"
 #include "log.h"
 #include "os.h"
+#include "slab.h"
 #include "spawn.h"
 #include "uthash.h"
 
@@ -474,16 +475,17 @@ static bool di_remove_root(di_object *di, di_string key) {
 static void di_clear_roots(di_object *di_) {
 	static const char *const root_prefix = "___root_";
 	const size_t root_prefix_len = strlen(root_prefix);
-	auto di = (di_object_internal *)di_;
-	struct di_member *i, *tmp;
-	HASH_ITER (hh, di->members, i, tmp) {
-		if (i->name.length < root_prefix_len) {
+	di_array names = di_get_all_member_names_raw(di_);
+	di_string *arr = names.arr;
+	for (int i = 0; i < names.length; i++) {
+		if (arr[i].length < root_prefix_len) {
 			continue;
 		}
-		if (strncmp(i->name.data, root_prefix, root_prefix_len) == 0) {
-			di_delete_member_raw(di_, i->name);
+		if (strncmp(arr[i].data, root_prefix, root_prefix_len) == 0) {
+			di_delete_member_raw(di_, arr[i]);
 		}
 	}
+	di_free_array(names);
 }
 
 /// Add an unnamed root.
@@ -493,18 +495,8 @@ static void di_clear_roots(di_object *di_) {
 /// Unlike the named roots, these roots don't need a unique name, but the same object
 /// cannot be added twice. Returns true if the root was added, false if it was already
 /// there.
-static bool di_add_anonymous_root(di_object *obj, di_object *root) {
-	auto roots = (struct di_roots *)obj;
-
-	struct di_anonymous_root *aroot = NULL;
-	HASH_FIND_PTR(roots->anonymous_roots, &root, aroot);
-	if (aroot != NULL) {
-		return false;
-	}
-	aroot = tmalloc(struct di_anonymous_root, 1);
-	aroot->obj = di_ref_object(root);
-	HASH_ADD_PTR(roots->anonymous_roots, obj, aroot);
-	return true;
+static bool di_add_anonymous_root(di_object *unused obj, di_object *root) {
+	return di_pin_object(root);
 }
 
 /// Remove an unnamed root.
@@ -512,38 +504,26 @@ static bool di_add_anonymous_root(di_object *obj, di_object *root) {
 /// EXPORT: deai:Roots.remove_anonymous(root: :object): :boolean
 ///
 /// Returns true if the root was removed, false if it does not exist.
-static bool di_remove_anonymous_root(di_object *obj, di_object *root) {
-	auto roots = (struct di_roots *)obj;
-	struct di_anonymous_root *aroot = NULL;
-	HASH_FIND_PTR(roots->anonymous_roots, &root, aroot);
-	if (aroot) {
-		HASH_DEL(roots->anonymous_roots, aroot);
-		di_unref_object(aroot->obj);
-		free(aroot);
-		return true;
-	}
-	return false;
+static bool di_remove_anonymous_root(di_object *unused obj, di_object *root) {
+	return di_unpin_object(root);
 }
 
 static void di_roots_dtor(di_object *obj) {
 	// Drop all the anonymous roots
 	auto roots = (struct di_roots *)obj;
-	struct di_anonymous_root *i, *tmp;
-
-	// Grab a list of objects we need to free first. Because destroying an object can
-	// cause another anonymous root to be removed anywhere on the list, HASH_ITER is
-	// not enough to handle this scenario.
-	auto total_roots = HASH_COUNT(roots->anonymous_roots);
-	auto objects_to_free = tmalloc(di_object *, total_roots);
-	size_t index = 0;
-	HASH_ITER (hh, roots->anonymous_roots, i, tmp) {
-		HASH_DEL(roots->anonymous_roots, i);
-		objects_to_free[index++] = i->obj;
-		free(i);
+	roots->dropped = true;
+
+	// Take the whole list of objects first. Because destroying an object can cause
+	// another pinned object to be unpinned, anywhere on the list.
+	auto total_roots = roots->npinned;
+	auto objects_to_free = roots->pinned;
+	roots->pinned = NULL;
+	roots->npinned = roots->pinned_capacity = 0;
+	for (uint32_t i = 0; i < total_roots; i++) {
+		((di_object_internal *)objects_to_free[i])->pin_index = 0;
 	}
-	DI_CHECK(index == total_roots);
 
-	for (size_t i = 0; i < total_roots; i++) {
+	for (uint32_t i = 0; i < total_roots; i++) {
 		di_unref_object(objects_to_free[i]);
 	}
 	free(objects_to_free);
@@ -559,14 +539,54 @@ static di_object *di_roots_getter(di_object *unused di) {
 	return (di_object *)roots;
 }
 
+#ifdef UNITTESTS
+/// Run the unit tests of the core
+static void di_run_unit_tests(di_object *unused di) {
+	di_closure_unit_tests();
+	di_gc_unit_tests();
+}
+#endif
+
 static const char *di_get_plugin_install_dir(di_object *p unused) {
 	return DI_PLUGIN_INSTALL_DIR;
 }
 
+/// Occupancy of the memory pools
+///
+/// EXPORT: deai:Stats.slab: [deai:SlabStats]
+///
+/// Objects and their member tables are allocated from per size class pools. Each element
+/// describes one size class: `block_size` is the size of blocks in the class, `nslabs` is
+/// the number of slabs allocated, `in_use` and `free` are the numbers of blocks that are
+/// in use, or are free for reuse, respectively.
+static di_array di_get_slab_stats(di_object *unused stats) {
+	return di_slab_stats_array();
+}
+
+/// Runtime statistics
+///
+/// TYPE: deai:Stats
+///
+/// EXPORT: stats: deai:Stats
+///
+/// EXPORT: deai:Stats.gc: deai:GcStats
+///
+/// Garbage collector and object lifetime statistics.
+static di_object *di_new_stats(void) {
+	auto stats = di_new_object_with_type(di_object);
+	di_set_type(stats, "deai:Stats");
+	auto gc_stats = di_new_gc_stats();
+	DI_CHECK_OK(di_member(stats, "gc", gc_stats));
+	DI_CHECK_OK(di_getter(stats, slab, di_get_slab_stats));
+	return stats;
+}
+
 int main(int argc, char *argv[]) {
 #ifdef TRACK_OBJECTS
 	INIT_LIST_HEAD(&all_objects);
 #endif
+	di_init_object_types();
+
 	auto p = di_new_object_with_type(struct deai);
 	di_set_type((di_object *)p, "deai:Core");
 
@@ -629,9 +649,16 @@ int main(int argc, char *argv[]) {
 	di_member(p, "dump_objects", closure);
 
 	DI_CHECK_OK(di_method(p, "track_object_ref", di_track_object_ref, di_object *));
+#ifdef UNITTESTS
+	DI_CHECK_OK(di_method(p, "run_unit_tests", di_run_unit_tests));
+#endif
 
 	DI_CHECK_OK(di_method(p, "__get_roots", di_roots_getter));
 	DI_CHECK_OK(di_method(p, "__get_argv", di_get_argv));
+	auto stats = di_new_stats();
+	DI_CHECK_OK(di_member(p, "stats", stats));
+	auto trace = di_new_trace();
+	DI_CHECK_OK(di_member(p, "trace", trace));
 
 	// proctitle is a string literal, as its memory is not deai managed
 	auto proctitle_getter =
@@ -788,11 +815,16 @@ int main(int argc, char *argv[]) {
 	if (!quit) {
 		ev_run(p->loop, 0);
 	}
+	// The event loop only collects garbage incrementally, make sure nothing is left behind
+	di_collect_garbage();
+	di_trace_stop();
 
 	di_unref_object((di_object *)roots);
 	// Set to NULL so the leak checker can catch leaks
 	roots = NULL;
+	di_free_type_tables();
 
 	di_dump_objects();
+	di_slab_release_unused();
 	return exit_code;
 }
@@ -9,21 +9,34 @@
 #include <deai/error.h>
 #include <deai/helper.h>
 #include <deai/object.h>
+#include <deai/trace.h>
 #include <deai/type.h>
 #include <assert.h>
 #include <ev.h>
 #include <inttypes.h>
 #include <stdalign.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <sys/mman.h>
+#include <threads.h>
+#include <time.h>
 #include "di_internal.h"
+#include "slab.h"
 #include "utils.h"
 
-#define HANDLER_PREFIX "handler_object_"
 struct di_signal {
 	di_object;
+	/// Number of handlers that haven't been removed
 	int nhandlers;
+	/// Number of dispatches in progress. While this is non-zero, removed handlers are
+	/// replaced by `tombstone` instead of being taken out of the handler array, so
+	/// dispatches can walk the array by index.
+	int dispatching;
+	/// Number of tombstones in the handler array
+	int ntombstones;
+	/// Placeholder for removed handlers, created on first use
+	di_object *nullable tombstone;
 };
 
 // This is essentially a fat weak reference, from object to its listeners.
@@ -32,13 +45,12 @@ struct di_listener {
 	struct list_head siblings;
 };
 
-static di_object_internal dead_weakly_referenced_object = {
-    .ref_count = 0,
-    .weak_ref_count = 1,        // Keep this object from being freed
+static struct di_weak_object dead_weak_ref_block = {
+    .object = NULL,
+    .ref_count = 1,        // Keep this block from being freed
 };
 
-struct di_weak_object *const dead_weak_ref =
-    (struct di_weak_object *)&dead_weakly_referenced_object;
+struct di_weak_object *const dead_weak_ref = &dead_weak_ref_block;
 
 const void *null_ptr = NULL;
 // clang-format off
@@ -49,6 +61,11 @@ static_assert(alignof(di_object) == alignof(di_object_internal),
 // clang-format on
 
 static const char error_type[] = "deai:Error";
+static const char signal_type[] = "deai:Signal";
+static const char listen_handle_type[] = "deai:ListenHandle";
+static const char batched_handler_type[] = "deai:BatchedSignalHandler";
+static const char filtered_handler_type[] = "deai:FilteredSignalHandler";
+static const char gc_stats_type[] = "deai:GcStats";
 
 di_string di_error_to_string(di_object *err) {
 	di_string func = DI_STRING_INIT, file = DI_STRING_INIT;
@@ -189,7 +206,6 @@ di_new_error_from_string(const char *file, int line, const char *func, di_string
 	di_member(err, "stack_proc_names", names);
 #endif
 
-	di_method(err, "__to_string", di_error_to_string);
 	di_member(err, "error", message);
 	if (file) {
 		di_member_clone(err, "file", di_string_borrow(file));
@@ -222,6 +238,447 @@ bool di_is_error(di_object *obj) {
 	return di_check_type(obj, error_type);
 }
 
+enum di_atom_derived {
+	DI_ATOM_SIGNAL,
+	DI_ATOM_GETTER,
+	DI_ATOM_SETTER,
+	DI_ATOM_DELETER,
+	DI_ATOM_NDERIVED,
+};
+
+struct di_atom_internal {
+	struct di_atom;
+	/// Atoms of names derived from this one, created on demand
+	const struct di_atom *nullable derived[DI_ATOM_NDERIVED];
+	UT_hash_handle hh;
+};
+
+static const char *const atom_derived_prefixes[] = {
+    [DI_ATOM_SIGNAL] = "__signal_",
+    [DI_ATOM_GETTER] = "__get_",
+    [DI_ATOM_SETTER] = "__set_",
+    [DI_ATOM_DELETER] = "__delete_",
+};
+
+/// All interned names. Atoms are never freed.
+static thread_local struct di_atom_internal *atoms = NULL;
+
+static inline unsigned int di_hash_name(di_string name) {
+	unsigned int hashv;
+	HASH_VALUE(name.data, name.length, hashv);
+	return hashv;
+}
+
+/// A key that can be used to look up members, but is not interned.
+static inline struct di_atom di_key(di_string name) {
+	return (struct di_atom){.name = name, .hash = di_hash_name(name)};
+}
+
+static struct di_atom_internal *nullable di_find_atom(const struct di_atom *key) {
+	struct di_atom_internal *ret = NULL;
+	HASH_FIND_BYHASHVALUE(hh, atoms, key->name.data, key->name.length, key->hash, ret);
+	return ret;
+}
+
+static const struct di_atom *di_intern_key(const struct di_atom *key) {
+	auto ret = di_find_atom(key);
+	if (ret == NULL) {
+		ret = tmalloc(struct di_atom_internal, 1);
+		ret->name = di_clone_string(key->name);
+		ret->hash = key->hash;
+		HASH_ADD_KEYPTR_BYHASHVALUE(hh, atoms, ret->name.data, ret->name.length,
+		                            ret->hash, ret);
+	}
+	return (struct di_atom *)ret;
+}
+
+const struct di_atom *di_intern(di_string name) {
+	auto key = di_key(name);
+	return di_intern_key(&key);
+}
+
+/// Get the atom of the name of `atom_`, prefixed according to `kind`.
+static const struct di_atom *
+di_atom_derive(const struct di_atom *atom_, enum di_atom_derived kind) {
+	auto atom = (struct di_atom_internal *)atom_;
+	if (atom->derived[kind] == NULL) {
+		scoped_di_string name = di_string_printf("%s%.*s", atom_derived_prefixes[kind],
+		                                         (int)atom->name.length, atom->name.data);
+		atom->derived[kind] = di_intern(name);
+	}
+	return atom->derived[kind];
+}
+
+/// Like `di_atom_derive`, but `key` doesn't have to be interned. If it is not, the
+/// derived name is formatted into `buf`, which the caller must free.
+static struct di_atom
+di_derive_key(const struct di_atom *key, enum di_atom_derived kind, di_string *buf) {
+	auto atom = di_find_atom(key);
+	if (atom != NULL) {
+		return *di_atom_derive((struct di_atom *)atom, kind);
+	}
+	*buf = di_string_printf("%s%.*s", atom_derived_prefixes[kind], (int)key->name.length,
+	                        key->name.data);
+	return di_key(*buf);
+}
+
+/// Intern the names with a derivable prefix, and link them to the atom of the unprefixed
+/// name. This way, getters, setters, etc. registered on objects can be found by
+/// accessing their properties by name without formatting the prefixed names.
+static void di_intern_if_derived(di_string name) {
+	if (name.length < 2 || name.data[0] != '_' || name.data[1] != '_') {
+		return;
+	}
+	for (int i = 0; i < DI_ATOM_NDERIVED; i++) {
+		if (di_string_starts_with(name, atom_derived_prefixes[i])) {
+			auto base = (struct di_atom_internal *)di_intern(
+			    di_suffix(name, strlen(atom_derived_prefixes[i])));
+			if (base->derived[i] == NULL) {
+				base->derived[i] = di_intern(name);
+			}
+			return;
+		}
+	}
+}
+
+#define DI_MEMBER_INDEX_EMPTY UINT32_MAX
+
+/// Source of member table stamps. Objects can be handed between threads, so the stamps have
+/// to be unique across all of them.
+static _Atomic uint64_t next_member_table_stamp = 1;
+
+static inline void di_member_table_touch(struct di_member_table *t) {
+	t->stamp = atomic_fetch_add_explicit(&next_member_table_stamp, 1, memory_order_relaxed);
+}
+
+static inline uint64_t di_member_name_filter_bit(unsigned int hash) {
+	return (uint64_t)1 << (hash % 64);
+}
+
+static inline uint32_t *di_member_table_index(struct di_member_table *t) {
+	return (uint32_t *)&t->entries[t->capacity];
+}
+
+static inline bool di_member_matches(const struct di_member *m, const struct di_atom *key) {
+	return m->name.data != NULL && m->hash == key->hash && m->name.length == key->name.length &&
+	       memcmp(m->name.data, key->name.data, key->name.length) == 0;
+}
+
+static struct di_member *nullable di_member_table_find(struct di_member_table *nullable t,
+                                                       const struct di_atom *key) {
+	if (t == NULL) {
+		return NULL;
+	}
+	if (t->index_bits == 0) {
+		for (uint32_t i = 0; i < t->nentries; i++) {
+			if (di_member_matches(&t->entries[i], key)) {
+				return &t->entries[i];
+			}
+		}
+		return NULL;
+	}
+
+	auto index = di_member_table_index(t);
+	uint32_t mask = (1U << t->index_bits) - 1;
+	for (uint32_t i = key->hash & mask; index[i] != DI_MEMBER_INDEX_EMPTY; i = (i + 1) & mask) {
+		// Removed members still occupy their index slots, until the table is rebuilt.
+		if (di_member_matches(&t->entries[index[i]], key)) {
+			return &t->entries[index[i]];
+		}
+	}
+	return NULL;
+}
+
+static void di_member_table_index_insert(struct di_member_table *t, uint32_t entry) {
+	auto index = di_member_table_index(t);
+	uint32_t mask = (1U << t->index_bits) - 1;
+	uint32_t i = t->entries[entry].hash & mask;
+	while (index[i] != DI_MEMBER_INDEX_EMPTY) {
+		i = (i + 1) & mask;
+	}
+	index[i] = entry;
+}
+
+/// Create a new table with room for `capacity` entries, and move the live members of `old`
+/// into it. `old` is freed.
+static size_t di_member_table_size(uint32_t capacity, uint32_t index_bits) {
+	size_t size = sizeof(struct di_member_table) + sizeof(struct di_member) * capacity;
+	if (index_bits != 0) {
+		size += sizeof(uint32_t) << index_bits;
+	}
+	return size;
+}
+
+/// Allocate memory for a member table. Small tables are very common, so they are
+/// allocated from the slab pools.
+static struct di_member_table *di_member_table_alloc(uint32_t capacity, uint32_t index_bits) {
+	size_t size = di_member_table_size(capacity, index_bits);
+	unsigned int slab_class = di_slab_class(size);
+	struct di_member_table *t = slab_class != 0 ? di_slab_alloc(slab_class) : malloc(size);
+	DI_CHECK(t, "Out of memory");
+	return t;
+}
+
+static void di_member_table_dealloc(struct di_member_table *nullable t) {
+	if (t == NULL) {
+		return;
+	}
+	unsigned int slab_class = di_slab_class(di_member_table_size(t->capacity, t->index_bits));
+	if (slab_class != 0) {
+		di_slab_free(t, slab_class);
+	} else {
+		free(t);
+	}
+}
+
+static struct di_member_table *
+di_member_table_rebuild(struct di_member_table *nullable old, uint32_t capacity) {
+	uint32_t index_bits = 0;
+	if (capacity > DI_MEMBER_TABLE_SMALL) {
+		// Keep the index at most half full, including the removed entries.
+		while ((1U << index_bits) < capacity * 2) {
+			index_bits++;
+		}
+	}
+	struct di_member_table *t = di_member_table_alloc(capacity, index_bits);
+	t->capacity = capacity;
+	t->nentries = 0;
+	t->count = 0;
+	t->index_bits = index_bits;
+	t->name_filter = 0;
+	di_member_table_touch(t);
+	if (index_bits != 0) {
+		memset(di_member_table_index(t), 0xff, sizeof(uint32_t) << index_bits);
+	}
+	if (old != NULL) {
+		for (uint32_t i = 0; i < old->nentries; i++) {
+			if (old->entries[i].name.data == NULL) {
+				continue;
+			}
+			t->entries[t->nentries] = old->entries[i];
+			t->name_filter |= di_member_name_filter_bit(old->entries[i].hash);
+			if (index_bits != 0) {
+				di_member_table_index_insert(t, t->nentries);
+			}
+			t->nentries++;
+		}
+		t->count = t->nentries;
+		di_member_table_dealloc(old);
+	}
+	return t;
+}
+
+/// Add a new entry for `key` to the table, the caller has to make sure the key doesn't
+/// exist yet, and fill in the value. Returns a pointer to the new entry.
+static struct di_member *
+di_member_table_add(struct di_member_table *nullable *nonnull table, const struct di_atom *key) {
+	auto t = *table;
+	if (t == NULL) {
+		t = *table = di_member_table_rebuild(NULL, 4);
+	} else if (t->nentries == t->capacity) {
+		// Only grow if the table is actually getting full, otherwise just reclaim the
+		// space of removed members.
+		t = *table = di_member_table_rebuild(
+		    t, t->count >= t->capacity / 2 ? t->capacity * 2 : t->capacity);
+	}
+
+	auto m = &t->entries[t->nentries];
+	// Share the name with the atom if this name has been interned.
+	auto atom = di_find_atom(key);
+	if (atom != NULL) {
+		m->name = atom->name;
+		m->name_interned = true;
+	} else {
+		m->name = di_clone_string(key->name);
+		m->name_interned = false;
+	}
+	m->hash = key->hash;
+	m->type = DI_TYPE_NIL;
+	if (t->index_bits != 0) {
+		di_member_table_index_insert(t, t->nentries);
+	}
+	t->nentries++;
+	t->count++;
+	t->name_filter |= di_member_name_filter_bit(key->hash);
+	di_member_table_touch(t);
+	return m;
+}
+
+/// Remove the entry `m` from table `t`, its value is moved to `*type` and `*value`
+static void di_member_table_take(struct di_member_table *t, struct di_member *m,
+                                 di_type *type, di_value *value) {
+	*type = m->type;
+	*value = m->value;
+	if (!m->name_interned) {
+		di_free_string(m->name);
+	}
+	m->name = DI_STRING_INIT;
+	m->type = DI_TYPE_NIL;
+	t->count--;
+	di_member_table_touch(t);
+	if (t->count == 0) {
+		// Start over to avoid leaving holes in empty tables
+		t->nentries = 0;
+		t->name_filter = 0;
+		if (t->index_bits != 0) {
+			memset(di_member_table_index(t), 0xff, sizeof(uint32_t) << t->index_bits);
+		}
+	}
+}
+
+/// Free a table and all the values in it
+static void di_member_table_free(struct di_member_table *nullable t) {
+	if (t == NULL) {
+		return;
+	}
+	for (uint32_t i = 0; i < t->nentries; i++) {
+		auto m = &t->entries[i];
+		if (m->name.data == NULL) {
+			continue;
+		}
+		di_free_value(m->type, &m->value);
+		if (!m->name_interned) {
+			di_free_string(m->name);
+		}
+	}
+	di_member_table_dealloc(t);
+}
+
+/// Find the next live member at or after the `*i`-th entry. `*i` is updated to the index of
+/// the returned member.
+static inline struct di_member *nullable di_member_table_next(struct di_member_table *nullable t,
+                                                              uint32_t *i) {
+	if (t == NULL) {
+		return NULL;
+	}
+	for (; *i < t->nentries; (*i)++) {
+		if (t->entries[*i].name.data != NULL) {
+			return &t->entries[*i];
+		}
+	}
+	return NULL;
+}
+
+/// Per-type member tables, keyed by type name.
+static thread_local struct di_type_table *type_tables = NULL;
+
+/// Look up a member of `obj` itself, ignoring members shared by its type.
+static struct di_member *
+di_lookup_own(di_object_internal *obj, const struct di_atom *key) {
+	return di_member_table_find(obj->members, key);
+}
+
+static struct di_member *
+di_lookup_key(di_object_internal *obj, const struct di_atom *key) {
+	auto ret = di_lookup_own(obj, key);
+	if (ret == NULL && obj->type_table != NULL) {
+		ret = di_member_table_find(obj->type_table->members, key);
+	}
+	return ret;
+}
+
+struct di_member *di_lookup_cached(di_object *obj_, struct di_member_cache *cache) {
+	auto obj = (di_object_internal *)obj_;
+	auto own = obj->members;
+	auto shared = obj->type_table != NULL ? obj->type_table->members : NULL;
+	if (cache->stamp != 0) {
+		if (!cache->shared) {
+			if (own != NULL && own->stamp == cache->stamp) {
+				return cache->member;
+			}
+		} else if (shared != NULL && shared->stamp == cache->stamp &&
+		           (own == NULL ||
+		            (own->name_filter & di_member_name_filter_bit(cache->atom->hash)) == 0)) {
+			// Nothing in the object itself can be shadowing the shared member
+			return cache->member;
+		}
+	}
+
+	auto ret = di_member_table_find(own, cache->atom);
+	if (ret != NULL) {
+		cache->stamp = own->stamp;
+		cache->shared = false;
+	} else if ((ret = di_member_table_find(shared, cache->atom)) != NULL) {
+		cache->stamp = shared->stamp;
+		cache->shared = true;
+	} else {
+		cache->stamp = 0;
+	}
+	cache->member = ret;
+	return ret;
+}
+
+static struct di_type_table *di_get_type_table(di_string name) {
+	struct di_type_table *ret = NULL;
+	HASH_FIND(hh, type_tables, name.data, name.length, ret);
+	if (ret == NULL) {
+		ret = tmalloc(struct di_type_table, 1);
+		ret->name = strndup(name.data, name.length);
+		HASH_ADD_KEYPTR(hh, type_tables, ret->name, name.length, ret);
+	}
+	return ret;
+}
+
+/// Point `obj->type_table` to the table of the type named by its "__type" member. Called
+/// whenever the "__type" member is added, changed, or removed.
+static void di_update_type_table(di_object_internal *obj) {
+	auto old_table = obj->type_table;
+	obj->type_table = NULL;
+	auto m = di_lookup_own(obj, di_atom_of("__type"));
+	if (m != NULL && m->type == DI_TYPE_STRING_LITERAL) {
+		obj->type_table = di_get_type_table(di_string_borrow(m->value.string_literal));
+	} else if (m != NULL && m->type == DI_TYPE_STRING) {
+		obj->type_table = di_get_type_table(m->value.string);
+	}
+
+	// Finalization removes the "__type" member too, so this also counts objects of each
+	// type that are freed.
+	if (old_table != obj->type_table) {
+		if (old_table != NULL) {
+			old_table->freed++;
+		}
+		if (obj->type_table != NULL) {
+			obj->type_table->allocated++;
+		}
+	}
+}
+
+static inline bool di_is_type_member(di_string name) {
+	return di_string_eq(name, di_string_borrow_literal("__type"));
+}
+
+/// Bits a member named `name` contributes to the `signal_filter` of its object, 0 if it
+/// can't provide signals.
+static uint64_t di_signal_filter_bits(di_string name, unsigned int hash) {
+	if (name.length < 5 || name.data[0] != '_' || name.data[1] != '_') {
+		return 0;
+	}
+	if (di_string_starts_with(name, atom_derived_prefixes[DI_ATOM_SIGNAL])) {
+		return (uint64_t)1 << (hash % 64);
+	}
+	if (di_string_eq(name, di_string_borrow_literal("__get")) ||
+	    di_string_starts_with(name, "__get___signal_")) {
+		return UINT64_MAX;
+	}
+	return 0;
+}
+
+void di_free_type_tables(void) {
+	struct di_type_table *t, *nt;
+	// Shared members can be objects with types themselves, so all the members have to be
+	// freed before any of the tables are.
+	HASH_ITER (hh, type_tables, t, nt) {
+		auto members = t->members;
+		t->members = NULL;
+		di_member_table_free(members);
+	}
+	HASH_ITER (hh, type_tables, t, nt) {
+		HASH_DEL(type_tables, t);
+		free(t->name);
+		free(t);
+	}
+}
+
 static int di_call_internal(di_object *self, di_object *method_, di_type *rt,
                             di_value *ret, di_tuple args, bool *called) {
 	auto method = (di_object_internal *)method_;
@@ -258,16 +715,71 @@ int di_callx(di_object *self, di_string name, di_type *rt, di_value *ret, di_tup
 	return di_call_internal(self, val, rt, ret, args, called);
 };
 
-/// Call "<prefix>_<name>" with "<prefix>" as fallback
+int di_callx_cached(di_object *self, struct di_member_cache *cache, di_string name,
+                    di_type *rt, di_value *ret, di_tuple args, bool *called) {
+	*called = false;
+	if (cache->atom == NULL) {
+		cache->atom = di_intern(name);
+	} else if (!di_string_eq(cache->atom->name, name)) {
+		// The name used at this call site changes, so caching doesn't help.
+		return di_callx(self, name, rt, ret, args, called);
+	}
+
+	auto m = di_lookup_cached(self, cache);
+	if (m != NULL && m->type == DI_TYPE_OBJECT) {
+		return di_call_internal(self, di_ref_object(m->value.object), rt, ret, args, called);
+	}
+
+	// Not a plain object member, it could need converting, or come from a getter.
+	di_object *val;
+	int rc = di_getxt_atom(self, cache->atom, DI_TYPE_OBJECT, (di_value *)&val, NULL);
+	if (rc != 0) {
+		return rc;
+	}
+	return di_call_internal(self, val, rt, ret, args, called);
+}
+
+static const struct di_atom *di_generic_handler_atom(enum di_atom_derived kind) {
+	switch (kind) {
+	case DI_ATOM_GETTER:
+		return di_atom_of("__get");
+	case DI_ATOM_SETTER:
+		return di_atom_of("__set");
+	case DI_ATOM_DELETER:
+		return di_atom_of("__delete");
+	case DI_ATOM_SIGNAL:
+	case DI_ATOM_NDERIVED:
+		break;
+	}
+	unreachable();
+}
+
+/// Get a raw member with type object, without incrementing its reference count.
+static int
+di_rawget_borrowed_object(di_object *o, const struct di_atom *key, di_object **ret) {
+	auto m = di_lookup_key((di_object_internal *)o, key);
+	if (m == NULL) {
+		return -ENOENT;
+	}
+	if (m->type != DI_TYPE_OBJECT) {
+		return -EINVAL;
+	}
+	*ret = m->value.object;
+	return 0;
+}
+
+/// Call "<prefix>_<name>" with "<prefix>" as fallback, `kind` decides the prefix.
 ///
 /// @param[out] found whether a handler is found
-static int call_handler_with_fallback(di_object *nonnull o, const char *nonnull prefix,
-                                      di_string name, struct di_variant arg,
-                                      di_type *nullable rtype, di_value *nullable ret,
+static int call_handler_with_fallback(di_object *nonnull o, enum di_atom_derived kind,
+                                      const struct di_atom *nonnull key,
+                                      struct di_variant arg, di_type *nullable rtype,
+                                      di_value *nullable ret,
                                       di_object *nullable *nullable error, bool *found) {
 	*found = false;
 
-	scoped_di_string buf = di_string_printf("%s_%.*s", prefix, (int)name.length, name.data);
+	scoped_di_string buf = DI_STRING_INIT;
+	auto handler_key = di_derive_key(key, kind, &buf);
 	di_type rtype2 = DI_LAST_TYPE;
 	di_value ret2;
 
@@ -286,7 +798,7 @@ static int call_handler_with_fallback(di_object *nonnull o, const char *nonnull
 	};
 	di_object *handler = NULL;
 	int rc = -ENOENT;
-	if (di_rawget_borrowed2(o, buf, handler) == 0) {
+	if (di_rawget_borrowed_object(o, &handler_key, &handler) == 0) {
 		*found = true;
 		if (error != NULL) {
 			rc = di_call_object_catch(handler, &rtype2, &ret2, tmp, error);
@@ -295,7 +807,8 @@ static int call_handler_with_fallback(di_object *nonnull o, const char *nonnull
 		}
 	}
 
-	if (rc != 0 && di_rawget_borrowed(o, prefix, handler) == 0) {
+	if (rc != 0 &&
+	    di_rawget_borrowed_object(o, di_generic_handler_atom(kind), &handler) == 0) {
 		*found = true;
 		tmp.length++;
 		if (tmp.length > 2) {
@@ -303,7 +816,7 @@ static int call_handler_with_fallback(di_object *nonnull o, const char *nonnull
 		}
 		args[1] = (struct di_variant){
 		    .type = DI_TYPE_STRING,
-		    .value = (di_value[]){{.string = name}},
+		    .value = (di_value[]){{.string = key->name}},
 		};
 		if (error != NULL) {
 			rc = di_call_object_catch(handler, &rtype2, &ret2, tmp, error);
@@ -323,11 +836,11 @@ static int call_handler_with_fallback(di_object *nonnull o, const char *nonnull
 	return rc;
 }
 
-int di_setx(di_object *o, di_string prop, di_type type, const void *val,
-            di_object *nullable *nullable error) {
+static int di_setx_key(di_object *o, const struct di_atom *key, di_type type,
+                       const void *val, di_object *nullable *nullable error) {
 	// If a setter is present, we just call that and we are done.
 	bool handler_found;
-	int rc = call_handler_with_fallback(o, "__set", prop,
+	int rc = call_handler_with_fallback(o, DI_ATOM_SETTER, key,
 	                                    (struct di_variant){(di_value *)val, type}, NULL,
 	                                    NULL, error, &handler_found);
 	if (handler_found) {
@@ -335,29 +848,49 @@ int di_setx(di_object *o, di_string prop, di_type type, const void *val,
 	}
 
 	// Call the deleter if present
-	rc = call_handler_with_fallback(o, "__delete", prop, (struct di_variant){NULL, DI_LAST_TYPE},
-	                                NULL, NULL, error, &handler_found);
+	rc = call_handler_with_fallback(o, DI_ATOM_DELETER, key,
+	                                (struct di_variant){NULL, DI_LAST_TYPE}, NULL, NULL,
+	                                error, &handler_found);
 	if (handler_found && rc != 0) {
 		return rc;
 	}
 
 	// Finally, replace the value
-	auto mem = di_lookup(o, prop);
+	// Members shared by the object's type are never modified, setting them adds a member
+	// to the object which shadows the shared one.
+	auto mem = di_lookup_own((di_object_internal *)o, key);
 	if (mem) {
-		// the old member still exists, we need to drop the old value
-		di_free_value(mem->type, mem->data);
-
-		mem->data = realloc(mem->data, di_sizeof_type(type));
+		// the old member still exists, we need to drop the old value. Replace it first,
+		// because freeing the old value might modify the object.
+		di_value new_value, old_value = mem->value;
+		di_type old_type = mem->type;
+		di_copy_value(type, &new_value, val);
+		mem->value = new_value;
 		mem->type = type;
-		di_copy_value(mem->type, mem->data, val);
+		if (di_is_type_member(key->name)) {
+			di_update_type_table((di_object_internal *)o);
+		}
+		di_free_value(old_type, &old_value);
 		return 0;
 	}
 
-	return di_add_member_clone(o, prop, type, val);
+	return di_add_member_clone(o, key->name, type, val);
 }
 
-int di_refrawgetx(di_object *o, di_string prop, di_type *type, di_value **ret) {
-	auto m = di_lookup(o, prop);
+int di_setx(di_object *o, di_string prop, di_type type, const void *val,
+            di_object *nullable *nullable error) {
+	auto key = di_key(prop);
+	return di_setx_key(o, &key, type, val, error);
+}
+
+int di_setx_atom(di_object *o, const struct di_atom *atom, di_type type, const void *val,
+                 di_object *nullable *nullable error) {
+	return di_setx_key(o, atom, type, val, error);
+}
+
+static int
+di_refrawgetx_key(di_object *o, const struct di_atom *key, di_type *type, di_value **ret) {
+	auto m = di_lookup_key((di_object_internal *)o, key);
 
 	// nil type is treated as non-existent
 	if (!m) {
@@ -366,13 +899,27 @@ int di_refrawgetx(di_object *o, di_string prop, di_type *type, di_value **ret) {
 
 	assert(di_sizeof_type(m->type) != 0);
 	*type = m->type;
-	*ret = m->data;
+	*ret = &m->value;
 	return 0;
 }
 
-int di_rawgetx(di_object *o, di_string prop, di_type *type, di_value *ret) {
+int di_refrawgetx(di_object *o, di_string prop, di_type *type, di_value **ret) {
+	if (prop.data == NULL) {
+		return -ENOENT;
+	}
+	auto key = di_key(prop);
+	return di_refrawgetx_key(o, &key, type, ret);
+}
+
+int di_refrawgetx_atom(di_object *o, const struct di_atom *atom, di_type *type,
+                       di_value **ret) {
+	return di_refrawgetx_key(o, atom, type, ret);
+}
+
+static int
+di_rawgetx_key(di_object *o, const struct di_atom *key, di_type *type, di_value *ret) {
 	di_value *tmp = NULL;
-	int rc = di_refrawgetx(o, prop, type, &tmp);
+	int rc = di_refrawgetx_key(o, key, type, &tmp);
 	if (rc != 0) {
 		return rc;
 	}
@@ -380,6 +927,14 @@ int di_rawgetx(di_object *o, di_string prop, di_type *type, di_value *ret) {
 	return 0;
 }
 
+int di_rawgetx(di_object *o, di_string prop, di_type *type, di_value *ret) {
+	if (prop.data == NULL) {
+		return -ENOENT;
+	}
+	auto key = di_key(prop);
+	return di_rawgetx_key(o, &key, type, ret);
+}
+
 /// A di_call_fn that does nothing.
 int di_noop(di_object *o, di_type *rt, di_value *r, di_tuple args) {
 	return 0;
@@ -403,16 +958,17 @@ static bool di_free_last_type(di_type type, di_value *val) {
 	return ret;
 }
 
-int di_getx(di_object *o, di_string prop, di_type *type, di_value *ret,
-            di_object *nullable *nullable error) {
-	int rc = di_rawgetx(o, prop, type, ret);
+static int di_getx_key(di_object *o, const struct di_atom *key, di_type *type,
+                       di_value *ret, di_object *nullable *nullable error) {
+	int rc = di_rawgetx_key(o, key, type, ret);
 	if (rc == 0) {
 		return 0;
 	}
 
 	bool handler_found;
-	rc = call_handler_with_fallback(o, "__get", prop, (struct di_variant){NULL, DI_LAST_TYPE},
-	                                type, ret, error, &handler_found);
+	rc = call_handler_with_fallback(o, DI_ATOM_GETTER, key,
+	                                (struct di_variant){NULL, DI_LAST_TYPE}, type, ret,
+	                                error, &handler_found);
 	if (rc != 0) {
 		return rc;
 	}
@@ -427,17 +983,56 @@ int di_getx(di_object *o, di_string prop, di_type *type, di_value *ret,
 	return 0;
 }
 
-int di_getxt(di_object *o, di_string prop, di_type rtype, di_value *ret,
-             di_object *nullable *nullable error) {
+int di_getx(di_object *o, di_string prop, di_type *type, di_value *ret,
+            di_object *nullable *nullable error) {
+	auto key = di_key(prop);
+	return di_getx_key(o, &key, type, ret, error);
+}
+
+int di_getx_cached(di_object *o, struct di_member_cache *cache, di_string prop, di_type *type,
+                   di_value *ret, di_object *nullable *nullable error) {
+	if (cache->atom == NULL) {
+		cache->atom = di_intern(prop);
+	} else if (!di_string_eq(cache->atom->name, prop)) {
+		return di_getx(o, prop, type, ret, error);
+	}
+	auto m = di_lookup_cached(o, cache);
+	if (m != NULL) {
+		*type = m->type;
+		di_copy_value(*type, ret, &m->value);
+		return 0;
+	}
+	return di_getx_key(o, cache->atom, type, ret, error);
+}
+
+int di_getx_atom(di_object *o, const struct di_atom *atom, di_type *type, di_value *ret,
+                 di_object *nullable *nullable error) {
+	return di_getx_key(o, atom, type, ret, error);
+}
+
+static int di_getxt_key(di_object *o, const struct di_atom *key, di_type rtype,
+                        di_value *ret, di_object *nullable *nullable error) {
 	di_value ret2;
 	di_type rt;
-	int rc = di_getx(o, prop, &rt, &ret2, error);
+	int rc = di_getx_key(o, key, &rt, &ret2, error);
 	if (rc != 0) {
 		return rc;
 	}
 	rc = di_type_conversion(rt, &ret2, rtype, ret, 0);
 	return rc;
+}
+
+int di_getxt(di_object *o, di_string prop, di_type rtype, di_value *ret,
+             di_object *nullable *nullable error) {
+	auto key = di_key(prop);
+	return di_getxt_key(o, &key, rtype, ret, error);
 };
+
+int di_getxt_atom(di_object *o, const struct di_atom *atom, di_type rtype, di_value *ret,
+                  di_object *nullable *nullable error) {
+	return di_getxt_key(o, atom, rtype, ret, error);
+}
+
 int di_rawgetxt(di_object *o, di_string prop, di_type rtype, di_value *ret) {
 	di_value ret2;
 	di_type rt;
@@ -482,19 +1077,66 @@ struct di_ref_tracked_object *ref_tracked;
 #endif
 
 /// Objects that has been unreferenced since last mark and sweep.
+/// Candidates for cycle collection, i.e. objects whose reference count dropped but not to
+/// zero. Objects that have survived `DI_GC_OLD_AGE` collections go to
+/// `old_unreferred_objects` instead, which is scanned much less frequently.
 thread_local struct list_head unreferred_objects;
+thread_local struct list_head old_unreferred_objects;
 thread_local bool collecting_garbage = false;
 
+enum {
+	/// Objects that survived this many collections are considered long lived.
+	DI_GC_OLD_AGE = 3,
+	/// Maximum number of objects `di_collect_garbage_step` scans. Collections of young
+	/// objects stop marking when it is reached, even in the middle of a candidate. For
+	/// long lived objects it is a soft limit: it is checked after scanning each candidate,
+	/// so one candidate that reaches a large graph can exceed it.
+	DI_GC_STEP_BUDGET = 4096,
+	/// `di_collect_garbage_step` skips collection if there are fewer candidates than
+	/// this...
+	DI_GC_MIN_CANDIDATES = 32,
+	/// ... unless it has already skipped this many times.
+	DI_GC_MAX_SKIPPED_STEPS = 16,
+	/// Long lived candidates are collected once every this many steps.
+	DI_GC_OLD_INTERVAL = 64,
+};
+
+/// Always on statistics of the garbage collector, see `di_new_gc_stats`
+static thread_local struct {
+	uint64_t objects_allocated;
+	uint64_t objects_freed;
+	uint64_t collections;
+	uint64_t objects_scanned;
+	uint64_t objects_reclaimed;
+	/// Time spent in the garbage collector, in nanoseconds
+	uint64_t time_ns;
+} gc_stats;
+
+/// Whether the current collection is only for young objects. If true, scanning stops at
+/// long lived objects, which are treated as if they are externally referenced.
+static thread_local bool gc_young_only = false;
+/// Number of objects scanned in the current collection
+static thread_local uint64_t gc_work = 0;
+/// Marking stops once `gc_work` reaches this, see `DI_GC_STEP_BUDGET`
+static thread_local uint64_t gc_mark_limit = UINT64_MAX;
+/// Whether marking stopped before all objects reachable from the candidate were visited
+static thread_local bool gc_mark_truncated = false;
+static thread_local unsigned int gc_steps = 0, gc_skipped_steps = 0;
+
+static struct list_head *di_gc_candidates(bool old) {
+	auto head = old ? &old_unreferred_objects : &unreferred_objects;
+	if (head->next == NULL) {
+		INIT_LIST_HEAD(head);
+	}
+	return head;
+}
+
 void di_init_object(di_object *obj_) {
 	di_object_internal *obj = (di_object_internal *)obj_;
 	obj->ref_count = 1;
-
-	// non-zero strong references will implicitly hold a weak refrence. that reference
-	// is only dropped when the object destruction finishes. this is to avoid the
-	// case where the last weak reference to the object is dropped during object
-	// destruction, thus cause the object to be freed in the middle of destruction.
-	obj->weak_ref_count = 1;
+	obj->weak_ref = NULL;
 	obj->destroyed = 0;
+	obj->pin_index = 0;
 
 #ifdef TRACK_OBJECTS
 	list_add(&obj->siblings, &all_objects);
@@ -511,9 +1153,16 @@ di_object *di_new_object(size_t sz, size_t alignment) {
 	}
 
 	di_object_internal *obj;
-	DI_CHECK_OK(posix_memalign((void **)&obj, alignment, sz));
+	unsigned int slab_class = alignment <= DI_SLAB_ALIGN ? di_slab_class(sz) : 0;
+	if (slab_class != 0) {
+		obj = di_slab_alloc(slab_class);
+	} else {
+		DI_CHECK_OK(posix_memalign((void **)&obj, alignment, sz));
+	}
 	memset(obj, 0, sz);
+	obj->slab_class = (uint8_t)slab_class;
 	di_init_object((di_object *)obj);
+	gc_stats.objects_allocated++;
 	return (di_object *)obj;
 }
 
@@ -535,37 +1184,51 @@ struct di_module *di_new_module(di_object *di) {
 	return di_new_module_with_size(di, sizeof(struct di_module));
 }
 
-static di_variant di_remove_member_raw_impl(di_object_internal *obj, struct di_member *m) {
-	HASH_DEL(*(struct di_member **)&obj->members, m);
-
-	auto ret = (di_variant){.type = m->type, .value = m->data};
-	di_free_string(m->name);
-	free(m);
-	return ret;
+/// Remove member `m` from `obj`, without freeing it. Its value is moved to `*type` and
+/// `*value`.
+static void di_remove_member_raw_impl(di_object_internal *obj, struct di_member *m,
+                                      di_type *type, di_value *value) {
+	bool is_type_member = di_is_type_member(m->name);
+	if (di_signal_filter_bits(m->name, m->hash) != 0 && --obj->nsignal_members == 0) {
+		obj->signal_filter = 0;
+	}
+	di_member_table_take(obj->members, m, type, value);
+	if (is_type_member) {
+		di_update_type_table(obj);
+	}
 }
 
 int di_remove_member_raw(di_object *obj, di_string name, di_variant *ret) {
-	auto m = di_lookup(obj, name);
+	auto key = di_key(name);
+	auto m = di_lookup_own((di_object_internal *)obj, &key);
 	if (!m) {
 		return -ENOENT;
 	}
-	*ret = di_remove_member_raw_impl((void *)obj, m);
+	di_value value;
+	di_remove_member_raw_impl((void *)obj, m, &ret->type, &value);
+	ret->value = malloc(di_sizeof_type(ret->type));
+	memcpy(ret->value, &value, di_sizeof_type(ret->type));
 	return 0;
 }
 
 int di_delete_member_raw(di_object *obj, di_string name) {
-	auto m = di_lookup(obj, name);
+	auto key = di_key(name);
+	auto m = di_lookup_own((di_object_internal *)obj, &key);
 	if (!m) {
 		return -ENOENT;
 	}
 
-	di_free_variant(di_remove_member_raw_impl((di_object_internal *)obj, (void *)m));
+	di_type type;
+	di_value value;
+	di_remove_member_raw_impl((di_object_internal *)obj, m, &type, &value);
+	di_free_value(type, &value);
 	return 0;
 }
 
 int di_delete_member(di_object *obj, di_string name, di_object *nullable *nullable error) {
 	bool handler_found;
-	int rc2 = call_handler_with_fallback(obj, "__delete", name,
+	auto key = di_key(name);
+	int rc2 = call_handler_with_fallback(obj, DI_ATOM_DELETER, &key,
 	                                     (struct di_variant){NULL, DI_LAST_TYPE}, NULL,
 	                                     NULL, error, &handler_found);
 	if (handler_found) {
@@ -589,31 +1252,72 @@ static void di_finalize_object_inner(di_object_internal *obj) {
 		tmp((di_object *)obj);
 	}
 
-	struct di_member *m = (void *)obj->members;
-	while (m) {
-		auto next_m = m->hh.next;
+	// Values are freed one by one, and freeing them might add or remove members, so
+	// the table must be refetched every time.
+	while (obj->members != NULL && obj->members->count > 0) {
+		struct di_member *m;
+		for (uint32_t i = 0; (m = di_member_table_next(obj->members, &i)) != NULL; i++) {
 #if 0
-		scopedp(char) *dbg = di_value_to_string(m->type, m->data);
-		fprintf(stderr, "removing member %.*s (%s)\n", (int)m->name.length,
-		        m->name.data, dbg);
+			scopedp(char) *dbg = di_value_to_string(m->type, &m->value);
+			fprintf(stderr, "removing member %.*s (%s)\n", (int)m->name.length,
+			        m->name.data, dbg);
 #endif
-		di_free_variant(di_remove_member_raw_impl(obj, m));
-		m = next_m;
+			di_type type;
+			di_value value;
+			di_remove_member_raw_impl(obj, m, &type, &value);
+			di_free_value(type, &value);
+		}
 	}
+	di_member_table_dealloc(obj->members);
+	obj->members = NULL;
 }
 
 void di_finalize_object(di_object *_obj) {
 	di_finalize_object_inner((di_object_internal *)_obj);
 }
 
-static inline void di_decrement_weak_ref_count(di_object_internal *obj) {
-	obj->weak_ref_count--;
-	if (obj->weak_ref_count == 0) {
-		assert(obj->ref_count == 0);
+static inline void di_decrement_weak_ref_count(struct di_weak_object *weak) {
+	if (weak == dead_weak_ref) {
+		return;
+	}
+	assert(weak->ref_count > 0);
+	weak->ref_count--;
+	if (weak->ref_count == 0) {
+		assert(weak->object == NULL);
+		di_slab_free(weak, di_slab_class(sizeof(*weak)));
+	}
+}
+
+/// Get the weak reference control block of `obj`, creating it if needed. No reference is
+/// taken.
+static struct di_weak_object *di_weak_ref_block(di_object_internal *obj) {
+	if (obj->weak_ref == NULL) {
+		struct di_weak_object *weak = di_slab_alloc(di_slab_class(sizeof(*weak)));
+		weak->object = obj;
+		// Reference held by the object itself
+		weak->ref_count = 1;
+		obj->weak_ref = weak;
+	}
+	return obj->weak_ref;
+}
+
+/// Free the memory of a destroyed object. Weak references don't keep the memory alive,
+/// they only keep the control block alive.
+static void di_free_object_memory(di_object_internal *obj) {
+	assert(obj->ref_count == 0);
+	if (obj->weak_ref != NULL) {
+		obj->weak_ref->object = NULL;
+		di_decrement_weak_ref_count(obj->weak_ref);
+		obj->weak_ref = NULL;
+	}
 #ifdef TRACK_OBJECTS
-		list_del(&obj->siblings);
-		fprintf(stderr, "freeing object %p\n", obj);
+	list_del(&obj->siblings);
+	fprintf(stderr, "freeing object %p\n", obj);
 #endif
+	gc_stats.objects_freed++;
+	if (obj->slab_class != 0) {
+		di_slab_free(obj, obj->slab_class);
+	} else {
 		free(obj);
 	}
 }
@@ -628,7 +1332,7 @@ static void di_destroy_object(di_object *_obj) {
 	}
 	obj->destroyed = 1;
 	di_finalize_object_inner(obj);
-	di_decrement_weak_ref_count(obj);
+	di_free_object_memory(obj);
 }
 
 #if 0
@@ -669,14 +1373,32 @@ di_object *di_ref_object(di_object *_obj) {
 }
 
 struct di_weak_object *di_weakly_ref_object(di_object *_obj) {
-	auto obj = (di_object_internal *)_obj;
-	obj->weak_ref_count++;
-	return (struct di_weak_object *)obj;
+	if (_obj == NULL) {
+		return dead_weak_ref;
+	}
+	auto weak = di_weak_ref_block((di_object_internal *)_obj);
+	weak->ref_count++;
+	return weak;
+}
+
+struct di_weak_object *di_borrow_weak_ref(di_object *obj) {
+	return di_weak_ref_block((di_object_internal *)obj);
+}
+
+/// Take another reference to the same object as `weak`
+static struct di_weak_object *di_clone_weak_ref(struct di_weak_object *weak) {
+	if (weak != dead_weak_ref) {
+		weak->ref_count++;
+	}
+	return weak;
 }
 
 di_object *nullable di_upgrade_weak_ref(struct di_weak_object *weak) {
 	assert(weak != PTR_POISON);
-	auto obj = (di_object_internal *)weak;
+	auto obj = weak->object;
+	if (obj == NULL) {
+		return NULL;
+	}
 	// Garbage collector cannot call user code when mark == 1
 	assert(obj->mark == 0 || obj->mark == 2 || obj->mark == 3);
 	// If mark == 2 or 3, the object is scheduled for destruction. If we allow
@@ -691,8 +1413,7 @@ di_object *nullable di_upgrade_weak_ref(struct di_weak_object *weak) {
 
 void di_drop_weak_ref(struct di_weak_object **weak) {
 	assert(*weak != PTR_POISON);
-	auto obj = (di_object_internal *)*weak;
-	di_decrement_weak_ref_count(obj);
+	di_decrement_weak_ref_count(*weak);
 	*weak = PTR_POISON;
 }
 
@@ -714,10 +1435,7 @@ void di_unref_object(di_object *_obj) {
 		list_del_init(&obj->unreferred_siblings);
 		di_destroy_object(_obj);
 	} else if (list_empty(&obj->unreferred_siblings) && obj->mark == 0) {
-		if (unreferred_objects.next == NULL) {
-			INIT_LIST_HEAD(&unreferred_objects);
-		}
-		list_add(&obj->unreferred_siblings, &unreferred_objects);
+		list_add(&obj->unreferred_siblings, di_gc_candidates(obj->gc_age >= DI_GC_OLD_AGE));
 	}
 	// if obj->mark == 3 or 2, then the object is scheduled for destruction, we don't need
 	// to add it to `unreferred_objects` list. It is unnecessary and will cause use-after-free.
@@ -730,50 +1448,51 @@ size_t di_min_return_size(size_t in) {
 	return in;
 }
 
-static int check_new_member(di_object_internal *obj, struct di_member *m) {
+static int check_new_member(di_object_internal *obj, const struct di_atom *key) {
 	struct di_member *om = NULL;
 
-	if (!m->name.data) {
+	if (!key->name.data) {
 		return -EINVAL;
 	}
 
-	HASH_FIND(hh, obj->members, m->name.data, m->name.length, om);
+	om = di_lookup_own(obj, key);
 	if (om) {
 		return -EEXIST;
 	}
 	return 0;
 }
 
-static int di_insert_member(di_object_internal *obj, struct di_member *m) {
-	int ret = check_new_member(obj, (void *)m);
-	if (ret != 0) {
-		return ret;
-	}
-
-	HASH_ADD_KEYPTR(hh, obj->members, m->name.data, m->name.length, m);
-	return 0;
-}
-
+/// Add a new member named `name` to `obj`, and move `*value` into it. The value is always
+/// consumed, even on failure.
+///
+/// Returns the new member, which is only valid until `obj`'s members are modified next.
 static struct di_member *
-di_add_member(di_object_internal *o, di_string name, di_type t, void *v) {
+di_add_member(di_object_internal *obj, di_string name, di_type t, di_value *value) {
 	if (!name.data) {
+		di_free_value(t, value);
 		return ERR_PTR(-EINVAL);
 	}
 
-	auto m = tmalloc(struct di_member, 1);
-	m->type = t;
-	m->data = v;
-	m->name = di_clone_string(name);
-
-	int ret = di_insert_member(o, m);
+	auto key = di_key(name);
+	int ret = check_new_member(obj, &key);
 	if (ret != 0) {
-		di_free_value(t, v);
-		free(v);
-
-		di_free_string(m->name);
-		free(m);
+		di_free_value(t, value);
 		return ERR_PTR(ret);
 	}
+
+	// Intern first, so the new member can share the interned name.
+	di_intern_if_derived(name);
+	auto m = di_member_table_add(&obj->members, &key);
+	m->type = t;
+	memcpy(&m->value, value, di_sizeof_type(t));
+	auto signal_bits = di_signal_filter_bits(m->name, m->hash);
+	if (signal_bits != 0) {
+		obj->signal_filter |= signal_bits;
+		obj->nsignal_members++;
+	}
+	if (di_is_type_member(m->name)) {
+		di_update_type_table(obj);
+	}
 	return m;
 }
 
@@ -783,10 +1502,9 @@ di_add_member_clone2(di_object *o, di_string name, di_type t, const void *value)
 		return ERR_PTR(-EINVAL);
 	}
 
-	void *copy = calloc(1, di_sizeof_type(t));
-	di_copy_value(t, copy, value);
-
-	return di_add_member((di_object_internal *)o, name, t, copy);
+	di_value copy;
+	di_copy_value(t, &copy, value);
+	return di_add_member((di_object_internal *)o, name, t, &copy);
 }
 
 int di_add_member_clone(di_object *o, di_string name, di_type t, const void *value) {
@@ -819,13 +1537,13 @@ struct di_member *di_add_member_move2(di_object *o, di_string name, di_type *t,
 	}
 
 	di_type tt = *t;
-	void *taddr = malloc(sz);
-	memcpy(taddr, addr, sz);
+	di_value value;
+	memcpy(&value, addr, sz);
 
 	*t = DI_TYPE_NIL;
 	memset(addr, 0, sz);
 
-	return di_add_member((di_object_internal *)o, name, tt, taddr);
+	return di_add_member((di_object_internal *)o, name, tt, &value);
 }
 
 int di_add_member_move(di_object *o, di_string name, di_type *t, void *addr) {
@@ -841,10 +1559,35 @@ struct di_member *di_lookup(di_object *_obj, di_string name) {
 		return NULL;
 	}
 
-	auto obj = (di_object_internal *)_obj;
-	struct di_member *ret = NULL;
-	HASH_FIND(hh, obj->members, name.data, name.length, ret);
-	return (void *)ret;
+	auto key = di_key(name);
+	return di_lookup_key((di_object_internal *)_obj, &key);
+}
+
+struct di_member *di_lookup_atom(di_object *obj, const struct di_atom *atom) {
+	return di_lookup_key((di_object_internal *)obj, atom);
+}
+
+int di_add_type_member_move(const char *type, di_string name, di_type *t, void *addr) {
+	auto sz = di_sizeof_type(*t);
+	if (sz == 0 || name.data == NULL) {
+		return -EINVAL;
+	}
+
+	auto table = di_get_type_table(di_string_borrow(type));
+	auto key = di_key(name);
+	if (di_member_table_find(table->members, &key) != NULL) {
+		return -EEXIST;
+	}
+
+	di_intern_if_derived(name);
+	auto m = di_member_table_add(&table->members, &key);
+	table->signal_filter |= di_signal_filter_bits(m->name, m->hash);
+	m->type = *t;
+	memcpy(&m->value, addr, sz);
+
+	*t = DI_TYPE_NIL;
+	memset(addr, 0, sz);
+	return 0;
 }
 
 di_tuple di_object_next_member(di_object *obj, di_string name) {
@@ -875,19 +1618,20 @@ di_tuple di_object_next_member(di_object *obj, di_string name) {
 		return inner.tuple;
 	}
 	di_tuple ret = DI_TUPLE_INIT;
-	struct di_member *m = NULL, *next_m = NULL;
-	if (name.data == NULL) {
-		HASH_ITER (hh, ((di_object_internal *)obj)->members, m, next_m) {
-			if (di_string_starts_with(m->name, "__")) {
-				continue;
-			}
-			break;
+	auto members = ((di_object_internal *)obj)->members;
+	uint32_t i = 0;
+	if (name.data != NULL) {
+		auto key = di_key(name);
+		auto prev = di_member_table_find(members, &key);
+		if (prev == NULL) {
+			return ret;
 		}
-	} else {
-		m = di_lookup(obj, name);
-		m = m == NULL ? NULL : m->hh.next;
-		while (m != NULL && di_string_starts_with(m->name, "__")) {
-			m = m->hh.next;
+		i = (uint32_t)(prev - members->entries) + 1;
+	}
+	struct di_member *m;
+	for (; (m = di_member_table_next(members, &i)) != NULL; i++) {
+		if (!di_string_starts_with(m->name, "__")) {
+			break;
 		}
 	}
 	if (m == NULL) {
@@ -898,7 +1642,7 @@ di_tuple di_object_next_member(di_object *obj, di_string name) {
 	ret.elements[0] = di_alloc_variant(di_clone_string(m->name));
 	ret.elements[1].type = m->type;
 	ret.elements[1].value = malloc(di_sizeof_type(m->type));
-	di_copy_value(m->type, ret.elements[1].value, m->data);
+	di_copy_value(m->type, ret.elements[1].value, &m->value);
 	return ret;
 }
 
@@ -908,13 +1652,13 @@ di_array di_get_all_member_names_raw(di_object *obj_) {
 	di_array ret = {
 	    .arr = NULL,
 	    .elem_type = DI_TYPE_STRING,
-	    .length = HASH_COUNT(obj->members),
+	    .length = obj->members ? obj->members->count : 0,
 	};
 	di_string *arr = ret.arr = tmalloc(di_string, ret.length);
 	int cnt = 0;
-	struct di_member *i, *ni;
-	HASH_ITER (hh, obj->members, i, ni) {
-		di_copy_value(DI_TYPE_STRING, &arr[cnt], &i->name);
+	struct di_member *m;
+	for (uint32_t i = 0; (m = di_member_table_next(obj->members, &i)) != NULL; i++) {
+		di_copy_value(DI_TYPE_STRING, &arr[cnt], &m->name);
 		cnt += 1;
 	}
 	assert(cnt == ret.length);
@@ -923,9 +1667,10 @@ di_array di_get_all_member_names_raw(di_object *obj_) {
 
 bool di_foreach_member_raw(di_object *obj_, di_member_cb cb, void *user_data) {
 	auto obj = (di_object_internal *)obj_;
-	struct di_member *i, *ni;
-	HASH_ITER (hh, obj->members, i, ni) {
-		if (cb(i->name, i->type, i->data, user_data)) {
+	struct di_member *m;
+	// `cb` might modify `obj`, so the table has to be refetched every time.
+	for (uint32_t i = 0; (m = di_member_table_next(obj->members, &i)) != NULL; i++) {
+		if (cb(m->name, m->type, &m->value, user_data)) {
 			return true;
 		}
 	}
@@ -940,33 +1685,174 @@ void di_set_object_dtor(di_object *nonnull obj, di_dtor_fn nullable dtor) {
 	internal->dtor = dtor;
 }
 
-void di_set_object_call(di_object *nonnull obj, di_call_fn nullable call) {
-	auto internal = (di_object_internal *)obj;
-	internal->call = call;
+void di_set_object_call(di_object *nonnull obj, di_call_fn nullable call) {
+	auto internal = (di_object_internal *)obj;
+	internal->call = call;
+}
+
+bool di_is_object_callable(di_object *nonnull obj) {
+	auto internal = (di_object_internal *)obj;
+	return internal->call != NULL;
+}
+
+void di_free_tuple(di_tuple t) {
+	for (int i = 0; i < t.length; i++) {
+		di_free_value(DI_TYPE_VARIANT, (di_value *)&t.elements[i]);
+	}
+	free(t.elements);
+}
+
+void di_free_array(di_array arr) {
+	if (arr.length == 0) {
+		DI_CHECK(arr.arr == NULL);
+		return;
+	}
+	size_t step = di_sizeof_type(arr.elem_type);
+	for (int i = 0; i < arr.length; i++) {
+		di_free_value(arr.elem_type, arr.arr + step * i);
+	}
+	free(arr.arr);
+}
+
+static void *di_copy_array_elements(di_array arr) {
+	size_t step = di_sizeof_type(arr.elem_type);
+	assert(step != 0);
+	void *ret = calloc(arr.length, step);
+	for (int i = 0; i < arr.length; i++) {
+		di_copy_value(arr.elem_type, ret + step * i, arr.arr + step * i);
+	}
+	return ret;
+}
+
+static struct di_variant *di_copy_tuple_elements(di_tuple t) {
+	auto ret = tmalloc(struct di_variant, t.length);
+	for (int i = 0; i < t.length; i++) {
+		di_copy_value(DI_TYPE_VARIANT, &ret[i], &t.elements[i]);
+	}
+	return ret;
+}
+
+/// Header in front of the storage of shared strings, arrays and tuples, see
+/// `di_shared_array`
+struct di_shared_header {
+	alignas(max_align_t) atomic_uint_fast64_t ref_count;
+};
+
+static inline struct di_shared_header *di_shared_header_of(const void *data) {
+	return (struct di_shared_header *)data - 1;
+}
+
+/// Allocate `size` bytes of shared storage, with a reference count of 1
+static void *di_shared_alloc(size_t size) {
+	struct di_shared_header *header = malloc(sizeof(struct di_shared_header) + size);
+	atomic_init(&header->ref_count, 1);
+	return header + 1;
+}
+
+di_shared_string di_share_string(di_string str) {
+	char *data = di_shared_alloc(str.length + 1);
+	if (str.length != 0) {
+		memcpy(data, str.data, str.length);
+	}
+	data[str.length] = '\0';
+	return (di_shared_string){{data, str.length}};
+}
+
+di_shared_string di_shared_string_ref(di_shared_string str) {
+	if (str.string.data != NULL) {
+		atomic_fetch_add_explicit(&di_shared_header_of(str.string.data)->ref_count, 1,
+		                          memory_order_relaxed);
+	}
+	return str;
+}
+
+void di_shared_string_unref(di_shared_string str) {
+	if (str.string.data == NULL) {
+		return;
+	}
+	auto header = di_shared_header_of(str.string.data);
+	if (atomic_fetch_sub_explicit(&header->ref_count, 1, memory_order_acq_rel) == 1) {
+		free(header);
+	}
+}
+
+di_shared_array di_share_array(di_array arr) {
+	if (arr.length == 0) {
+		return (di_shared_array){arr};
+	}
+	size_t size = di_sizeof_type(arr.elem_type) * arr.length;
+	void *data = di_shared_alloc(size);
+	// Move the elements, they don't have to be copied.
+	memcpy(data, arr.arr, size);
+	free(arr.arr);
+	return (di_shared_array){{arr.length, data, arr.elem_type}};
+}
+
+di_shared_array di_shared_array_ref(di_shared_array arr) {
+	if (arr.array.length != 0) {
+		atomic_fetch_add_explicit(&di_shared_header_of(arr.array.arr)->ref_count, 1,
+		                          memory_order_relaxed);
+	}
+	return arr;
+}
+
+void di_shared_array_unref(di_shared_array arr) {
+	if (arr.array.length == 0) {
+		return;
+	}
+	auto header = di_shared_header_of(arr.array.arr);
+	if (atomic_fetch_sub_explicit(&header->ref_count, 1, memory_order_acq_rel) != 1) {
+		return;
+	}
+	size_t step = di_sizeof_type(arr.array.elem_type);
+	for (int i = 0; i < arr.array.length; i++) {
+		di_free_value(arr.array.elem_type, arr.array.arr + step * i);
+	}
+	free(header);
+}
+
+di_array di_shared_array_take(di_shared_array arr) {
+	if (arr.array.length == 0) {
+		return arr.array;
+	}
+	auto header = di_shared_header_of(arr.array.arr);
+	di_array ret = {arr.array.length, NULL, arr.array.elem_type};
+	if (atomic_load_explicit(&header->ref_count, memory_order_acquire) == 1) {
+		// No one else can take a new reference, so the elements can be moved.
+		size_t size = di_sizeof_type(arr.array.elem_type) * arr.array.length;
+		ret.arr = malloc(size);
+		memcpy(ret.arr, arr.array.arr, size);
+		free(header);
+	} else {
+		// Copy before dropping the reference, so the elements stay valid.
+		ret.arr = di_copy_array_elements(arr.array);
+		di_shared_array_unref(arr);
+	}
+	return ret;
+}
+
+/// Tuples are shared as arrays of variants
+static inline di_array di_tuple_as_array(di_tuple t) {
+	return (di_array){t.length, t.elements, DI_TYPE_VARIANT};
 }
 
-bool di_is_object_callable(di_object *nonnull obj) {
-	auto internal = (di_object_internal *)obj;
-	return internal->call != NULL;
+di_shared_tuple di_share_tuple(di_tuple t) {
+	auto arr = di_share_array(di_tuple_as_array(t));
+	return (di_shared_tuple){{arr.array.length, arr.array.arr}};
 }
 
-void di_free_tuple(di_tuple t) {
-	for (int i = 0; i < t.length; i++) {
-		di_free_value(DI_TYPE_VARIANT, (di_value *)&t.elements[i]);
-	}
-	free(t.elements);
+di_shared_tuple di_shared_tuple_ref(di_shared_tuple t) {
+	di_shared_array_ref((di_shared_array){di_tuple_as_array(t.tuple)});
+	return t;
 }
 
-void di_free_array(di_array arr) {
-	if (arr.length == 0) {
-		DI_CHECK(arr.arr == NULL);
-		return;
-	}
-	size_t step = di_sizeof_type(arr.elem_type);
-	for (int i = 0; i < arr.length; i++) {
-		di_free_value(arr.elem_type, arr.arr + step * i);
-	}
-	free(arr.arr);
+void di_shared_tuple_unref(di_shared_tuple t) {
+	di_shared_array_unref((di_shared_array){di_tuple_as_array(t.tuple)});
+}
+
+di_tuple di_shared_tuple_take(di_shared_tuple t) {
+	auto arr = di_shared_array_take((di_shared_array){di_tuple_as_array(t.tuple)});
+	return (di_tuple){arr.length, arr.arr};
 }
 
 void di_free_value(di_type t, di_value *value_ptr) {
@@ -1024,7 +1910,6 @@ void di_copy_value(di_type t, void *dst, const void *src) {
 	const di_tuple *tuple;
 	di_value *dstval = dst;
 	const di_value *srcval = src;
-	void *d;
 
 	// dst and src only allowed to be null when t is unit
 	assert(t == DI_TYPE_NIL || (dst && src));
@@ -1033,24 +1918,14 @@ void di_copy_value(di_type t, void *dst, const void *src) {
 		arr = &srcval->array;
 		if (arr->length == 0) {
 			dstval->array = *arr;
-		} else {
-			assert(di_sizeof_type(arr->elem_type) != 0);
-			d = calloc(arr->length, di_sizeof_type(arr->elem_type));
-			for (int i = 0; i < arr->length; i++) {
-				di_copy_value(arr->elem_type, d + di_sizeof_type(arr->elem_type) * i,
-				              arr->arr + di_sizeof_type(arr->elem_type) * i);
-			}
-			dstval->array = (di_array){arr->length, d, arr->elem_type};
+			break;
 		}
+		dstval->array = (di_array){arr->length, di_copy_array_elements(*arr), arr->elem_type};
 		break;
 	case DI_TYPE_TUPLE:
 		tuple = &srcval->tuple;
-		dstval->tuple.elements = tmalloc(struct di_variant, tuple->length);
+		dstval->tuple.elements = di_copy_tuple_elements(*tuple);
 		dstval->tuple.length = tuple->length;
-
-		for (int i = 0; i < tuple->length; i++) {
-			di_copy_value(DI_TYPE_VARIANT, &dstval->tuple.elements[i], &tuple->elements[i]);
-		}
 		break;
 	case DI_TYPE_VARIANT:
 		dstval->variant = (struct di_variant){
@@ -1068,7 +1943,7 @@ void di_copy_value(di_type t, void *dst, const void *src) {
 		dstval->object = srcval->object;
 		break;
 	case DI_TYPE_WEAK_OBJECT:
-		dstval->weak_object = di_weakly_ref_object(srcval->object);
+		dstval->weak_object = di_clone_weak_ref(srcval->weak_object);
 		break;
 	case DI_TYPE_NIL:
 		// nothing to do
@@ -1133,78 +2008,178 @@ static void di_listen_handle_auto_stop(di_object *obj, int stop_) {
 	di_setx(obj, di_string_borrow_literal("stop_on_drop"), DI_TYPE_BOOL, &stop, NULL);
 }
 
+/// The array of handlers of `sig`. The pointer is only valid until members of `sig` are
+/// changed, or any handler is called.
+static di_array *nullable di_signal_handlers(struct di_signal *sig) {
+	auto m = di_lookup((di_object *)sig, di_string_borrow_literal("handlers"));
+	if (m == NULL || m->type != DI_TYPE_ARRAY) {
+		return NULL;
+	}
+	return &m->value.array;
+}
+
+/// Take the tombstones out of the handler array
+static void di_signal_compact(struct di_signal *sig) {
+	auto handlers = di_signal_handlers(sig);
+	di_object **arr = handlers->arr;
+	int length = 0;
+	for (int i = 0; i < handlers->length; i++) {
+		if (arr[i] != sig->tombstone) {
+			arr[length++] = arr[i];
+		}
+	}
+	handlers->length = length;
+	if (length == 0) {
+		free(handlers->arr);
+		handlers->arr = NULL;
+	}
+	// Tombstones are plain objects, dropping them can't run any code
+	for (; sig->ntombstones > 0; sig->ntombstones--) {
+		di_unref_object(sig->tombstone);
+	}
+}
+
 static void di_signal_remove_handler(di_object *sig_, struct di_weak_object *handler) {
 	struct di_signal *sig = (void *)sig_;
-	scoped_di_string handler_member_name = di_string_printf(HANDLER_PREFIX "%p", handler);
-
-	if (di_delete_member_raw(sig_, handler_member_name) != -ENOENT) {
-		sig->nhandlers -= 1;
-		if (sig->nhandlers == 0) {
-			// No handler remains, remove ourself from parent.
-			scoped_di_weak_object *weak_source;
-			scoped_di_string signal_member_name;
-			DI_CHECK_OK(di_get(sig_, "weak_source", weak_source));
-			DI_CHECK_OK(di_get(sig_, "signal_name", signal_member_name));
-			scoped_di_object *source = di_upgrade_weak_ref(weak_source);
-			if (source != NULL) {
-				di_delete_member(source, signal_member_name, NULL);
-			}
+	auto handlers = di_signal_handlers(sig);
+	if (handlers == NULL || handler->object == NULL) {
+		return;
+	}
+
+	di_object **arr = handlers->arr;
+	int i;
+	for (i = 0; i < handlers->length; i++) {
+		if (arr[i] == (di_object *)handler->object) {
+			break;
+		}
+	}
+	if (i == handlers->length) {
+		return;
+	}
+
+	di_object *removed = arr[i];
+	if (sig->dispatching > 0) {
+		if (sig->tombstone == NULL) {
+			sig->tombstone = di_new_object_with_type(di_object);
+		}
+		arr[i] = di_ref_object(sig->tombstone);
+		sig->ntombstones++;
+	} else {
+		memmove(&arr[i], &arr[i + 1], sizeof(*arr) * (handlers->length - i - 1));
+		handlers->length--;
+		if (handlers->length == 0) {
+			free(handlers->arr);
+			handlers->arr = NULL;
+		}
+	}
+	sig->nhandlers -= 1;
+	// The handler array is consistent now, safe to run arbitrary code.
+	di_unref_object(removed);
+
+	if (sig->nhandlers == 0) {
+		// No handler remains, remove ourself from parent.
+		scoped_di_weak_object *weak_source;
+		scoped_di_string signal_member_name;
+		DI_CHECK_OK(di_get(sig_, "weak_source", weak_source));
+		DI_CHECK_OK(di_get(sig_, "signal_name", signal_member_name));
+		scoped_di_object *source = di_upgrade_weak_ref(weak_source);
+		if (source != NULL) {
+			di_delete_member(source, signal_member_name, NULL);
 		}
 	}
 }
 
-static void di_signal_dispatch(di_object *sig_, di_tuple args) {
-	auto sig = (struct di_signal *)sig_;
-	auto inner = (di_object_internal *)sig_;
-	struct di_member *i, *tmpi;
+static bool
+di_signal_handler_accepts(di_object *handler, di_tuple args, di_object **target);
 
-	int cnt = 0;
-	di_object **handlers = tmalloc(di_object *, sig->nhandlers);
-	HASH_ITER (hh, inner->members, i, tmpi) {
-		if (!di_string_starts_with(i->name, HANDLER_PREFIX)) {
-			continue;
-		}
+/// Call a signal handler, errors are logged instead of propagated to the emitter.
+static void di_call_signal_handler(di_object *handler, di_tuple args) {
+	di_type rtype;
+	di_value ret;
+	scoped_di_object *err_obj = NULL;
+	int rc = di_call_object_catch(handler, &rtype, &ret, args, &err_obj);
+	if (rc != 0) {
+		di_log_va(log_module, DI_LOG_ERROR, "Failed to call a signal handler: %s\n",
+		          strerror(-rc));
+		return;
+	}
 
-		// Any of the handlers can be removed during emission, so first we copy
-		// the list of handlers we need
-		di_copy_value(DI_TYPE_OBJECT, &handlers[cnt++], i->data);
+	di_free_value(rtype, &ret);
+	if (err_obj != NULL) {
+		scoped_di_string error_message = di_object_to_string(err_obj, NULL);
+		di_log_va(log_module, DI_LOG_ERROR, "Error arose when calling signal handler: %.*s\n",
+		          (int)error_message.length, error_message.data);
 	}
+}
 
-	assert(cnt == sig->nhandlers);
-	for (int i = 0; i < cnt; i++) {
-		di_type rtype;
-		di_value ret;
-		scoped_di_object *err_obj = NULL;
-		int rc = di_call_object_catch(handlers[i], &rtype, &ret, args, &err_obj);
-		di_unref_object(handlers[i]);
+static void di_signal_dispatch(di_object *sig_, di_tuple args) {
+	auto sig = (struct di_signal *)sig_;
+	auto handlers = di_signal_handlers(sig);
+	if (handlers == NULL) {
+		return;
+	}
 
-		if (rc != 0) {
-			di_log_va(log_module, DI_LOG_ERROR, "Failed to call a signal handler: %s\n",
-			          strerror(-rc));
+	// Handlers added during emission are not called. Handlers removed during emission
+	// become tombstones, so indices stay valid until the outermost dispatch returns.
+	int count = handlers->length;
+	sig->dispatching++;
+	for (int i = 0; i < count; i++) {
+		// Handlers can change the handler array, so it has to be fetched again.
+		handlers = di_signal_handlers(sig);
+		if (handlers == NULL) {
+			break;
+		}
+		di_object *handler = ((di_object **)handlers->arr)[i];
+		if (handler == sig->tombstone) {
 			continue;
 		}
 
-		di_free_value(rtype, &ret);
-		if (err_obj != NULL) {
-			scoped_di_string error_message = di_object_to_string(err_obj, NULL);
-			di_log_va(log_module, DI_LOG_ERROR, "Error arose when calling signal handler: %.*s\n",
-			          (int)error_message.length, error_message.data);
+		// Check the filters here, so the wrapper doesn't have to be called.
+		if (!di_signal_handler_accepts(handler, args, &handler)) {
+			continue;
 		}
+
+		// The handler might remove itself
+		di_ref_object(handler);
+		di_call_signal_handler(handler, args);
+		di_unref_object(handler);
+	}
+	sig->dispatching--;
+	if (sig->dispatching == 0 && sig->ntombstones > 0 && di_signal_handlers(sig) != NULL) {
+		di_signal_compact(sig);
 	}
-	free(handlers);
 }
 
-static void di_signal_add_handler(di_object *sig, di_object *handler) {
-	scoped_di_string new_signal_listener_name = di_string_printf(HANDLER_PREFIX "%p", handler);
-	di_add_member_clone(sig, new_signal_listener_name, DI_TYPE_OBJECT, &handler);
-
-	((struct di_signal *)sig)->nhandlers += 1;
+static void di_signal_add_handler(di_object *sig_, di_object *handler) {
+	auto sig = (struct di_signal *)sig_;
+	auto handlers = di_signal_handlers(sig);
+	if (handlers == NULL) {
+		DI_CHECK_OK(di_add_member_move(sig_, di_string_borrow_literal("handlers"),
+		                               (di_type[]){DI_TYPE_ARRAY},
+		                               (di_array[]){{
+		                                   .arr = NULL,
+		                                   .length = 0,
+		                                   .elem_type = DI_TYPE_OBJECT,
+		                               }}));
+		handlers = di_signal_handlers(sig);
+	}
+	di_object **arr = handlers->arr;
+	handlers->arr = arr = trealloc(arr, handlers->length + 1);
+	arr[handlers->length++] = di_ref_object(handler);
+	sig->nhandlers += 1;
+}
+
+static void di_signal_dtor(di_object *sig_) {
+	auto sig = (struct di_signal *)sig_;
+	if (sig->tombstone != NULL) {
+		di_unref_object(sig->tombstone);
+		sig->tombstone = NULL;
+	}
 }
 
 di_object *di_listen_to(di_object *_obj, di_string name, di_object *h,
                         di_object *nullable *nullable error) {
-	scoped_di_string signal_member_name =
-	    di_string_printf("__signal_%.*s", (int)name.length, name.data);
+	auto signal_member = di_atom_derive(di_intern(name), DI_ATOM_SIGNAL);
 
 	auto obj = (di_object_internal *)_obj;
 	assert(!obj->destroyed);
@@ -1213,21 +2188,21 @@ di_object *di_listen_to(di_object *_obj, di_string name, di_object *h,
 	di_type sig_type = DI_TYPE_NIL;
 	di_value sigv;
 	struct di_signal *sig = NULL;
-	int rc = di_getx(_obj, signal_member_name, &sig_type, &sigv,
-	                 error != NULL ? &new_error : NULL);
+	int rc = di_getx_atom(_obj, signal_member, &sig_type, &sigv,
+	                      error != NULL ? &new_error : NULL);
 	assert(rc == 0 || new_error == NULL);
 	if (rc == -ENOENT) {
 		auto weak_source = di_weakly_ref_object(_obj);
 		sig_type = DI_TYPE_NIL;
-		sig = di_new_object_with_type(struct di_signal);
+		sig = di_new_object_with_type2(struct di_signal, signal_type);
 		sig->nhandlers = 0;
+		di_set_object_dtor((di_object *)sig, di_signal_dtor);
 		DI_CHECK_OK(di_member(sig, "weak_source", weak_source));
-		DI_CHECK_OK(di_member_clone(sig, "signal_name", signal_member_name));
-		DI_CHECK_OK(di_method(sig, "remove", di_signal_remove_handler, struct di_weak_object *));
-		DI_CHECK_OK(di_method(sig, "add", di_signal_add_handler, di_object *));
-		DI_CHECK_OK(di_method(sig, "dispatch", di_signal_dispatch, di_tuple));
-		rc = di_setx(_obj, signal_member_name, DI_TYPE_OBJECT, &sig,
-		             error != NULL ? &new_error : NULL);
+		DI_CHECK_OK(di_add_member_clone((di_object *)sig,
+		                                di_string_borrow_literal("signal_name"),
+		                                DI_TYPE_STRING, &signal_member->name));
+		rc = di_setx_atom(_obj, signal_member, DI_TYPE_OBJECT, &sig,
+		                  error != NULL ? &new_error : NULL);
 		if (rc != 0 && new_error == NULL) {
 			new_error = di_new_error("Failed to set signal object %s", strerror(rc));
 		}
@@ -1249,15 +2224,12 @@ di_object *di_listen_to(di_object *_obj, di_string name, di_object *h,
 
 	di_signal_add_handler((di_object *)sig, h);
 
-	auto listen_handle = di_new_object_with_type(struct di_listen_handle);
-	DI_CHECK_OK(di_set_type((void *)listen_handle, "deai:ListenHandle"));
+	auto listen_handle = di_new_object_with_type2(struct di_listen_handle, listen_handle_type);
 
 	auto weak_sig = di_weakly_ref_object((di_object *)sig);
 	auto weak_handler = di_weakly_ref_object(h);
 	di_member(listen_handle, "weak_signal", weak_sig);
 	di_member(listen_handle, "weak_handler", weak_handler);
-	di_method(listen_handle, "stop", di_listen_handle_stop);
-	di_method(listen_handle, "auto_stop", di_listen_handle_auto_stop, int);
 
 	di_set_object_dtor((void *)listen_handle, di_listen_handle_dtor);
 	di_unref_object((di_object *)sig);
@@ -1265,6 +2237,426 @@ di_object *di_listen_to(di_object *_obj, di_string name, di_object *h,
 	return (di_object *)listen_handle;
 }
 
+/// A signal handler that collects the emissions it receives, and delivers them to the
+/// handler it wraps all at once. See `di_listen_to_batch`.
+struct di_batched_handler {
+	di_object;
+	/// Link in `pending_batches`, valid if `pending` is true
+	struct list_head siblings;
+	bool pending;
+};
+
+/// Batched handlers with emissions that haven't been delivered yet, in the order of their
+/// first emission.
+static thread_local struct list_head pending_batches;
+
+static int
+di_batched_handler_call(di_object *obj, di_type *rt, di_value *unused ret, di_tuple args) {
+	auto batch = (struct di_batched_handler *)obj;
+	auto m = di_lookup(obj, di_string_borrow_literal("pending"));
+	if (m == NULL) {
+		DI_CHECK_OK(di_add_member_move(obj, di_string_borrow_literal("pending"),
+		                               (di_type[]){DI_TYPE_ARRAY},
+		                               (di_array[]){{
+		                                   .arr = NULL,
+		                                   .length = 0,
+		                                   .elem_type = DI_TYPE_TUPLE,
+		                               }}));
+		m = di_lookup(obj, di_string_borrow_literal("pending"));
+	}
+
+	auto pending = &m->value.array;
+	di_tuple *arr = pending->arr;
+	pending->arr = arr = trealloc(arr, pending->length + 1);
+	di_copy_value(DI_TYPE_TUPLE, &arr[pending->length++], &args);
+
+	if (!batch->pending) {
+		if (pending_batches.next == NULL) {
+			INIT_LIST_HEAD(&pending_batches);
+		}
+		list_add_tail(&batch->siblings, &pending_batches);
+		batch->pending = true;
+	}
+	*rt = DI_TYPE_NIL;
+	return 0;
+}
+
+static void di_batched_handler_dtor(di_object *obj) {
+	auto batch = (struct di_batched_handler *)obj;
+	if (batch->pending) {
+		list_del(&batch->siblings);
+		batch->pending = false;
+	}
+}
+
+void di_flush_batched_signals(void) {
+	if (pending_batches.next == NULL) {
+		return;
+	}
+	// Batches that receive emissions while we deliver these, e.g. from handlers emitting
+	// their own signals, are left for the next flush, so this always finishes.
+	struct list_head batches;
+	INIT_LIST_HEAD(&batches);
+	list_splice_init(&pending_batches, &batches);
+	while (!list_empty(&batches)) {
+		auto batch = list_first_entry(&batches, struct di_batched_handler, siblings);
+		list_del(&batch->siblings);
+		batch->pending = false;
+
+		scoped_di_object *obj = di_ref_object((di_object *)batch);
+		di_variant events;
+		if (di_remove_member_raw(obj, di_string_borrow_literal("pending"), &events) != 0) {
+			continue;
+		}
+
+		scoped_di_object *handler = NULL;
+		if (di_get(obj, "handler", handler) == 0) {
+			di_call_signal_handler(handler, (di_tuple){.length = 1, .elements = &events});
+		}
+		di_free_value(DI_TYPE_VARIANT, (di_value *)&events);
+	}
+}
+
+bool di_has_batched_signals(void) {
+	return pending_batches.next != NULL && !list_empty(&pending_batches);
+}
+
+di_object *di_listen_to_batch(di_object *obj, di_string name, di_object *h,
+                              di_object *nullable *nullable error) {
+	auto batch = di_new_object_with_type2(struct di_batched_handler, batched_handler_type);
+	di_set_object_call((di_object *)batch, di_batched_handler_call);
+	di_set_object_dtor((di_object *)batch, di_batched_handler_dtor);
+	DI_CHECK_OK(di_member_clone(batch, "handler", h));
+
+	auto listen_handle = di_listen_to(obj, name, (di_object *)batch, error);
+	di_unref_object((di_object *)batch);
+	return listen_handle;
+}
+
+/// A signal handler that only forwards the emissions that pass all of its filters. See
+/// `di_listen_to_filtered`.
+struct di_filtered_handler {
+	di_object;
+	unsigned int nfilters;
+	struct di_signal_filter filters[];
+};
+
+/// Get the string value of `type` and `value`, without copying.
+static bool di_borrow_string_value(di_type type, const di_value *value, di_string *ret) {
+	if (type == DI_TYPE_STRING) {
+		*ret = value->string;
+		return true;
+	}
+	if (type == DI_TYPE_STRING_LITERAL) {
+		*ret = di_string_borrow(value->string_literal);
+		return true;
+	}
+	return false;
+}
+
+static bool di_signal_filter_match(const struct di_signal_filter *filter, di_tuple args) {
+	if (filter->arg >= args.length) {
+		return false;
+	}
+	di_type type = args.elements[filter->arg].type;
+	di_value *value = args.elements[filter->arg].value;
+	if (type == DI_TYPE_VARIANT) {
+		type = value->variant.type;
+		value = value->variant.value;
+	}
+
+	di_string str;
+	di_value converted;
+	switch (filter->kind) {
+	case DI_SIGNAL_FILTER_EQUAL:
+		switch (filter->type) {
+		case DI_TYPE_NIL:
+			return type == DI_TYPE_NIL;
+		case DI_TYPE_STRING:
+			return di_borrow_string_value(type, value, &str) &&
+			       di_string_eq(str, filter->value.string);
+		case DI_TYPE_INT:
+			return di_int_conversion(type, value, 64, false, &converted.int_) == 0 &&
+			       converted.int_ == filter->value.int_;
+		case DI_TYPE_UINT:
+			return di_int_conversion(type, value, 64, true, &converted.uint) == 0 &&
+			       converted.uint == filter->value.uint;
+		case DI_TYPE_BOOL:
+		case DI_TYPE_FLOAT:
+			if (di_type_conversion(type, value, filter->type, &converted, true) != 0) {
+				return false;
+			}
+			if (filter->type == DI_TYPE_BOOL) {
+				return converted.bool_ == filter->value.bool_;
+			}
+			return converted.float_ == filter->value.float_;
+		case DI_TYPE_ANY:
+		case DI_TYPE_EMPTY_OBJECT:
+		case DI_TYPE_NINT:
+		case DI_TYPE_NUINT:
+		case DI_TYPE_POINTER:
+		case DI_TYPE_OBJECT:
+		case DI_TYPE_WEAK_OBJECT:
+		case DI_TYPE_STRING_LITERAL:
+		case DI_TYPE_ARRAY:
+		case DI_TYPE_TUPLE:
+		case DI_TYPE_VARIANT:
+		case DI_LAST_TYPE:
+			// `di_copy_signal_filter` converts the values to the types above
+			break;
+		}
+		unreachable();
+	case DI_SIGNAL_FILTER_PREFIX:
+		return di_borrow_string_value(type, value, &str) &&
+		       di_string_starts_with_string(str, filter->value.string);
+	case DI_SIGNAL_FILTER_MASK:
+		if (di_int_conversion(type, value, 64, true, &converted.uint) != 0 &&
+		    di_int_conversion(type, value, 64, false, &converted.int_) != 0) {
+			return false;
+		}
+		return (converted.uint & filter->value.uint) != 0;
+	default:
+		unreachable();
+	}
+}
+
+static int
+di_filtered_handler_call(di_object *obj, di_type *rt, di_value *ret, di_tuple args) {
+	di_object *target;
+	if (!di_signal_handler_accepts(obj, args, &target)) {
+		*rt = DI_TYPE_NIL;
+		return 0;
+	}
+	return di_call_object(target, rt, ret, args);
+}
+
+/// Whether `handler` should be called for an emission with `args`. Handlers with filters
+/// are unwrapped, and the wrapped handler is returned in `*target`.
+static bool
+di_signal_handler_accepts(di_object *handler, di_tuple args, di_object **target) {
+	*target = handler;
+	if (((di_object_internal *)handler)->call != di_filtered_handler_call) {
+		return true;
+	}
+
+	auto filtered = (struct di_filtered_handler *)handler;
+	for (unsigned int i = 0; i < filtered->nfilters; i++) {
+		if (!di_signal_filter_match(&filtered->filters[i], args)) {
+			return false;
+		}
+	}
+	// The wrapped handler is kept alive by the wrapper
+	DI_CHECK_OK(di_rawget_borrowed_object(handler, di_atom_of("handler"), target));
+	return true;
+}
+
+static void di_filtered_handler_dtor(di_object *obj) {
+	auto filtered = (struct di_filtered_handler *)obj;
+	for (unsigned int i = 0; i < filtered->nfilters; i++) {
+		di_free_value(filtered->filters[i].type, &filtered->filters[i].value);
+	}
+	filtered->nfilters = 0;
+}
+
+/// Convert the value of `filter` to the type it's compared as, and copy it into `out`.
+static int di_copy_signal_filter(const struct di_signal_filter *filter,
+                                 struct di_signal_filter *out) {
+	*out = *filter;
+	di_string str;
+	switch (filter->kind) {
+	case DI_SIGNAL_FILTER_EQUAL:
+		switch (filter->type) {
+		case DI_TYPE_NIL:
+		case DI_TYPE_BOOL:
+		case DI_TYPE_FLOAT:
+			return 0;
+		case DI_TYPE_NINT:
+		case DI_TYPE_INT:
+			out->type = DI_TYPE_INT;
+			return di_int_conversion(filter->type, (di_value *)&filter->value, 64, false,
+			                         &out->value.int_);
+		case DI_TYPE_NUINT:
+		case DI_TYPE_UINT:
+			out->type = DI_TYPE_UINT;
+			return di_int_conversion(filter->type, (di_value *)&filter->value, 64, true,
+			                         &out->value.uint);
+		case DI_TYPE_STRING:
+		case DI_TYPE_STRING_LITERAL:
+		case DI_TYPE_ANY:
+		case DI_TYPE_EMPTY_OBJECT:
+		case DI_TYPE_POINTER:
+		case DI_TYPE_OBJECT:
+		case DI_TYPE_WEAK_OBJECT:
+		case DI_TYPE_ARRAY:
+		case DI_TYPE_TUPLE:
+		case DI_TYPE_VARIANT:
+		case DI_LAST_TYPE:
+			// Strings are compared as strings, others are rejected below.
+			break;
+		}
+		fallthrough();
+	case DI_SIGNAL_FILTER_PREFIX:
+		if (!di_borrow_string_value(filter->type, &filter->value, &str)) {
+			return -EINVAL;
+		}
+		out->type = DI_TYPE_STRING;
+		out->value.string = di_clone_string(str);
+		return 0;
+	case DI_SIGNAL_FILTER_MASK:
+		out->type = DI_TYPE_UINT;
+		if (di_int_conversion(filter->type, (di_value *)&filter->value, 64, true,
+		                      &out->value.uint) == 0) {
+			return 0;
+		}
+		return di_int_conversion(filter->type, (di_value *)&filter->value, 64, false,
+		                         &out->value.int_);
+	default:
+		return -EINVAL;
+	}
+}
+
+di_object *
+di_listen_to_filtered(di_object *obj, di_string name, di_object *h,
+                      const struct di_signal_filter *filters, unsigned int nfilters,
+                      di_object *nullable *nullable error) {
+	auto filtered = (struct di_filtered_handler *)di_new_object_with_type_name(
+	    sizeof(struct di_filtered_handler) + sizeof(struct di_signal_filter) * nfilters,
+	    alignof(struct di_filtered_handler), filtered_handler_type);
+	di_set_object_call((di_object *)filtered, di_filtered_handler_call);
+	di_set_object_dtor((di_object *)filtered, di_filtered_handler_dtor);
+	DI_CHECK_OK(di_member_clone(filtered, "handler", h));
+
+	for (unsigned int i = 0; i < nfilters; i++) {
+		auto filter = &filtered->filters[filtered->nfilters];
+		if (di_copy_signal_filter(&filters[i], filter) != 0) {
+			di_unref_object((di_object *)filtered);
+			auto new_error = di_new_error("Invalid filter %u for signal %.*s", i,
+			                              (int)name.length, name.data);
+			if (error != NULL) {
+				*error = new_error;
+				return NULL;
+			}
+			di_throw(new_error);
+		}
+		filtered->nfilters++;
+	}
+
+	auto listen_handle = di_listen_to(obj, name, (di_object *)filtered, error);
+	di_unref_object((di_object *)filtered);
+	return listen_handle;
+}
+
+static uint64_t di_gc_stats_collections(di_object *unused o) {
+	return gc_stats.collections;
+}
+static uint64_t di_gc_stats_objects_scanned(di_object *unused o) {
+	return gc_stats.objects_scanned;
+}
+static uint64_t di_gc_stats_objects_reclaimed(di_object *unused o) {
+	return gc_stats.objects_reclaimed;
+}
+static double di_gc_stats_time(di_object *unused o) {
+	return (double)gc_stats.time_ns / 1e9;
+}
+static uint64_t di_gc_stats_objects_allocated(di_object *unused o) {
+	return gc_stats.objects_allocated;
+}
+static uint64_t di_gc_stats_objects_freed(di_object *unused o) {
+	return gc_stats.objects_freed;
+}
+static uint64_t di_gc_stats_candidates(di_object *unused o) {
+	uint64_t count = 0;
+	struct list_head *pos;
+	list_for_each (pos, di_gc_candidates(false)) {
+		count++;
+	}
+	list_for_each (pos, di_gc_candidates(true)) {
+		count++;
+	}
+	return count;
+}
+static di_object *di_gc_stats_types(di_object *unused o) {
+	auto ret = di_new_object_with_type(di_object);
+	struct di_type_table *t, *nt;
+	HASH_ITER (hh, type_tables, t, nt) {
+		if (t->allocated == 0) {
+			continue;
+		}
+		auto entry = di_new_object_with_type(di_object);
+		DI_CHECK_OK(di_member_clone(entry, "allocated", t->allocated));
+		DI_CHECK_OK(di_member_clone(entry, "freed", t->freed));
+		DI_CHECK_OK(di_member_clone(entry, "live", t->allocated - t->freed));
+		DI_CHECK_OK(di_add_member_move(ret, di_string_borrow(t->name),
+		                               (di_type[]){DI_TYPE_OBJECT}, &entry));
+	}
+	return ret;
+}
+
+/// Garbage collector statistics
+///
+/// TYPE: deai:GcStats
+///
+/// Counters are always collected, and this object always reports their current values.
+///
+/// EXPORT: deai:GcStats.collections: :unsigned
+///
+/// Number of times the garbage collector has run.
+///
+/// EXPORT: deai:GcStats.objects_scanned: :unsigned
+///
+/// Total number of objects scanned by the garbage collector.
+///
+/// EXPORT: deai:GcStats.objects_reclaimed: :unsigned
+///
+/// Number of objects freed by the garbage collector, i.e. those in reference cycles.
+///
+/// EXPORT: deai:GcStats.candidates: :unsigned
+///
+/// Number of objects currently waiting to be scanned by the garbage collector.
+///
+/// EXPORT: deai:GcStats.time: :float
+///
+/// Wall time spent in the garbage collector, in seconds.
+///
+/// EXPORT: deai:GcStats.objects_allocated: :unsigned
+///
+/// EXPORT: deai:GcStats.objects_freed: :unsigned
+///
+/// Number of objects created and freed, respectively.
+///
+/// EXPORT: deai:GcStats.types: :object
+///
+/// Object lifetime statistics for each type, keyed by the type name. Each value has the
+/// fields `allocated`, `freed` and `live`. An object is counted as allocated when it's
+/// given a type, and as freed when it's finalized or its type is changed.
+di_object *di_new_gc_stats(void) {
+	auto ret = di_new_object_with_type(di_object);
+	di_set_type(ret, gc_stats_type);
+	return ret;
+}
+
+void di_init_object_types(void) {
+	DI_CHECK_OK(di_type_method(error_type, "__to_string", di_error_to_string));
+	DI_CHECK_OK(di_type_method(signal_type, "remove", di_signal_remove_handler,
+	                           struct di_weak_object *));
+	DI_CHECK_OK(di_type_method(signal_type, "add", di_signal_add_handler, di_object *));
+	DI_CHECK_OK(di_type_method(signal_type, "dispatch", di_signal_dispatch, di_tuple));
+	DI_CHECK_OK(di_type_method(listen_handle_type, "stop", di_listen_handle_stop));
+	DI_CHECK_OK(
+	    di_type_method(listen_handle_type, "auto_stop", di_listen_handle_auto_stop, int));
+
+	DI_CHECK_OK(di_type_getter(gc_stats_type, collections, di_gc_stats_collections));
+	DI_CHECK_OK(di_type_getter(gc_stats_type, objects_scanned, di_gc_stats_objects_scanned));
+	DI_CHECK_OK(
+	    di_type_getter(gc_stats_type, objects_reclaimed, di_gc_stats_objects_reclaimed));
+	DI_CHECK_OK(di_type_getter(gc_stats_type, candidates, di_gc_stats_candidates));
+	DI_CHECK_OK(di_type_getter(gc_stats_type, time, di_gc_stats_time));
+	DI_CHECK_OK(
+	    di_type_getter(gc_stats_type, objects_allocated, di_gc_stats_objects_allocated));
+	DI_CHECK_OK(di_type_getter(gc_stats_type, objects_freed, di_gc_stats_objects_freed));
+	DI_CHECK_OK(di_type_getter(gc_stats_type, types, di_gc_stats_types));
+}
+
 static inline di_string di_object_to_string_fallback(di_object *o) {
 	return di_string_printf("[object:%p]", o);
 }
@@ -1323,20 +2715,68 @@ di_string di_object_to_string(di_object *o, di_object *nullable *nullable error)
 	return ret;
 }
 
+/// Emit the signal found in the member `signal_member`, which is named `name`.
+static int di_emitn_key(di_object *o, di_string name, const struct di_atom *signal_member,
+                        di_tuple args) {
+	assert(args.length == 0 || (args.elements != NULL));
+	scoped_di_object *sig = NULL;
+	if (di_getxt_key(o, signal_member, DI_TYPE_OBJECT, (di_value *)&sig, NULL) == 0) {
+		auto start = di_trace_begin();
+		di_signal_dispatch(sig, args);
+		di_trace_end("emit", name, start);
+	}
+	return 0;
+}
+
+/// Bloom filter of the signals `o` could have. Most signals are emitted without anyone
+/// listening, so this is checked before doing any lookup.
+static uint64_t di_signal_filter_of(di_object *o) {
+	auto obj = (di_object_internal *)o;
+	auto filter = obj->signal_filter;
+	if (obj->type_table != NULL) {
+		filter |= obj->type_table->signal_filter;
+	}
+	return filter;
+}
+
 int di_emitn(di_object *o, di_string name, di_tuple args) {
 	if (args.length > MAX_NARGS) {
 		return -E2BIG;
 	}
+	auto filter = di_signal_filter_of(o);
+	if (filter == 0) {
+		return 0;
+	}
 
-	assert(args.length == 0 || (args.elements != NULL));
+	// Listening to a signal, or adding a signal member, interns its name. Names that
+	// aren't interned are not interned here either, so scripts emitting names built at
+	// runtime don't grow the atom table.
+	auto key = di_key(name);
+	auto atom = di_find_atom(&key);
+	if (atom != NULL) {
+		return di_emitn_atom(o, (struct di_atom *)atom, args);
+	}
+	scoped_di_string buf = DI_STRING_INIT;
+	auto signal_member = di_derive_key(&key, DI_ATOM_SIGNAL, &buf);
+	if ((filter & ((uint64_t)1 << (signal_member.hash % 64))) == 0) {
+		return 0;
+	}
+	return di_emitn_key(o, name, &signal_member, args);
+}
 
-	scoped_di_string signal_member_name =
-	    di_string_printf("__signal_%.*s", (int)name.length, name.data);
-	scoped_di_object *sig = NULL;
-	if (di_get2(o, signal_member_name, sig) == 0) {
-		di_signal_dispatch(sig, args);
+int di_emitn_atom(di_object *o, const struct di_atom *name, di_tuple args) {
+	if (args.length > MAX_NARGS) {
+		return -E2BIG;
 	}
-	return 0;
+	auto filter = di_signal_filter_of(o);
+	if (filter == 0) {
+		return 0;
+	}
+	auto signal_member = di_atom_derive(name, DI_ATOM_SIGNAL);
+	if ((filter & ((uint64_t)1 << (signal_member->hash % 64))) == 0) {
+		return 0;
+	}
+	return di_emitn_key(o, name->name, signal_member, args);
 }
 
 #undef is_destroy
@@ -1346,6 +2786,34 @@ di_object *di_get_roots(void) {
 	return (di_object *)roots;
 }
 
+bool di_pin_object(di_object *obj_) {
+	auto obj = (di_object_internal *)obj_;
+	if (roots == NULL || roots->dropped || obj->pin_index != 0) {
+		return false;
+	}
+	if (roots->npinned == roots->pinned_capacity) {
+		roots->pinned_capacity = roots->pinned_capacity ? roots->pinned_capacity * 2 : 16;
+		roots->pinned = trealloc(roots->pinned, roots->pinned_capacity);
+	}
+	roots->pinned[roots->npinned++] = di_ref_object(obj_);
+	obj->pin_index = roots->npinned;
+	return true;
+}
+
+bool di_unpin_object(di_object *obj_) {
+	auto obj = (di_object_internal *)obj_;
+	if (roots == NULL || obj->pin_index == 0) {
+		return false;
+	}
+	// Move the last pinned object into the hole
+	auto last = (di_object_internal *)roots->pinned[--roots->npinned];
+	roots->pinned[obj->pin_index - 1] = (di_object *)last;
+	last->pin_index = obj->pin_index;
+	obj->pin_index = 0;
+	di_unref_object(obj_);
+	return true;
+}
+
 static void di_scan_type(di_type type, di_value *value, int (*pre)(di_object_internal *, int),
                          int state, void (*post)(di_object_internal *)) {
 	if (type == DI_TYPE_OBJECT) {
@@ -1355,9 +2823,13 @@ static void di_scan_type(di_type type, di_value *value, int (*pre)(di_object_int
 			next_state = pre(obj, state);
 		}
 		if (next_state >= 0) {
-			struct di_member *m, *tmpm;
-			HASH_ITER (hh, obj->members, m, tmpm) {
-				di_scan_type(m->type, m->data, pre, next_state, post);
+			struct di_member *m;
+			for (uint32_t i = 0; (m = di_member_table_next(obj->members, &i)) != NULL; i++) {
+				di_scan_type(m->type, &m->value, pre, next_state, post);
+			}
+			for (int i = 0; i < obj->inline_values.length; i++) {
+				auto v = &obj->inline_values.elements[i];
+				di_scan_type(v->type, v->value, pre, next_state, post);
 			}
 			if (post) {
 				post(obj);
@@ -1387,11 +2859,30 @@ static void di_scan_type(di_type type, di_value *value, int (*pre)(di_object_int
 // we use `fprintf(stderr, ...)` directly.
 
 // Stage 1, count all references reachable from the unreferenced root object. mark is set to 1
-static int di_collect_garbage_mark(di_object_internal *o, int _ unused) {
+//
+// `is_root` is 1 for the root object, and 0 for everything else. When collecting young
+// objects, we don't go into long lived objects, objects referenced by them will just look
+// like they have external references. They could be part of a garbage cycle through the
+// long lived object, so it is queued for the next collection of long lived objects.
+//
+// Once `gc_mark_limit` is reached, the remaining objects are not visited, they look like
+// they have external references too. So stopping early only ever revives objects.
+static int di_collect_garbage_mark(di_object_internal *o, int is_root) {
+	if (gc_work >= gc_mark_limit) {
+		gc_mark_truncated = true;
+		return -1;
+	}
+	if (gc_young_only && !is_root && o->mark == 0 && o->gc_age >= DI_GC_OLD_AGE) {
+		if (list_empty(&o->unreferred_siblings)) {
+			list_add(&o->unreferred_siblings, di_gc_candidates(true));
+		}
+		return -1;
+	}
 #ifdef TRACK_OBJECTS
 	fprintf(stderr, "\tmark %p %s %lu/%lu\n", o, di_get_type((void *)o),
 	        o->ref_count_scan, o->ref_count);
 #endif
+	gc_work++;
 	list_del_init(&o->unreferred_siblings);
 	o->ref_count_scan += 1;
 	if (o->mark == 1) {
@@ -1430,6 +2921,9 @@ static int di_collect_garbage_scan(di_object_internal *o, int revive) {
 #endif
 		o->ref_count_scan = 0;
 		o->mark = 0;
+		if (o->gc_age < DI_GC_OLD_AGE) {
+			o->gc_age++;
+		}
 		return 1;
 	}
 	if (o->mark == 2 || o->mark == 0) {
@@ -1458,63 +2952,171 @@ static void di_collect_garbage_collect_post(di_object_internal *o) {
 	// fprintf(stderr, "\tpost-finalizing %p, %lu\n", o, o->ref_count);
 	di_finalize_object_inner(o);
 	di_unref_object((void *)o);
-}
-/// Collect garbage in cyclic references
-void di_collect_garbage(void) {
-	while (!list_empty(&unreferred_objects)) {
-		di_object_internal *i, *ni;
-		// While we scan, we need to remove roots that can be reached from other
-		// roots, so in the end we guarantee that no roots can reach each other.
-		// This is an important assumption we need when we finalize objects.
-
-		// Move scanned objects to a new list, so if finalizing some
-		// of the objects here cause some other objects to be unreferenced, they
-		// could be added to the list without disrupting the collection.
-		struct list_head isolated_roots;
-		INIT_LIST_HEAD(&isolated_roots);
-		while (!list_empty(&unreferred_objects)) {
-			i = list_first_entry(&unreferred_objects, di_object_internal, unreferred_siblings);
-			// fprintf(stderr, "unref root: %p %lu/%lu %d, %s\n", i, i->ref_count_scan,
-			//        i->ref_count, i->mark, di_get_type((void *)i));
-
-			// di_collect_garbage_mark will remove all reached objects from unreferred_objects.
-			assert(i->mark == 0);
-			di_scan_type(DI_TYPE_OBJECT, (void *)&i, di_collect_garbage_mark, 0, NULL);
-			// unreferred_objects list doesn't constitute as a reference.
-			i->ref_count_scan -= 1;
-			list_add(&i->unreferred_siblings, &isolated_roots);
-		}
-
-		list_for_each_entry (i, &isolated_roots, unreferred_siblings) {
-			// fprintf(stderr, "unref root: %p %lu/%lu %d, %s\n", i, i->ref_count_scan,
-			//        i->ref_count, i->mark, di_get_type((void *)i));
-			di_scan_type(DI_TYPE_OBJECT, (void *)&i, di_collect_garbage_scan, 0, NULL);
-		}
-
-		// First, remove all revived objects from the list. Because unreferring
-		// them will add them to the `unreferred_objects` list. If we don't remove
-		// them from this list first, this list will be corrupted.
-		list_for_each_entry_safe (i, ni, &isolated_roots, unreferred_siblings) {
-			assert(i->mark == 0 || i->mark == 2);
-			if (i->mark != 2) {
-				list_del_init(&i->unreferred_siblings);
+	gc_stats.objects_reclaimed++;
+}
+/// Run one round of cycle collection, with candidates from `candidates`. Candidates are
+/// taken until `budget` objects have been scanned, the rest are left for later. When only
+/// collecting young objects, marking also stops at `budget`, and the candidate it stopped
+/// in is handed over to the next collection of long lived objects, which always finishes
+/// the candidates it takes.
+static void di_collect_garbage_batch(struct list_head *candidates, uint64_t budget) {
+	di_object_internal *i, *ni;
+	// While we scan, we need to remove roots that can be reached from other
+	// roots, so in the end we guarantee that no roots can reach each other.
+	// This is an important assumption we need when we finalize objects.
+
+	// Move scanned objects to a new list, so if finalizing some
+	// of the objects here cause some other objects to be unreferenced, they
+	// could be added to the list without disrupting the collection.
+	struct list_head isolated_roots;
+	INIT_LIST_HEAD(&isolated_roots);
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	gc_work = 0;
+	gc_mark_limit = gc_young_only ? budget : UINT64_MAX;
+	gc_mark_truncated = false;
+	di_object_internal *truncated = NULL;
+	while (!list_empty(candidates) && gc_work < budget) {
+		i = list_first_entry(candidates, di_object_internal, unreferred_siblings);
+		// fprintf(stderr, "unref root: %p %lu/%lu %d, %s\n", i, i->ref_count_scan,
+		//        i->ref_count, i->mark, di_get_type((void *)i));
+
+		// di_collect_garbage_mark will remove all reached objects from unreferred_objects.
+		assert(i->mark == 0);
+		di_scan_type(DI_TYPE_OBJECT, (void *)&i, di_collect_garbage_mark, 1, NULL);
+		// unreferred_objects list doesn't constitute as a reference.
+		i->ref_count_scan -= 1;
+		list_add(&i->unreferred_siblings, &isolated_roots);
+		if (gc_mark_truncated) {
+			// The budget is used up, so this is the last candidate
+			truncated = i;
+		}
+	}
+	gc_mark_limit = UINT64_MAX;
+
+	list_for_each_entry (i, &isolated_roots, unreferred_siblings) {
+		// fprintf(stderr, "unref root: %p %lu/%lu %d, %s\n", i, i->ref_count_scan,
+		//        i->ref_count, i->mark, di_get_type((void *)i));
+		di_scan_type(DI_TYPE_OBJECT, (void *)&i, di_collect_garbage_scan, 0, NULL);
+	}
+
+	// First, remove all revived objects from the list. Because unreferring
+	// them will add them to the `unreferred_objects` list. If we don't remove
+	// them from this list first, this list will be corrupted.
+	list_for_each_entry_safe (i, ni, &isolated_roots, unreferred_siblings) {
+		assert(i->mark == 0 || i->mark == 2);
+		if (i->mark != 2) {
+			list_del_init(&i->unreferred_siblings);
+			if (i == truncated) {
+				// It could still be part of a garbage cycle we didn't finish marking
+				list_add(&i->unreferred_siblings, di_gc_candidates(true));
 			}
 		}
+	}
+
+	while (!list_empty(&isolated_roots)) {
+		// fprintf(stderr, "unref root: %p %lu/%lu %d\n", i,
+		//         i->ref_count_scan, i->ref_count, i->mark);
+		i = list_first_entry(&isolated_roots, di_object_internal, unreferred_siblings);
+		di_scan_type(DI_TYPE_OBJECT, (void *)&i, di_collect_garbage_collect_pre, 0,
+		             di_collect_garbage_collect_post);
 
-		while (!list_empty(&isolated_roots)) {
-			// fprintf(stderr, "unref root: %p %lu/%lu %d\n", i,
-			//         i->ref_count_scan, i->ref_count, i->mark);
-			i = list_first_entry(&isolated_roots, di_object_internal, unreferred_siblings);
-			di_scan_type(DI_TYPE_OBJECT, (void *)&i, di_collect_garbage_collect_pre, 0,
-			             di_collect_garbage_collect_post);
+		// `i` should have been freed at this point. and the last unref should have removed it from to_finalize.
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	gc_stats.collections++;
+	gc_stats.objects_scanned += gc_work;
+	gc_stats.time_ns += (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+	                    (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+}
 
-			// `i` should have been freed at this point. and the last unref should have removed it from to_finalize.
+/// Whether `head` has at least `n` entries, without walking the whole list.
+static bool list_has_at_least(struct list_head *head, unsigned int n) {
+	struct list_head *pos = head->next;
+	for (unsigned int i = 0; i < n; i++, pos = pos->next) {
+		if (pos == head) {
+			return false;
 		}
 	}
+	return true;
+}
+
+/// Collect garbage in cyclic references
+void di_collect_garbage(void) {
+	auto start = di_trace_begin();
+	auto young = di_gc_candidates(false);
+	auto old = di_gc_candidates(true);
+	gc_young_only = false;
+	while (!list_empty(young) || !list_empty(old)) {
+		di_collect_garbage_batch(list_empty(young) ? old : young, UINT64_MAX);
+	}
+	gc_skipped_steps = 0;
+	di_trace_end("gc", DI_STRING_INIT, start);
+}
+
+bool di_collect_garbage_step(void) {
+	auto young = di_gc_candidates(false);
+	auto old = di_gc_candidates(true);
+	gc_steps++;
+	if (gc_steps % DI_GC_OLD_INTERVAL == 0 && !list_empty(old)) {
+		auto start = di_trace_begin();
+		gc_young_only = false;
+		di_collect_garbage_batch(old, DI_GC_STEP_BUDGET);
+		di_trace_end("gc_step", di_string_borrow_literal("old"), start);
+	} else if (list_has_at_least(young, DI_GC_MIN_CANDIDATES) ||
+	           (!list_empty(young) && gc_skipped_steps >= DI_GC_MAX_SKIPPED_STEPS)) {
+		auto start = di_trace_begin();
+		gc_skipped_steps = 0;
+		gc_young_only = true;
+		di_collect_garbage_batch(young, DI_GC_STEP_BUDGET);
+		gc_young_only = false;
+		di_trace_end("gc_step", di_string_borrow_literal("young"), start);
+	} else if (!list_empty(young)) {
+		gc_skipped_steps++;
+	}
+	return !list_empty(young) || !list_empty(old);
+}
+
+#ifdef UNITTESTS
+void di_gc_unit_tests(void) {
+	// Start with no candidates, so the steps below only see the ring.
+	di_collect_garbage();
+
+	// A garbage cycle several times larger than the step budget, every object in it is
+	// a young candidate.
+	const int nobjects = 3 * DI_GC_STEP_BUDGET;
+	di_object *first = di_new_object_with_type(di_object);
+	di_weak_object *weak_first = di_weakly_ref_object(first);
+	di_object *last = di_ref_object(first);
+	for (int i = 1; i < nobjects; i++) {
+		di_object *next = di_new_object_with_type(di_object);
+		DI_CHECK_OK(di_member_clone(last, "next", next));
+		di_unref_object(last);
+		last = next;
+	}
+	DI_CHECK_OK(di_member_clone(last, "next", first));
+	di_unref_object(first);
+	di_unref_object(last);
+
+	// Steps of young objects never go over the budget, and the cycle is still
+	// collected by a step of long lived objects.
+	bool collected = false;
+	for (int i = 0; i < 2 * DI_GC_OLD_INTERVAL && !collected; i++) {
+		di_collect_garbage_step();
+		bool old_step = gc_steps % DI_GC_OLD_INTERVAL == 0;
+		DI_CHECK(gc_work <= DI_GC_STEP_BUDGET || old_step);
+		scoped_di_object *obj = di_upgrade_weak_ref(weak_first);
+		collected = obj == NULL;
+	}
+	DI_CHECK(collected);
+	di_drop_weak_ref(&weak_first);
 }
+#endif
 
 bool di_is_empty_object(di_object *nonnull obj) {
-	return ((di_object_internal *)obj)->members == NULL;
+	auto members = ((di_object_internal *)obj)->members;
+	return members == NULL || members->count == 0;
 }
 
 #ifdef TRACK_OBJECTS
@@ -1589,14 +3191,15 @@ void di_dump_object(di_object *obj_) {
 	auto obj = (di_object_internal *)obj_;
 	di_log_va(log_module, DI_LOG_DEBUG,
 	          "%p, ref count: %lu strong %lu weak (live: %d), type: %s\n", obj,
-	          obj->ref_count, obj->weak_ref_count, obj->mark, di_get_type((void *)obj));
-	struct di_member *m, *tmpm;
-	HASH_ITER (hh, obj->members, m, tmpm) {
-		char *value_string = di_value_to_string(m->type, m->data);
+	          obj->ref_count, obj->weak_ref ? obj->weak_ref->ref_count - 1 : 0, obj->mark,
+	          di_get_type((void *)obj));
+	struct di_member *m;
+	for (uint32_t i = 0; (m = di_member_table_next(obj->members, &i)) != NULL; i++) {
+		char *value_string = di_value_to_string(m->type, &m->value);
 		di_log_va(log_module, DI_LOG_DEBUG, "\tmember: %.*s, type: %s (%s)",
 		          (int)m->name.length, m->name.data, di_type_to_string(m->type), value_string);
 		free(value_string);
-		di_dump_type_content(m->type, m->data);
+		di_dump_type_content(m->type, &m->value);
 	}
 }
 void di_dump_objects(void) {
@@ -1612,11 +3215,22 @@ void di_dump_objects(void) {
 	// Account for references from the roots
 	if (roots != NULL) {
 		roots->ref_count_scan--;
-		di_log_va(log_module, DI_LOG_DEBUG, "Anonymous roots:\n");
-		for (auto root = roots->anonymous_roots; root; root = root->hh.next) {
-			auto obj_internal = (di_object_internal *)root->obj;
+		di_log_va(log_module, DI_LOG_DEBUG, "Pinned objects:\n");
+		for (uint32_t j = 0; j < roots->npinned; j++) {
+			auto obj_internal = (di_object_internal *)roots->pinned[j];
 			obj_internal->ref_count_scan--;
-			di_log_va(log_module, DI_LOG_DEBUG, "\t%p\n", root->obj);
+			di_log_va(log_module, DI_LOG_DEBUG, "\t%p\n", roots->pinned[j]);
+		}
+	}
+
+	// Account for references from the per-type member tables
+	struct di_type_table *t, *nt;
+	HASH_ITER (hh, type_tables, t, nt) {
+		struct di_member *m;
+		for (uint32_t i = 0; (m = di_member_table_next(t->members, &i)) != NULL; i++) {
+			if (m->type == DI_TYPE_OBJECT) {
+				((di_object_internal *)m->value.object)->ref_count_scan--;
+			}
 		}
 	}
 
@@ -14,6 +14,7 @@
 #include <deai/object.h>
 
 #include "common.h"        // IWYU pragma: keep
+#include "os.h"
 
 static struct di_variant di_env_get(struct di_module *m, di_string name_) {
 	struct di_variant ret = {
@@ -63,11 +64,10 @@ static int di_os_getpid(di_object * /*m*/) {
 	return getpid();
 }
 
-static di_array di_listdir(di_object *o unused, di_string path) {
+di_array di_read_dir(const char *path) {
 	int capacity = 0;
 	di_array ret = {.arr = NULL, .length = 0, .elem_type = DI_TYPE_STRING};
-	scopedp(char) *c_path = di_string_to_chars_alloc(path);
-	DIR *dir = opendir(c_path);
+	DIR *dir = opendir(path);
 	if (!dir) {
 		return ret;
 	}
@@ -87,6 +87,11 @@ static di_array di_listdir(di_object *o unused, di_string path) {
 	return ret;
 }
 
+static di_array di_listdir(di_object *o unused, di_string path) {
+	scopedp(char) *c_path = di_string_to_chars_alloc(path);
+	return di_read_dir(c_path);
+}
+
 /// EXPORT: os: deai:module
 ///
 /// OS environment
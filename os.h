@@ -8,3 +8,6 @@
 #include <deai/deai.h>
 
 void di_init_os(di_object *di);
+/// List the names of entries in directory `path`, excluding "." and "..". Doesn't touch
+/// any objects, so it can be called from worker threads.
+di_array di_read_dir(const char *path);
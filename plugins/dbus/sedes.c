@@ -43,6 +43,29 @@ static di_type dbus_type_to_di(int type) {
 	}
 }
 
+/// Get the width and signedness of a dbus integer type. Returns false if `type` is not an
+/// integer type.
+static bool dbus_int_type_info(int type, int *bits, bool *is_unsigned) {
+	switch (type) {
+	case DBUS_TYPE_INT16:
+	case DBUS_TYPE_UINT16:
+		*bits = 16;
+		break;
+	case DBUS_TYPE_INT32:
+	case DBUS_TYPE_UINT32:
+		*bits = 32;
+		break;
+	case DBUS_TYPE_INT64:
+	case DBUS_TYPE_UINT64:
+		*bits = 64;
+		break;
+	default:
+		return false;
+	}
+	*is_unsigned = type == DBUS_TYPE_UINT16 || type == DBUS_TYPE_UINT32 || type == DBUS_TYPE_UINT64;
+	return true;
+}
+
 #define DESERIAL(typeid, type, tgt)                                                      \
 	case typeid:                                                                         \
 		do {                                                                             \
@@ -84,18 +107,35 @@ static void dbus_deserialize_one(DBusMessageIter *i, void *retp, di_type *otype,
 // Deserialize an array. `i' is the iterator, already recursed into the array
 // `type' is the array element type
 static void dbus_deserialize_array(DBusMessageIter *i, di_array *retp, int type, int length) {
-	if (dbus_type_is_fixed(type)) {
-		di_array ret;
-		int length;
-		dbus_message_iter_get_fixed_array(i, &ret.arr, &length);
-		ret.length = length;
+	di_array ret;
+	ret.elem_type = dbus_type_to_di(type);
+
+	int bits;
+	bool is_unsigned;
+	if (dbus_int_type_info(type, &bits, &is_unsigned) || type == DBUS_TYPE_DOUBLE ||
+	    type == DBUS_TYPE_BOOLEAN) {
+		// Fixed size elements can be read all at once. They point into the message, so they
+		// have to be copied out, integers are widened in bulk at the same time.
+		void *elements;
+		int nelements;
+		dbus_message_iter_get_fixed_array(i, &elements, &nelements);
+		ret.length = nelements;
+		ret.arr = calloc(ret.length, di_sizeof_type(ret.elem_type));
+		if (type == DBUS_TYPE_DOUBLE) {
+			memcpy(ret.arr, elements, sizeof(double) * ret.length);
+		} else if (type == DBUS_TYPE_BOOLEAN) {
+			for (int x = 0; x < ret.length; x++) {
+				((bool *)ret.arr)[x] = ((dbus_bool_t *)elements)[x];
+			}
+		} else {
+			// Widening never fails
+			DI_CHECK_OK(di_int_array_conversion(elements, bits, is_unsigned, ret.arr, 64,
+			                                    is_unsigned, ret.length));
+		}
 		*retp = ret;
 		return;
 	}
 
-	di_array ret;
-	ret.elem_type = dbus_type_to_di(type);
-
 	size_t esize = di_sizeof_type(ret.elem_type);
 	ret.length = length;
 	if (ret.elem_type >= DI_LAST_TYPE) {
@@ -212,34 +252,9 @@ static void dbus_deserialize_one(DBusMessageIter *i, void *retp, di_type *otype,
 }
 
 static bool dbus_serialize_integer(DBusMessageIter *i, struct di_variant var, int dbus_type) {
-	int8_t dbus_bits;
+	int dbus_bits;
 	bool dbus_unsigned;
-	switch (dbus_type) {
-	case DBUS_TYPE_INT16:
-		dbus_unsigned = false;
-		dbus_bits = 16;
-		break;
-	case DBUS_TYPE_INT32:
-		dbus_unsigned = false;
-		dbus_bits = 32;
-		break;
-	case DBUS_TYPE_INT64:
-		dbus_unsigned = false;
-		dbus_bits = 64;
-		break;
-	case DBUS_TYPE_UINT16:
-		dbus_unsigned = false;
-		dbus_bits = 16;
-		break;
-	case DBUS_TYPE_UINT32:
-		dbus_unsigned = false;
-		dbus_bits = 32;
-		break;
-	case DBUS_TYPE_UINT64:
-		dbus_unsigned = false;
-		dbus_bits = 64;
-		break;
-	default:
+	if (!dbus_int_type_info(dbus_type, &dbus_bits, &dbus_unsigned)) {
 		return false;
 	}
 	char buf[sizeof(intmax_t)];
@@ -335,8 +350,9 @@ static int dbus_serialize_with_signature(DBusMessageIter *i, struct di_variant v
 		auto si2 = si.child[0];
 		DBusMessageIter i2;
 
+		// dbus_bool_t is wider than bool, so bool arrays can't be appended as they are.
 		if (dbus_type_is_basic(atype) && atype != DBUS_TYPE_STRING &&
-		    atype == *si2.current.data) {
+		    atype != DBUS_TYPE_BOOLEAN && atype == *si2.current.data) {
 			// Basic data type and no conversion needed
 			bool ret = dbus_message_iter_open_container(i, DBUS_TYPE_ARRAY,
 			                                            (char[]){(char)atype, 0}, &i2);
@@ -351,6 +367,28 @@ static int dbus_serialize_with_signature(DBusMessageIter *i, struct di_variant v
 			return dbus_message_iter_close_container(i, &i2) ? 0 : -ENOMEM;
 		}
 
+		int from_bits, to_bits;
+		bool from_unsigned, to_unsigned;
+		if (dbus_int_type_info(atype, &from_bits, &from_unsigned) &&
+		    dbus_int_type_info(*si2.current.data, &to_bits, &to_unsigned)) {
+			// Integers of a different width, convert them all at once
+			int dbus_type = *si2.current.data;
+			scopedp(char) *buf = malloc((size_t)to_bits / 8 * arr.length);
+			int ret = di_int_array_conversion(arr.arr, from_bits, from_unsigned, buf,
+			                                  to_bits, to_unsigned, arr.length);
+			if (ret != 0) {
+				return ret;
+			}
+			if (!dbus_message_iter_open_container(i, DBUS_TYPE_ARRAY,
+			                                      (char[]){(char)dbus_type, 0}, &i2)) {
+				return -ENOMEM;
+			}
+			if (!dbus_message_iter_append_fixed_array(&i2, dbus_type, &buf, arr.length)) {
+				return -ENOMEM;
+			}
+			return dbus_message_iter_close_container(i, &i2) ? 0 : -ENOMEM;
+		}
+
 		char *tmp = di_string_to_chars_alloc(si2.current);
 		int step = di_sizeof_type(arr.elem_type);
 		bool ret = dbus_message_iter_open_container(i, DBUS_TYPE_ARRAY, tmp, &i2);
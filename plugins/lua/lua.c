@@ -44,6 +44,7 @@
 #include <deai/deai.h>
 #include <deai/error.h>
 #include <deai/helper.h>
+#include <deai/trace.h>
 #include <deai/type.h>
 
 #include "common.h"
@@ -1044,12 +1045,26 @@ static int call_lua_function(di_object *ref_, di_type *rt, di_value *ret, di_tup
 
 	// Get the function
 	lua_rawgeti(L, LUA_REGISTRYINDEX, ref->tref);
+	auto trace_start = di_trace_begin();
+	char trace_detail[64];
+	di_string detail = DI_STRING_INIT;
+	if (trace_start != 0) {
+		// Name the span after where the function is defined
+		lua_Debug ar;
+		lua_pushvalue(L, -1);
+		lua_getinfo(L, ">S", &ar);
+		snprintf(trace_detail, sizeof(trace_detail), "%s:%d", ar.short_src,
+		         ar.linedefined);
+		detail = di_string_borrow(trace_detail);
+	}
 	// Push arguments
 	for (unsigned int i = 0; i < t.length; i++) {
 		di_lua_pushvariant(L, DI_STRING_INIT, vars[i]);
 	}
 
-	if (lua_pcall(L, t.length, 1, -(int)t.length - 2) != 0) {
+	int rc = lua_pcall(L, t.length, 1, -(int)t.length - 2);
+	di_trace_end("lua", detail, trace_start);
+	if (rc != 0) {
 		di_type err_type;
 		di_value err;
 		DI_CHECK_OK(di_lua_type_to_di(L, -1, DI_TYPE_ANY, &err_type, &err));
@@ -1180,7 +1195,71 @@ struct di_signal_handler_wrapper {
 };
 
 static int call_lua_signal_handler_once(di_object *obj, di_type *rt, di_value *ret, di_tuple t);
-/// EXPORT: deai.plugin.lua:Proxy.on(signal: :string, callback): deai:ListenHandle
+
+/// Maximum number of filters a signal listener can have
+#define DI_LUA_MAX_SIGNAL_FILTERS 16
+
+/// Read the signal filters from the table at `index` into `filters`, see `on`. Strings in
+/// the filters are borrowed from the table. Returns the number of filters.
+static unsigned int
+di_lua_get_signal_filters(lua_State *L, int index, struct di_signal_filter *filters) {
+	unsigned int nfilters = 0;
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		// Stack: [ ..., key, value ]
+		if (!lua_isinteger(L, -2) || lua_tointeger(L, -2) < 1) {
+			luaL_error(L, "keys of signal filters must be argument positions");
+		}
+		if (nfilters >= DI_LUA_MAX_SIGNAL_FILTERS) {
+			luaL_error(L, "too many signal filters");
+		}
+
+		auto filter = &filters[nfilters++];
+		filter->arg = (unsigned int)(lua_tointeger(L, -2) - 1);
+		filter->kind = DI_SIGNAL_FILTER_EQUAL;
+		int npop = 1;
+		if (lua_type(L, -1) == LUA_TTABLE) {
+			lua_getfield(L, -1, "prefix");
+			if (lua_type(L, -1) == LUA_TSTRING) {
+				filter->kind = DI_SIGNAL_FILTER_PREFIX;
+			} else {
+				lua_pop(L, 1);
+				lua_getfield(L, -1, "mask");
+				if (!lua_isinteger(L, -1)) {
+					luaL_error(L, "signal filter must have either 'prefix' or 'mask'");
+				}
+				filter->kind = DI_SIGNAL_FILTER_MASK;
+			}
+			npop = 2;
+		}
+
+		switch (lua_type(L, -1)) {
+		case LUA_TSTRING:
+			filter->type = DI_TYPE_STRING;
+			filter->value.string.data =
+			    lua_tolstring(L, -1, &filter->value.string.length);
+			break;
+		case LUA_TNUMBER:
+			if (lua_isinteger(L, -1)) {
+				filter->type = DI_TYPE_INT;
+				filter->value.int_ = lua_tointeger(L, -1);
+			} else {
+				filter->type = DI_TYPE_FLOAT;
+				filter->value.float_ = lua_tonumber(L, -1);
+			}
+			break;
+		case LUA_TBOOLEAN:
+			filter->type = DI_TYPE_BOOL;
+			filter->value.bool_ = lua_toboolean(L, -1);
+			break;
+		default:
+			luaL_error(L, "unsupported value in signal filter");
+		}
+		lua_pop(L, npop);
+	}
+	return nfilters;
+}
+/// EXPORT: deai.plugin.lua:Proxy.on(signal: :string, callback, filters): deai:ListenHandle
 ///
 /// Listen for signals
 ///
@@ -1189,17 +1268,35 @@ static int call_lua_signal_handler_once(di_object *obj, di_type *rt, di_value *r
 ///
 /// If the handle is garbage collected, the listener will be left running forever.
 ///
-/// EXPORT: deai.plugin.lua:Proxy.once(signal: :string, callback): deai:ListenHandle
+/// `filters` is optional. It is a table keyed by argument positions, the callback is only
+/// called if all the arguments match. An argument matches a string, number or boolean if
+/// it's equal to it, ``{prefix = "str"}`` if it's a string starting with "str", and
+/// ``{mask = n}`` if it's an integer that has any of the bits of ``n`` set. The filters
+/// are checked without calling into lua. For example::
+///
+///     watch:on("modify", function(path) end, {[1] = {prefix = "/etc/"}})
+///
+/// EXPORT: deai.plugin.lua:Proxy.once(signal: :string, callback, filters): deai:ListenHandle
 ///
 /// Listen for signals only once
 ///
 /// Same as :lua:meth:`on`, except the callback will only be called for the first time the
-/// signal is received.
+/// signal is received. `filters` work the same way too, and the listener is only stopped
+/// once the callback has been called, i.e. by the first emission that passes the filters.
+///
+/// EXPORT: deai.plugin.lua:Proxy.on_batch(signal: :string, callback): deai:ListenHandle
+///
+/// Listen for signals in batches
+///
+/// Same as :lua:meth:`on`, except the callback is called at most once per event loop
+/// iteration, with a list of the arguments of every emission since the last call. Each
+/// element of the list is itself a list of arguments.
 static int di_lua_add_listener(lua_State *L) {
-	// Stack: [ object, string, lua closure ]
+	// Stack: [ object, string, lua closure, (filters) ]
 	bool once = lua_toboolean(L, lua_upvalueindex(1));
-	if (lua_gettop(L) != 3) {
-		return luaL_error(L, "'on' takes 3 arguments");
+	bool batch = lua_toboolean(L, lua_upvalueindex(2));
+	if (lua_gettop(L) != 3 && lua_gettop(L) != 4) {
+		return luaL_error(L, "'on' takes 3 or 4 arguments");
 	}
 	if (lua_type(L, 3) != LUA_TFUNCTION) {
 		return luaL_argerror(L, 3, "not a function");
@@ -1211,6 +1308,19 @@ static int di_lua_add_listener(lua_State *L) {
 		return luaL_argerror(L, 1, "not a di object");
 	}
 
+	struct di_signal_filter filters[DI_LUA_MAX_SIGNAL_FILTERS];
+	unsigned int nfilters = 0;
+	bool has_filters = lua_gettop(L) == 4 && !lua_isnil(L, 4);
+	if (has_filters) {
+		if (batch) {
+			return luaL_argerror(L, 4, "batched listeners can't have filters");
+		}
+		if (lua_type(L, 4) != LUA_TTABLE) {
+			return luaL_argerror(L, 4, "not a table");
+		}
+		nfilters = di_lua_get_signal_filters(L, 4, filters);
+	}
+
 	di_object *listen_handle = NULL, *error = NULL;
 
 	// Create a scope so things are properly freed before we touch dangerous lua_error.
@@ -1221,7 +1331,7 @@ static int di_lua_add_listener(lua_State *L) {
 		signame = di_clone_string(signame);
 
 		scoped_di_object *handler =
-		    (di_object *)lua_type_to_di_object(L, -1, call_lua_function);
+		    (di_object *)lua_type_to_di_object(L, 3, call_lua_function);
 
 		if (once) {
 			auto wrapped_handler = di_new_object_with_type2(
@@ -1231,8 +1341,22 @@ static int di_lua_add_listener(lua_State *L) {
 			handler = (di_object *)wrapped_handler;
 		}
 
+		if (has_filters) {
+			// Keep the filters on the stack, so the strings in them stay valid
+			lua_insert(L, 1);
+		} else {
+			lua_settop(L, 3);
+		}
 		lua_pop(L, 3);        // Pop arguments
-		listen_handle = di_listen_to(o, signame, (void *)handler, &error);
+		if (batch) {
+			listen_handle = di_listen_to_batch(o, signame, (void *)handler, &error);
+		} else if (has_filters) {
+			listen_handle = di_listen_to_filtered(o, signame, (void *)handler, filters,
+			                                      nfilters, &error);
+			lua_pop(L, 1);        // Pop filters
+		} else {
+			listen_handle = di_listen_to(o, signame, (void *)handler, &error);
+		}
 		assert((error == NULL) != (listen_handle == NULL));
 		if (once && listen_handle) {
 			di_member_clone(handler, "listen_handle", listen_handle);
@@ -1516,6 +1640,30 @@ struct di_lua_proxy_object {
 	// dummy object for documentation purposes
 };
 
+/// Number of `di_member_cache`s used by `__index`, must be a power of 2
+#define DI_LUA_INDEX_CACHE_SIZE 64
+
+/// Caches for the member names accessed through `__index`. Short strings are interned by
+/// lua, so the address of a key string picks the cache, and the same name accessed in a
+/// loop keeps hitting the same one.
+static struct di_member_cache di_lua_index_cache[DI_LUA_INDEX_CACHE_SIZE];
+
+/// Find the cache for `key`, whose string is at `lua_key` inside lua. NULL is returned if
+/// it's not worth caching.
+static struct di_member_cache *
+di_lua_index_cache_for(di_object *obj, const char *lua_key, di_string key) {
+	auto cache = &di_lua_index_cache[((uintptr_t)lua_key >> 4) & (DI_LUA_INDEX_CACHE_SIZE - 1)];
+	if (cache->atom != NULL && di_string_eq(cache->atom->name, key)) {
+		return cache;
+	}
+	// Only intern names that are actually members, anything could be used as a key.
+	if (di_lookup(obj, key) == NULL) {
+		return NULL;
+	}
+	*cache = (struct di_member_cache){.atom = di_intern(key)};
+	return cache;
+}
+
 static int di_lua_meta_index(lua_State *L) {
 	if (lua_gettop(L) != 2) {
 		return luaL_error(L, "wrong number of arguments to __index");
@@ -1531,6 +1679,7 @@ static int di_lua_meta_index(lua_State *L) {
 	{
 		scoped_di_string key = DI_STRING_INIT;
 		key.data = lua_tolstring(L, 2, &key.length);
+		const char *lua_key = key.data;
 		key = di_clone_string(key);
 
 		scoped_di_object *ud = di_ref_object(*(di_object **)lua_touserdata(L, 1));
@@ -1539,12 +1688,20 @@ static int di_lua_meta_index(lua_State *L) {
 		// Handle the special methods
 		if (di_string_eq(key, di_string_borrow_literal("on"))) {
 			lua_pushboolean(L, false);
-			lua_pushcclosure(L, di_lua_add_listener, 1);
+			lua_pushboolean(L, false);
+			lua_pushcclosure(L, di_lua_add_listener, 2);
 			return 1;
 		}
 		if (di_string_eq(key, di_string_borrow_literal("once"))) {
 			lua_pushboolean(L, true);
-			lua_pushcclosure(L, di_lua_add_listener, 1);
+			lua_pushboolean(L, false);
+			lua_pushcclosure(L, di_lua_add_listener, 2);
+			return 1;
+		}
+		if (di_string_eq(key, di_string_borrow_literal("on_batch"))) {
+			lua_pushboolean(L, false);
+			lua_pushboolean(L, true);
+			lua_pushcclosure(L, di_lua_add_listener, 2);
 			return 1;
 		}
 		if (di_string_eq(key, di_string_borrow_literal("emit"))) {
@@ -1558,7 +1715,12 @@ static int di_lua_meta_index(lua_State *L) {
 
 		di_type rt;
 		di_value ret;
-		rc = di_getx(ud, key, &rt, &ret, &error);
+		auto cache = di_lua_index_cache_for(ud, lua_key, key);
+		if (cache != NULL) {
+			rc = di_getx_cached(ud, cache, key, &rt, &ret, &error);
+		} else {
+			rc = di_getx(ud, key, &rt, &ret, &error);
+		}
 		if (rc != 0) {
 			lua_pushnil(L);
 			return 1;
@@ -17,6 +17,9 @@
 #include <stdio.h>
 #include <xcb/randr.h>
 
+static const char output_type[] = "deai.plugin.xorg.randr:Output";
+static const char view_type[] = "deai.plugin.xorg.randr:View";
+
 struct di_xorg_randr {
 	struct di_xorg_ext;
 
@@ -682,16 +685,8 @@ static int get_output_max_backlight(struct di_xorg_output *o) {
 static di_object *make_object_for_output(struct di_xorg_randr *rr, xcb_randr_output_t oid) {
 	DI_CHECK(di_has_member(rr, XORG_CONNECTION_MEMBER));
 
-	auto obj =
-	    di_new_object_with_type2(struct di_xorg_output, "deai.plugin.xorg.randr:Output");
+	auto obj = di_new_object_with_type2(struct di_xorg_output, output_type);
 	obj->id = oid;
-	di_field(obj, id);
-	di_getter(obj, current_view, get_output_current_view);
-	di_getter(obj, views, get_output_views);
-	di_getter(obj, info, get_output_info);
-	di_getter_setter(obj, backlight, get_output_backlight, set_output_backlight);
-	di_getter(obj, max_backlight, get_output_max_backlight);
-	di_getter(obj, props, get_output_props_object);
 
 	di_member_clone(obj, "___randr", (di_object *)rr);
 	return (void *)obj;
@@ -733,19 +728,28 @@ static di_array get_view_outputs(struct di_xorg_view *v) {
 static di_object *make_object_for_view(struct di_xorg_randr *rr, xcb_randr_crtc_t cid) {
 	DI_CHECK(di_has_member(rr, XORG_CONNECTION_MEMBER));
 
-	auto obj =
-	    di_new_object_with_type2(struct di_xorg_view, "deai.plugin.xorg.randr:View");
+	auto obj = di_new_object_with_type2(struct di_xorg_view, view_type);
 	obj->id = cid;
 
-	di_getter(obj, outputs, get_view_outputs);
-	di_field(obj, id);
-	di_getter_setter(obj, config, get_view_config, set_view_config);
-
 	di_member_clone(obj, "___randr", (di_object *)rr);
 
 	return (void *)obj;
 }
 
+void init_randr_types(void) {
+	di_type_field(output_type, struct di_xorg_output, id);
+	di_type_getter(output_type, current_view, get_output_current_view);
+	di_type_getter(output_type, views, get_output_views);
+	di_type_getter(output_type, info, get_output_info);
+	di_type_getter_setter(output_type, backlight, get_output_backlight, set_output_backlight);
+	di_type_getter(output_type, max_backlight, get_output_max_backlight);
+	di_type_getter(output_type, props, get_output_props_object);
+
+	di_type_getter(view_type, outputs, get_view_outputs);
+	di_type_field(view_type, struct di_xorg_view, id);
+	di_type_getter_setter(view_type, config, get_view_config, set_view_config);
+}
+
 /// SIGNAL: deai.plugin.xorg:RandrExt.output-change(output) An output's configuration changed
 ///
 /// Arguments:
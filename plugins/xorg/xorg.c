@@ -69,6 +69,43 @@ struct {
     {NULL, NULL},
 };
 
+/// Atom of the signal emitted for raw X event `ev`
+static const struct di_atom *raw_event_atom(xcb_generic_event_t *ev) {
+	static const struct di_atom *core_event_atoms[256];
+	static const struct di_atom *ge_event_atoms[64];
+	if (ev->response_type == XCB_GE_GENERIC) {
+		auto gev = (xcb_ge_generic_event_t *)ev;
+		if (gev->event_type < ARRAY_SIZE(ge_event_atoms) &&
+		    ge_event_atoms[gev->event_type] != NULL) {
+			return ge_event_atoms[gev->event_type];
+		}
+		scoped_di_string event_name =
+		    di_string_printf("___raw_x_event_ge_%d", gev->event_type);
+		auto ret = di_intern(event_name);
+		if (gev->event_type < ARRAY_SIZE(ge_event_atoms)) {
+			ge_event_atoms[gev->event_type] = ret;
+		}
+		return ret;
+	}
+	if (core_event_atoms[ev->response_type] == NULL) {
+		scoped_di_string event_name =
+		    di_string_printf("___raw_x_event_%d", ev->response_type);
+		core_event_atoms[ev->response_type] = di_intern(event_name);
+	}
+	return core_event_atoms[ev->response_type];
+}
+
+/// Atom of the connection member that keeps the `i`-th extension alive
+static const struct di_atom *strong_ext_atom(int i) {
+	static const struct di_atom *atoms[ARRAY_SIZE(xext_reg)];
+	if (atoms[i] == NULL) {
+		scoped_di_string ext_key =
+		    di_string_printf("___strong_x_ext_%s", xext_reg[i].name);
+		atoms[i] = di_intern(ext_key);
+	}
+	return atoms[i];
+}
+
 static void di_xorg_ioev(di_object *dc_obj) {
 	// di_get_log(dc->x->di);
 	// di_log_va((void *)log, DI_LOG_DEBUG, "xcb ioev\n");
@@ -78,31 +115,23 @@ static void di_xorg_ioev(di_object *dc_obj) {
 	while ((ev = xcb_poll_for_event(dc->c))) {
 		// handle event
 		{
-			scoped_di_string event_name = DI_STRING_INIT;
-			if (ev->response_type == XCB_GE_GENERIC) {
-				auto gev = (xcb_ge_generic_event_t *)ev;
-				event_name = di_string_printf("___raw_x_event_ge_%d", gev->event_type);
-			} else {
-				event_name = di_string_printf("___raw_x_event_%d", ev->response_type);
-			}
 			di_value tmp;
 			tmp.pointer = ev;
-			di_emitn((void *)dc, event_name,
-			         (di_tuple){
-			             .length = 1,
-			             .elements =
-			                 &(struct di_variant){
-			                     .type = DI_TYPE_POINTER,
-			                     .value = &tmp,
-			                 },
-			         });
+			di_emitn_atom((void *)dc, raw_event_atom(ev),
+			              (di_tuple){
+			                  .length = 1,
+			                  .elements =
+			                      &(struct di_variant){
+			                          .type = DI_TYPE_POINTER,
+			                          .value = &tmp,
+			                      },
+			              });
 		}
 
 		for (int i = 0; xext_reg[i].name != NULL; i++) {
 			// Only strongly referenced ext have signal listerners.
-			scoped_di_string ext_key = di_string_printf("___strong_x_ext_%s", xext_reg[i].name);
 			scoped_di_object *ext_obj = NULL;
-			if (di_get2(dc_obj, ext_key, ext_obj) != 0) {
+			if (di_get_atom(dc_obj, strong_ext_atom(i), ext_obj) != 0) {
 				continue;
 			}
 			struct di_xorg_ext *ext = (void *)ext_obj;
@@ -743,6 +772,7 @@ static struct di_module *new_xorg_module(di_object *di) {
 }
 
 DEAI_PLUGIN_ENTRY_POINT(di) {
+	init_randr_types();
 	auto x = new_xorg_module(di);
 	di_register_module(di, di_string_borrow_literal("xorg"), &x);
 }
@@ -95,6 +95,8 @@ xcb_atom_t di_xorg_intern_atom(struct di_xorg_connection *nonnull xc, di_string
 
 struct di_xorg_ext *nullable new_xinput(struct di_xorg_connection *nonnull);
 struct di_xorg_ext *nullable new_randr(struct di_xorg_connection *nonnull);
+/// Register the members shared by all randr output and view objects
+void init_randr_types(void);
 struct di_xorg_ext *nullable new_key(struct di_xorg_connection *nonnull);
 /// Increment the signal count and start fdevent when necessary
 void di_xorg_add_signal(struct di_xorg_connection *nonnull);
@@ -0,0 +1,250 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <deai/helper.h>
+
+#include "slab.h"
+#include "utils.h"
+
+#if defined(__SANITIZE_ADDRESS__) || __has_feature(address_sanitizer)
+#include <sanitizer/asan_interface.h>
+#define POISON(addr, size) ASAN_POISON_MEMORY_REGION(addr, size)
+#define UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+#define POISON(addr, size) ((void)(addr), (void)(size))
+#define UNPOISON(addr, size) ((void)(addr), (void)(size))
+#endif
+
+/// Slabs are aligned to their size, so the slab a block belongs to can be found by
+/// masking the block's address.
+#define DI_SLAB_SIZE ((size_t)64 * 1024)
+
+static const size_t block_sizes[] = {32, 64, 128, 192, 256, 384, 512, 768, 1024};
+#define NCLASSES ARRAY_SIZE(block_sizes)
+
+struct di_slab_block {
+	struct di_slab_block *nullable next;
+};
+
+struct di_slab_pool;
+struct di_slab {
+	struct di_slab *nullable next;
+	/// The pool this slab is carved into
+	struct di_slab_pool *nonnull pool;
+	/// Number of blocks of this slab that are currently handed out, only touched by the
+	/// thread owning the pool.
+	uint32_t in_use;
+	alignas(DI_SLAB_ALIGN) char blocks[];
+};
+
+struct di_slab_pool {
+	struct di_slab *nullable slabs;
+	struct di_slab_block *nullable freelist;
+	struct di_slab_stats stats;
+	/// Blocks freed by other threads, moved to `freelist` by the owning thread
+	_Atomic(struct di_slab_block *) remote_frees;
+};
+
+struct di_slab_pools {
+	struct di_slab_pools *nullable next;
+	struct di_slab_pool classes[NCLASSES];
+};
+
+/// Pools of all threads. Pools are never freed, other threads could still be returning
+/// blocks to them after their thread exits.
+static _Atomic(struct di_slab_pools *) all_pools = NULL;
+static thread_local struct di_slab_pool *pools = NULL;
+
+static struct di_slab_pool *di_slab_pools(void) {
+	if (pools == NULL) {
+		struct di_slab_pools *new_pools = tmalloc(struct di_slab_pools, 1);
+		new_pools->next = atomic_load(&all_pools);
+		while (!atomic_compare_exchange_weak(&all_pools, &new_pools->next, new_pools)) {
+		}
+		pools = new_pools->classes;
+	}
+	return pools;
+}
+
+unsigned int di_slab_class(size_t size) {
+	for (unsigned int i = 0; i < NCLASSES; i++) {
+		if (size <= block_sizes[i]) {
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+static inline struct di_slab *di_slab_of(void *ptr) {
+	return (struct di_slab *)((uintptr_t)ptr & ~(DI_SLAB_SIZE - 1));
+}
+
+static void di_slab_grow(struct di_slab_pool *pool, size_t block_size) {
+	struct di_slab *slab = aligned_alloc(DI_SLAB_SIZE, DI_SLAB_SIZE);
+	DI_CHECK(slab != NULL);
+	slab->next = pool->slabs;
+	slab->pool = pool;
+	slab->in_use = 0;
+	pool->slabs = slab;
+	pool->stats.nslabs++;
+
+	size_t nblocks = (DI_SLAB_SIZE - offsetof(struct di_slab, blocks)) / block_size;
+	// Push the blocks in reverse, so they are handed out in address order
+	for (size_t i = nblocks; i > 0; i--) {
+		struct di_slab_block *block = (void *)(slab->blocks + (i - 1) * block_size);
+		block->next = pool->freelist;
+		pool->freelist = block;
+		POISON(block, block_size);
+	}
+	pool->stats.free += nblocks;
+}
+
+/// Return a block to the freelist of the pool owning it. Must be called on the thread
+/// owning the pool.
+static void di_slab_free_local(struct di_slab_pool *pool, struct di_slab_block *block,
+                               size_t block_size) {
+	block->next = pool->freelist;
+	pool->freelist = block;
+	POISON(block, block_size);
+
+	auto slab = di_slab_of(block);
+	assert(slab->in_use > 0);
+	slab->in_use--;
+	pool->stats.free++;
+	pool->stats.in_use--;
+}
+
+/// Take back the blocks of `pool` freed by other threads
+static void di_slab_collect_remote_frees(struct di_slab_pool *pool, size_t block_size) {
+	auto block =
+	    atomic_exchange_explicit(&pool->remote_frees, NULL, memory_order_acquire);
+	while (block != NULL) {
+		auto next = block->next;
+		di_slab_free_local(pool, block, block_size);
+		block = next;
+	}
+}
+
+void *di_slab_alloc(unsigned int cls) {
+	assert(cls > 0 && cls <= NCLASSES);
+	auto pool = &di_slab_pools()[cls - 1];
+	auto block_size = block_sizes[cls - 1];
+	if (pool->freelist == NULL) {
+		di_slab_collect_remote_frees(pool, block_size);
+	}
+	if (pool->freelist == NULL) {
+		di_slab_grow(pool, block_size);
+	}
+
+	auto block = pool->freelist;
+	UNPOISON(block, block_size);
+	pool->freelist = block->next;
+	di_slab_of(block)->in_use++;
+	pool->stats.free--;
+	pool->stats.in_use++;
+	return block;
+}
+
+void di_slab_free(void *ptr, unsigned int cls) {
+	assert(cls > 0 && cls <= NCLASSES);
+	struct di_slab_block *block = ptr;
+	auto pool = di_slab_of(ptr)->pool;
+	if (pool == &di_slab_pools()[cls - 1]) {
+		di_slab_free_local(pool, block, block_sizes[cls - 1]);
+		return;
+	}
+
+	// The block was allocated by another thread, hand it back to that thread's pool.
+	// Only poison past `next`, the owner could take it as soon as it's pushed.
+	POISON((char *)block + sizeof(*block), block_sizes[cls - 1] - sizeof(*block));
+	block->next = atomic_load_explicit(&pool->remote_frees, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&pool->remote_frees, &block->next,
+	                                              block, memory_order_release,
+	                                              memory_order_relaxed)) {
+	}
+}
+
+unsigned int di_slab_get_stats(struct di_slab_stats *stats, unsigned int nstats) {
+	auto pools = di_slab_pools();
+	for (unsigned int i = 0; stats != NULL && i < nstats && i < NCLASSES; i++) {
+		di_slab_collect_remote_frees(&pools[i], block_sizes[i]);
+		stats[i] = pools[i].stats;
+		stats[i].block_size = block_sizes[i];
+	}
+	return NCLASSES;
+}
+
+di_array di_slab_stats_array(void) {
+	struct di_slab_stats stats[NCLASSES];
+	di_slab_get_stats(stats, NCLASSES);
+
+	di_array ret = {
+	    .length = NCLASSES,
+	    .elem_type = DI_TYPE_OBJECT,
+	    .arr = tmalloc(di_object *, NCLASSES),
+	};
+	di_object **arr = ret.arr;
+	for (unsigned int i = 0; i < NCLASSES; i++) {
+		arr[i] = di_new_object_with_type(di_object);
+		di_set_type(arr[i], "deai:SlabStats");
+		DI_CHECK_OK(di_member_clone(arr[i], "block_size", (uint64_t)stats[i].block_size));
+		DI_CHECK_OK(di_member_clone(arr[i], "nslabs", stats[i].nslabs));
+		DI_CHECK_OK(di_member_clone(arr[i], "in_use", stats[i].in_use));
+		DI_CHECK_OK(di_member_clone(arr[i], "free", stats[i].free));
+	}
+	return ret;
+}
+
+void di_slab_release_unused(void) {
+	auto pools = di_slab_pools();
+	for (unsigned int i = 0; i < NCLASSES; i++) {
+		auto pool = &pools[i];
+		auto block_size = block_sizes[i];
+		di_slab_collect_remote_frees(pool, block_size);
+
+		// Drop blocks of empty slabs from the freelist first
+		struct di_slab_block *block = pool->freelist, *tail = NULL;
+		pool->freelist = NULL;
+		while (block != NULL) {
+			UNPOISON(block, block_size);
+			auto next = block->next;
+			if (di_slab_of(block)->in_use == 0) {
+				pool->stats.free--;
+			} else {
+				block->next = NULL;
+				if (tail != NULL) {
+					UNPOISON(tail, block_size);
+					tail->next = block;
+					POISON(tail, block_size);
+				} else {
+					pool->freelist = block;
+				}
+				tail = block;
+			}
+			POISON(block, block_size);
+			block = next;
+		}
+
+		struct di_slab **slab = &pool->slabs;
+		while (*slab != NULL) {
+			auto curr = *slab;
+			if (curr->in_use == 0) {
+				*slab = curr->next;
+				UNPOISON(curr, DI_SLAB_SIZE);
+				free(curr);
+				pool->stats.nslabs--;
+			} else {
+				slab = &curr->next;
+			}
+		}
+	}
+}
@@ -0,0 +1,50 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deai/object.h>
+
+/// Size class pools for small, frequently allocated memory blocks, e.g. object headers
+/// and member tables. Blocks are carved out of larger slabs, and freed blocks are kept in
+/// a per size class freelist for reuse, instead of being returned to malloc.
+///
+/// Pools are thread local. Blocks freed on a thread other than the one that allocated
+/// them are handed back to the allocating thread's pool, which takes them back the next
+/// time it runs out of free blocks.
+
+/// Alignment of all blocks returned by `di_slab_alloc`
+#define DI_SLAB_ALIGN alignof(max_align_t)
+
+struct di_slab_stats {
+	/// Size of blocks in this size class
+	size_t block_size;
+	/// Number of slabs allocated for this size class
+	uint64_t nslabs;
+	/// Number of blocks currently handed out
+	uint64_t in_use;
+	/// Number of blocks in the freelist
+	uint64_t free;
+};
+
+/// Find the size class for blocks of `size` bytes. Returns 0 if blocks this big are not
+/// pooled and should be allocated with malloc instead.
+unsigned int di_slab_class(size_t size);
+/// Allocate a block from size class `cls`, which must be a value returned by
+/// `di_slab_class`. The returned memory is not initialized.
+void *nonnull di_slab_alloc(unsigned int cls);
+/// Return a block to the size class `cls` it was allocated from.
+void di_slab_free(void *nonnull ptr, unsigned int cls);
+
+/// Get the occupancy of every size class. Returns the number of size classes, and if
+/// `stats` is not NULL, fill in at most `nstats` entries of it.
+unsigned int di_slab_get_stats(struct di_slab_stats *nullable stats, unsigned int nstats);
+/// Create an array of objects describing the occupancy of every size class.
+di_array di_slab_stats_array(void);
+/// Free all slabs of this thread that have no blocks in use.
+void di_slab_release_unused(void);
@@ -20,9 +20,12 @@
 #include <deai/helper.h>
 
 #include "di_internal.h"
+#include "loop_stats.h"
 #include "spawn.h"
 #include "string_buf.h"
 
+static const char child_process_type[] = "deai.builtin.spawn:ChildProcess";
+
 /// Object type: ChildProcess
 ///
 /// Represent a child process. When recycled, the child process will be left running. To
@@ -103,6 +106,7 @@ static void sigchld_handler(EV_P_ ev_child *w, int revents) {
 	struct child *c = container_of(w, struct child, w);
 	// Keep child process object alive when emitting
 	scoped_di_object unused *obj = di_ref_object((di_object *)c);
+	auto start = di_loop_stats_begin();
 
 	int sig = 0;
 	if (WIFSIGNALED(w->rstatus)) {
@@ -127,6 +131,7 @@ static void sigchld_handler(EV_P_ ev_child *w, int revents) {
 	di_delete_member((void *)c, di_string_borrow_literal("__signal_stdout_line"), NULL);
 	di_delete_member((void *)c, di_string_borrow_literal("__signal_stderr_line"), NULL);
 	di_delete_member((void *)c, di_string_borrow_literal("__signal_exit"), NULL);
+	di_loop_stats_end(DI_LOOP_SOURCE_CHILD_EXIT, start);
 }
 
 static void child_destroy(di_object *obj) {
@@ -149,7 +154,9 @@ static void child_destroy(di_object *obj) {
 static void output_cb(di_object *obj, int id) {
 	auto c = (struct child *)obj;
 	assert(c->output_buf[id]);
+	auto start = di_loop_stats_begin();
 	output_handler(c, c->fds[id], id, SIGNAL_NAME[id]);
+	di_loop_stats_end(DI_LOOP_SOURCE_CHILD_OUTPUT, start);
 }
 
 /// Pid of the child process
@@ -230,9 +237,7 @@ static void di_child_process_new_exit_signal(di_object *p, di_object *sig) {
 	ev_child_init(&child->w, sigchld_handler, child->pid, 0);
 	ev_child_start(di->loop, &child->w);
 
-	auto roots = di_get_roots();
-	scoped_di_string child_root_key = di_string_printf("child_process_%d", child->pid);
-	DI_CHECK_OK(di_call(roots, "add", child_root_key, p));
+	di_pin_object(p);
 }
 
 static void di_child_start_output_listener(di_object *p, int id) {
@@ -295,9 +300,7 @@ static void di_child_process_delete_exit_signal(di_object *obj) {
 	ev_child_stop(EV_A_ & c->w);
 
 	// We as a fundamental event source has stopped, so remove roots and unref core.
-	auto roots = di_get_roots();
-	scoped_di_string child_root_key = di_string_printf("child_process_%d", c->pid);
-	DI_CHECK_OK(di_call(roots, "remove", child_root_key));
+	di_unpin_object((di_object *)c);
 }
 
 static void di_child_process_stop_output_listener(di_object *obj, int id) {
@@ -388,16 +391,8 @@ di_object *di_spawn_run(struct di_spawn *p, di_array argv, bool ignore_output) {
 	}
 
 	auto cp = di_new_object_with_type(struct child);
-	di_set_type((di_object *)cp, "deai.builtin.spawn:ChildProcess");
+	di_set_type((di_object *)cp, child_process_type);
 	di_set_object_dtor((di_object *)cp, child_destroy);
-	di_method(cp, "__get_pid", get_child_pid);
-	di_method(cp, "kill", kill_child, int);
-	di_method(cp, "__set___signal_exit", di_child_process_new_exit_signal, di_object *);
-	di_method(cp, "__set___signal_stdout_line", di_child_process_new_stdout_signal, di_object *);
-	di_method(cp, "__set___signal_stderr_line", di_child_process_new_stderr_signal, di_object *);
-	di_method(cp, "__delete___signal_exit", di_child_process_delete_exit_signal);
-	di_method(cp, "__delete___signal_stdout_line", di_child_process_delete_stdout_signal);
-	di_method(cp, "__delete___signal_stderr_line", di_child_process_delete_stderr_signal);
 
 	cp->pid = pid;
 	cp->fds[0] = opfds[0];
@@ -425,5 +420,20 @@ void di_init_spawn(di_object *di) {
 	auto m = di_new_module_with_size(di, sizeof(struct di_spawn));
 	di_method(m, "run", di_spawn_run, di_array, bool);
 
+	di_type_method(child_process_type, "__get_pid", get_child_pid);
+	di_type_method(child_process_type, "kill", kill_child, int);
+	di_type_method(child_process_type, "__set___signal_exit",
+	               di_child_process_new_exit_signal, di_object *);
+	di_type_method(child_process_type, "__set___signal_stdout_line",
+	               di_child_process_new_stdout_signal, di_object *);
+	di_type_method(child_process_type, "__set___signal_stderr_line",
+	               di_child_process_new_stderr_signal, di_object *);
+	di_type_method(child_process_type, "__delete___signal_exit",
+	               di_child_process_delete_exit_signal);
+	di_type_method(child_process_type, "__delete___signal_stdout_line",
+	               di_child_process_delete_stdout_signal);
+	di_type_method(child_process_type, "__delete___signal_stderr_line",
+	               di_child_process_delete_stderr_signal);
+
 	di_register_module(di, di_string_borrow_literal("spawn"), &m);
 }
@@ -0,0 +1,370 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#include <deai/builtins/event.h>
+#include <deai/deai.h>
+#include <deai/error.h>
+#include <deai/helper.h>
+#include <deai/type.h>
+
+#include <ev.h>
+
+#include "di_internal.h"
+#include "loop_stats.h"
+#include "stream.h"
+
+enum di_stream_op {
+	DI_STREAM_DEBOUNCE,
+	DI_STREAM_THROTTLE,
+	DI_STREAM_COALESCE,
+	DI_STREAM_BUFFER,
+	DI_STREAM_MERGE,
+};
+
+/// An event stream
+///
+/// TYPE: deai.builtin.event:Stream
+///
+/// Created by the stream operators of the event module. The "sources" member holds the
+/// objects whose signals are processed, and the emissions waiting to be forwarded are kept
+/// in the "pending" member.
+///
+/// SIGNAL: deai.builtin.event:Stream.event(...) Emitted by the operator. The arguments are
+/// those of the source signal, except for `buffer`, whose stream emits an array of the
+/// argument lists.
+struct di_stream {
+	di_object_internal;
+	/// The event loop of di, kept here so the timer can be stopped by the destructor.
+	struct ev_loop *loop;
+	ev_timer timer;
+	enum di_stream_op op;
+	/// Argument used as the key by `coalesce`
+	unsigned int key;
+	/// Maximum number of emissions `buffer` holds
+	unsigned int count;
+};
+
+static const char stream_type[] = "deai.builtin.event:Stream";
+
+/// Get the array of pending emissions, creating it if it doesn't exist.
+static di_array *di_stream_pending(struct di_stream *s) {
+	auto m = di_lookup((di_object *)s, di_string_borrow_literal("pending"));
+	if (m == NULL) {
+		DI_CHECK_OK(di_add_member_move((di_object *)s, di_string_borrow_literal("pending"),
+		                               (di_type[]){DI_TYPE_ARRAY},
+		                               (di_array[]){{
+		                                   .arr = NULL,
+		                                   .length = 0,
+		                                   .elem_type = DI_TYPE_TUPLE,
+		                               }}));
+		m = di_lookup((di_object *)s, di_string_borrow_literal("pending"));
+	}
+	return &m->value.array;
+}
+
+/// Store a copy of `args` as the `index`th pending emission, `index` can be one past the
+/// end.
+static void di_stream_set_pending(struct di_stream *s, uint64_t index, di_tuple args) {
+	auto pending = di_stream_pending(s);
+	di_tuple *arr = pending->arr;
+	if (index == pending->length) {
+		pending->arr = arr = trealloc(arr, pending->length + 1);
+		pending->length++;
+	} else {
+		di_free_tuple(arr[index]);
+	}
+	di_copy_value(DI_TYPE_TUPLE, &arr[index], &args);
+}
+
+/// Take the pending emissions out of the stream.
+static di_array di_stream_take_pending(struct di_stream *s) {
+	di_variant pending;
+	if (di_remove_member_raw((di_object *)s, di_string_borrow_literal("pending"),
+	                         &pending) != 0) {
+		return (di_array){.length = 0, .arr = NULL, .elem_type = DI_TYPE_TUPLE};
+	}
+	di_array ret = pending.value->array;
+	free(pending.value);
+	return ret;
+}
+
+static bool di_stream_key_as_string(di_variant key, di_string *ret) {
+	if (key.type == DI_TYPE_STRING) {
+		*ret = key.value->string;
+		return true;
+	}
+	if (key.type == DI_TYPE_STRING_LITERAL) {
+		*ret = di_string_borrow(key.value->string_literal);
+		return true;
+	}
+	return false;
+}
+
+static bool di_stream_key_equal(di_variant a, di_variant b) {
+	di_string sa, sb;
+	if (di_stream_key_as_string(a, &sa) && di_stream_key_as_string(b, &sb)) {
+		return di_string_eq(sa, sb);
+	}
+	int64_t ia, ib;
+	if (di_int_conversion(a.type, a.value, 64, false, &ia) == 0 &&
+	    di_int_conversion(b.type, b.value, 64, false, &ib) == 0) {
+		return ia == ib;
+	}
+	if (a.type == DI_TYPE_OBJECT && b.type == DI_TYPE_OBJECT) {
+		return a.value->object == b.value->object;
+	}
+	return a.type == b.type && di_sizeof_type(a.type) == 0;
+}
+
+/// Forward the pending emissions.
+static void di_stream_flush(struct di_stream *s) {
+	auto pending = di_stream_take_pending(s);
+	if (pending.length == 0) {
+		di_free_array(pending);
+		return;
+	}
+	if (s->op == DI_STREAM_BUFFER) {
+		di_emit(s, "event", pending);
+	} else {
+		di_tuple *arr = pending.arr;
+		for (uint64_t i = 0; i < pending.length; i++) {
+			di_emitn((di_object *)s, di_string_borrow_literal("event"), arr[i]);
+		}
+	}
+	di_free_array(pending);
+}
+
+static void di_stream_timer_callback(EV_P_ ev_timer *t, int revents) {
+	auto s = container_of(t, struct di_stream, timer);
+	// Listeners might stop the stream
+	scoped_di_object *obj = di_ref_object((di_object *)s);
+
+	ev_timer_stop(EV_A_ t);
+	if (s->op == DI_STREAM_THROTTLE) {
+		auto pending = di_stream_pending(s);
+		if (pending->length == 0) {
+			// Nothing happened during the window, the next emission is forwarded
+			// right away.
+			return;
+		}
+		// Start the next window
+		ev_timer_again(EV_A_ t);
+	}
+	auto start = di_loop_stats_begin();
+	di_stream_flush(s);
+	di_loop_stats_end(DI_LOOP_SOURCE_STREAM, start);
+}
+
+/// Handle an emission from one of the sources.
+static void di_stream_push(struct di_stream *s, di_tuple args) {
+	auto loop = s->loop;
+	di_array *pending;
+	switch (s->op) {
+	case DI_STREAM_MERGE:
+		di_emitn((di_object *)s, di_string_borrow_literal("event"), args);
+		return;
+	case DI_STREAM_DEBOUNCE:
+		di_stream_set_pending(s, 0, args);
+		ev_timer_again(loop, &s->timer);
+		return;
+	case DI_STREAM_THROTTLE:
+		if (!ev_is_active(&s->timer)) {
+			ev_timer_again(loop, &s->timer);
+			di_emitn((di_object *)s, di_string_borrow_literal("event"), args);
+		} else {
+			di_stream_set_pending(s, 0, args);
+		}
+		return;
+	case DI_STREAM_COALESCE:
+		pending = di_stream_pending(s);
+		uint64_t index = pending->length;
+		for (uint64_t i = 0; i < pending->length && s->key < args.length; i++) {
+			di_tuple *arr = pending->arr;
+			if (s->key < arr[i].length &&
+			    di_stream_key_equal(arr[i].elements[s->key], args.elements[s->key])) {
+				index = i;
+				break;
+			}
+		}
+		di_stream_set_pending(s, index, args);
+		if (!ev_is_active(&s->timer)) {
+			ev_timer_again(loop, &s->timer);
+		}
+		return;
+	case DI_STREAM_BUFFER:
+		pending = di_stream_pending(s);
+		di_stream_set_pending(s, pending->length, args);
+		if (s->count != 0 && pending->length >= s->count) {
+			ev_timer_stop(loop, &s->timer);
+			di_stream_flush(s);
+		} else if (s->timer.repeat > 0 && !ev_is_active(&s->timer)) {
+			ev_timer_again(loop, &s->timer);
+		}
+		return;
+	}
+}
+
+static int
+di_stream_handler_call(di_object *obj, di_type *rt, di_value *unused ret, di_tuple args) {
+	scoped_di_object *stream = NULL;
+	DI_CHECK_OK(di_get(obj, "stream", stream));
+	di_stream_push((struct di_stream *)stream, args);
+	*rt = DI_TYPE_NIL;
+	return 0;
+}
+
+/// Stop listening to the sources, and drop the pending emissions.
+static void di_stream_stop(di_object *o) {
+	auto s = (struct di_stream *)o;
+	// The timer could still be running even if the stream is not listening, e.g. when
+	// this is called as the destructor of a stopped stream.
+	ev_timer_stop(s->loop, &s->timer);
+	di_delete_member_raw(o, di_string_borrow_literal("pending"));
+	// Dropping the handles stops the listeners
+	di_delete_member_raw(o, di_string_borrow_literal("__listen_handles"));
+}
+
+static void di_stream_delete_signal(di_object *o) {
+	if (di_delete_member_raw(o, di_string_borrow_literal("__signal_event")) != 0) {
+		return;
+	}
+	di_stream_stop(o);
+}
+
+static void di_stream_add_signal(di_object *o, di_object *sig) {
+	if (di_member_clone(o, "__signal_event", sig) != 0) {
+		return;
+	}
+
+	di_array sources;
+	scoped_di_string signal = DI_STRING_INIT;
+	DI_CHECK_OK(di_get(o, "sources", sources));
+	DI_CHECK_OK(di_get(o, "source_signal", signal));
+
+	// The handler keeps the stream alive while the sources are alive.
+	scoped_di_object *handler = di_new_object_with_type(di_object);
+	di_set_object_call(handler, di_stream_handler_call);
+	DI_CHECK_OK(di_member_clone(handler, "stream", o));
+
+	di_array handles = {
+	    .length = sources.length,
+	    .elem_type = DI_TYPE_OBJECT,
+	    .arr = tmalloc(di_object *, sources.length),
+	};
+	di_object **handles_arr = handles.arr;
+	di_object **sources_arr = sources.arr;
+	for (uint64_t i = 0; i < sources.length; i++) {
+		handles_arr[i] = di_listen_to(sources_arr[i], signal, handler, NULL);
+		DI_CHECK_OK(di_call(handles_arr[i], "auto_stop", true));
+	}
+	di_free_array(sources);
+	DI_CHECK_OK(di_member(o, "__listen_handles", handles));
+}
+
+static di_object *
+di_new_stream(di_object *event_module, enum di_stream_op op, di_array sources, di_string signal) {
+	auto di_obj = di_module_get_deai((struct di_module *)event_module);
+	if (di_obj == NULL) {
+		di_throw(di_new_error("deai is shutting down..."));
+	}
+	if (sources.length == 0 || sources.elem_type != DI_TYPE_OBJECT) {
+		di_unref_object(di_obj);
+		di_throw(di_new_error("Streams need at least one source object"));
+	}
+
+	auto s = di_new_object_with_type2(struct di_stream, stream_type);
+	s->op = op;
+	s->loop = ((struct deai *)di_obj)->loop;
+	ev_timer_init(&s->timer, di_stream_timer_callback, 0, 0);
+	s->dtor = di_stream_stop;
+	di_signal_setter_deleter(s, "event", di_stream_add_signal, di_stream_delete_signal);
+
+	// Streams have strong references to di, for the event loop.
+	di_member(s, DEAI_MEMBER_NAME_RAW, di_obj);
+	DI_CHECK_OK(di_member_clone(s, "sources", sources));
+	DI_CHECK_OK(di_member_clone(s, "source_signal", signal));
+	return (di_object *)s;
+}
+
+static di_object *di_new_timed_stream(di_object *event_module, enum di_stream_op op,
+                                      di_object *source, di_string signal, double interval) {
+	if (interval <= 0 && op != DI_STREAM_BUFFER) {
+		di_throw(di_new_error("Interval must be positive"));
+	}
+	di_array sources = {.length = 1, .elem_type = DI_TYPE_OBJECT, .arr = &source};
+	auto s = (struct di_stream *)di_new_stream(event_module, op, sources, signal);
+	s->timer.repeat = interval > 0 ? interval : 0;
+	return (di_object *)s;
+}
+
+/// Debounce a signal
+///
+/// EXPORT: event.debounce(source: deai:Object, signal: :string, interval: :float):
+/// deai.builtin.event:Stream
+///
+/// The stream emits the last emission of `signal` from `source`, once `source` has been
+/// quiet for `interval` seconds.
+di_object *di_event_debounce(di_object *event_module, di_object *source, di_string signal,
+                             double interval) {
+	return di_new_timed_stream(event_module, DI_STREAM_DEBOUNCE, source, signal, interval);
+}
+
+/// Throttle a signal
+///
+/// EXPORT: event.throttle(source: deai:Object, signal: :string, interval: :float):
+/// deai.builtin.event:Stream
+///
+/// The stream emits at most once every `interval` seconds. An emission of `signal` is
+/// forwarded right away if the stream hasn't emitted for `interval` seconds, otherwise the
+/// last emission is forwarded at the end of the interval.
+di_object *di_event_throttle(di_object *event_module, di_object *source, di_string signal,
+                             double interval) {
+	return di_new_timed_stream(event_module, DI_STREAM_THROTTLE, source, signal, interval);
+}
+
+/// Coalesce emissions of a signal by key
+///
+/// EXPORT: event.coalesce(source: deai:Object, signal: :string, key: :integer, interval:
+/// :float): deai.builtin.event:Stream
+///
+/// Emissions of `signal` are collected for `interval` seconds, then forwarded. Of the
+/// emissions whose `key`-th argument (counting from 0) are equal, only the last one is
+/// forwarded.
+di_object *di_event_coalesce(di_object *event_module, di_object *source, di_string signal,
+                             unsigned int key, double interval) {
+	auto s = (struct di_stream *)di_new_timed_stream(event_module, DI_STREAM_COALESCE,
+	                                                 source, signal, interval);
+	s->key = key;
+	return (di_object *)s;
+}
+
+/// Buffer emissions of a signal
+///
+/// EXPORT: event.buffer(source: deai:Object, signal: :string, count: :integer, interval:
+/// :float): deai.builtin.event:Stream
+///
+/// Emissions of `signal` are collected, and forwarded together as an array of argument
+/// lists once there are `count` of them, or `interval` seconds after the first one. Either
+/// can be 0 to disable that condition, but not both.
+di_object *di_event_buffer(di_object *event_module, di_object *source, di_string signal,
+                           unsigned int count, double interval) {
+	if (count == 0 && interval <= 0) {
+		di_throw(di_new_error("Either count or interval must be set"));
+	}
+	auto s = (struct di_stream *)di_new_timed_stream(event_module, DI_STREAM_BUFFER, source,
+	                                                 signal, interval);
+	s->count = count;
+	return (di_object *)s;
+}
+
+/// Merge a signal from multiple sources
+///
+/// EXPORT: event.merge(sources: [deai:Object], signal: :string): deai.builtin.event:Stream
+///
+/// The stream forwards the emissions of `signal` from all of the `sources`.
+di_object *di_event_merge(di_object *event_module, di_array sources, di_string signal) {
+	return di_new_stream(event_module, DI_STREAM_MERGE, sources, signal);
+}
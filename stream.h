@@ -0,0 +1,22 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#pragma once
+#include <deai/deai.h>
+
+/// Operators that turn the emissions of a signal into a new stream of emissions, with the
+/// rate controlled natively. Each returns a "deai.builtin.event:Stream" object, which
+/// emits "event" signals, and only listens to its sources while it has listeners itself.
+
+di_object *di_event_debounce(di_object *event_module, di_object *source, di_string signal,
+                             double interval);
+di_object *di_event_throttle(di_object *event_module, di_object *source, di_string signal,
+                             double interval);
+di_object *di_event_coalesce(di_object *event_module, di_object *source, di_string signal,
+                             unsigned int key, double interval);
+di_object *di_event_buffer(di_object *event_module, di_object *source, di_string signal,
+                           unsigned int count, double interval);
+di_object *di_event_merge(di_object *event_module, di_array sources, di_string signal);
@@ -25,4 +25,33 @@ DEAI_PLUGIN_ENTRY_POINT(di) {
 	DI_CHECK(object == NULL);
 
 	di_drop_weak_ref(&weak);
+
+	// Pinning directly is the same as adding an anonymous root, and removing the pinned
+	// objects out of order must keep the others pinned.
+	di_object *objects[3];
+	for (int i = 0; i < 3; i++) {
+		objects[i] = di_new_object_with_type(di_object);
+		DI_CHECK(di_pin_object(objects[i]));
+	}
+	DI_CHECK(!di_pin_object(objects[1]));
+	di_callr(roots, "add_anonymous", added, objects[2]);
+	DI_CHECK(!added);
+
+	weak = di_weakly_ref_object(objects[0]);
+	di_unref_object(objects[0]);
+	DI_CHECK(di_unpin_object(objects[1]));
+	DI_CHECK(!di_unpin_object(objects[1]));
+	di_unref_object(objects[1]);
+	object = di_upgrade_weak_ref(weak);
+	DI_CHECK(object != NULL);
+
+	di_callr(roots, "remove_anonymous", removed, object);
+	DI_CHECK(removed);
+	di_unref_object(object);
+	object = di_upgrade_weak_ref(weak);
+	DI_CHECK(object == NULL);
+	di_drop_weak_ref(&weak);
+
+	DI_CHECK(di_unpin_object(objects[2]));
+	di_unref_object(objects[2]);
 }
@@ -0,0 +1,20 @@
+a = {}
+
+di:register_module("test_batch", a)
+calls = 0
+handle = di.test_batch:on_batch("ev", function(events)
+    calls = calls + 1
+    -- Every emission since the last call, each as a list of arguments
+    assert(#events == 3)
+    for i, args in ipairs(events) do
+        assert(args[1] == i)
+        assert(args[2] == "arg"..i)
+    end
+    assert(calls == 1)
+    handle:stop()
+    di:quit()
+end)
+di.test_batch:emit("ev", 1, "arg1")
+di.test_batch:emit("ev", 2, "arg2")
+di.test_batch:emit("ev", 3, "arg3")
+assert(calls == 0)
@@ -0,0 +1,49 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include "common.h"
+
+static di_object *event_module;
+static di_object *emitter;
+static di_object *handle;
+static int calls = 0;
+
+static void on_batch(di_array events) {
+	DI_CHECK(events.elem_type == DI_TYPE_TUPLE);
+	// The first batch has everything emitted before the loop started, the others only
+	// have the emission from the previous call.
+	DI_CHECK(events.length == (calls == 0 ? 3 : 1));
+	calls++;
+	// Emitted while delivering, this goes into the next batch, so the timer still gets
+	// to run.
+	DI_CHECK_OK(di_emit(emitter, "ev", (int64_t)calls));
+}
+
+static void check_batches(double unused now) {
+	DI_CHECK(calls >= 2);
+	DI_CHECK_OK(di_call(handle, "stop"));
+	di_unref_object(handle);
+	di_unref_object(emitter);
+	di_unref_object(event_module);
+}
+
+/// Emissions to a batched handler are delivered together once per event loop iteration,
+/// and a handler emitting to itself doesn't stop the loop from making progress.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	DI_CHECK_OK(di_get(di, "event", event_module));
+	emitter = di_new_object_with_type(di_object);
+	scoped_di_object *handler = (di_object *)di_make_closure(on_batch, (), di_array);
+	handle = di_listen_to_batch(emitter, di_string_borrow_literal("ev"), handler, NULL);
+	for (int64_t i = 0; i < 3; i++) {
+		DI_CHECK_OK(di_emit(emitter, "ev", i));
+	}
+	DI_CHECK(calls == 0);
+
+	scoped_di_object *timer = NULL;
+	DI_CHECK_OK(di_callr(event_module, "timer", timer, 0.05));
+	scoped_di_object *on_elapsed =
+	    (di_object *)di_make_closure(check_batches, (), double);
+	auto timer_handle =
+	    di_listen_to(timer, di_string_borrow_literal("elapsed"), on_elapsed, NULL);
+	di_unref_object(timer_handle);
+}
@@ -0,0 +1,87 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+
+#define NCALLS 2000000
+
+static void nop(di_object *unused o) {
+}
+
+static int64_t add(di_object *unused o, int64_t a, int64_t b) {
+	return a + b;
+}
+
+static di_object *same(di_object *unused o, di_object *p) {
+	return di_ref_object(p);
+}
+
+static uint64_t length(di_object *unused o, di_string s) {
+	return s.length;
+}
+
+static int64_t captured(int64_t c, int64_t a) {
+	return c + a;
+}
+
+static double timespec_diff(struct timespec a, struct timespec b) {
+	return (double)(b.tv_sec - a.tv_sec) + (double)(b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+static void report(const char *name, struct timespec start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("%-32s %12.0f calls/s\n", name, NCALLS / timespec_diff(start, end));
+}
+
+/// Measure the cost of calling C functions registered with `di_method`, and closures
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	scoped_di_object *o = di_new_object_with_type(di_object);
+	DI_CHECK_OK(di_method(o, "nop", nop));
+	DI_CHECK_OK(di_method(o, "add", add, int64_t, int64_t));
+	DI_CHECK_OK(di_method(o, "same", same, di_object *));
+	DI_CHECK_OK(di_method(o, "length", length, di_string));
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < NCALLS; i++) {
+		DI_CHECK_OK(di_call(o, "nop"));
+	}
+	report("(object) -> void", start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int64_t sum = 0;
+	for (int64_t i = 0; i < NCALLS; i++) {
+		DI_CHECK_OK(di_callr(o, "add", sum, sum, i));
+	}
+	report("(object, int, int) -> int", start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < NCALLS; i++) {
+		scoped_di_object *ret = NULL;
+		DI_CHECK_OK(di_callr(o, "same", ret, o));
+	}
+	report("(object, object) -> object", start);
+
+	// The argument needs a conversion, and the return type is not one of the common ones
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint64_t len = 0;
+	const char *str = "a string literal";
+	for (int i = 0; i < NCALLS; i++) {
+		DI_CHECK_OK(di_callr(o, "length", len, str));
+	}
+	report("(object, string) -> uint", start);
+
+	// Captures are passed before the arguments
+	scoped_di_object *cl = (di_object *)di_make_closure(captured, ((int64_t)1), int64_t);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int64_t i = 0; i < NCALLS; i++) {
+		di_type rt;
+		di_value ret;
+		DI_CHECK_OK(di_call_object(cl, &rt, &ret, di_make_tuple(i)));
+	}
+	report("closure (capture, int) -> int", start);
+}
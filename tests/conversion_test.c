@@ -39,4 +39,28 @@ DEAI_PLUGIN_ENTRY_POINT(di) {
 	DI_CHECK(retty == DI_TYPE_STRING);
 	DI_CHECK(strncmp(val.string.data, str_literal, val.string.length) == 0);
 	di_free_string(val.string);
+
+	// Test conversions between numbers
+	val.int_ = -1;
+	DI_CHECK(di_type_conversion(DI_TYPE_INT, &val, DI_TYPE_NUINT, &val2, true) == -EINVAL);
+	DI_CHECK_OK(di_type_conversion(DI_TYPE_INT, &val, DI_TYPE_NINT, &val2, true));
+	DI_CHECK(val2.nint == -1);
+	DI_CHECK_OK(di_type_conversion(DI_TYPE_INT, &val, DI_TYPE_FLOAT, &val2, true));
+	DI_CHECK(val2.float_ == -1.0);
+	val.uint = UINT64_MAX;
+	DI_CHECK(di_type_conversion(DI_TYPE_UINT, &val, DI_TYPE_INT, &val2, true) == -EINVAL);
+	val.float_ = 1.0;
+	DI_CHECK(di_type_conversion(DI_TYPE_FLOAT, &val, DI_TYPE_INT, &val2, true) == -EINVAL);
+
+	// Test bulk integer conversions
+	int16_t small[] = {-3, 0, 1000};
+	int64_t wide[3];
+	DI_CHECK_OK(di_int_array_conversion(small, 16, false, wide, 64, false, 3));
+	DI_CHECK(wide[0] == -3 && wide[1] == 0 && wide[2] == 1000);
+	uint8_t bytes[3] = {1, 2, 3};
+	DI_CHECK(di_int_array_conversion(wide, 64, false, bytes, 8, true, 3) == -EINVAL);
+	DI_CHECK(bytes[0] == 1 && bytes[1] == 2 && bytes[2] == 3);
+	DI_CHECK_OK(di_int_array_conversion(wide + 1, 64, false, small, 16, false, 2));
+	DI_CHECK(small[0] == 0 && small[1] == 1000);
+	DI_CHECK(di_int_array_conversion(wide, 64, false, small, 12, false, 3) == -EINVAL);
 }
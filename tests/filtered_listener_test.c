@@ -0,0 +1,116 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include "common.h"
+
+enum { STRING, PREFIX, MASK, INT_AND_BOOL, FLOAT, NLISTENERS };
+
+static int calls[NLISTENERS];
+
+static void handler(int64_t i, di_string unused str, int64_t unused n, bool unused flag,
+                    double unused f) {
+	calls[i]++;
+}
+
+static di_object *
+listen(di_object *emitter, int64_t i, const struct di_signal_filter *filters,
+       unsigned int nfilters) {
+	scoped_di_object *h = (di_object *)di_make_closure(handler, (i), di_string, int64_t,
+	                                                   bool, double);
+	di_object *error = NULL;
+	auto handle = di_listen_to_filtered(emitter, di_string_borrow_literal("ev"), h,
+	                                    filters, nfilters, &error);
+	DI_CHECK(error == NULL);
+	return handle;
+}
+
+static void emit(di_object *emitter, const char *str, int64_t n, bool flag, double f) {
+	DI_CHECK_OK(di_emit(emitter, "ev", di_string_borrow(str), n, flag, f));
+}
+
+/// Filtered listeners are only called for emissions whose arguments pass all the filters
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	scoped_di_object *emitter = di_new_object_with_type(di_object);
+	di_object *handles[NLISTENERS];
+	handles[STRING] = listen(emitter, STRING,
+	                         (struct di_signal_filter[]){{
+	                             .kind = DI_SIGNAL_FILTER_EQUAL,
+	                             .arg = 0,
+	                             .type = DI_TYPE_STRING_LITERAL,
+	                             .value = {.string_literal = "/etc/hosts"},
+	                         }},
+	                         1);
+	handles[PREFIX] = listen(emitter, PREFIX,
+	                         (struct di_signal_filter[]){{
+	                             .kind = DI_SIGNAL_FILTER_PREFIX,
+	                             .arg = 0,
+	                             .type = DI_TYPE_STRING_LITERAL,
+	                             .value = {.string_literal = "/etc/"},
+	                         }},
+	                         1);
+	handles[MASK] = listen(emitter, MASK,
+	                       (struct di_signal_filter[]){{
+	                           .kind = DI_SIGNAL_FILTER_MASK,
+	                           .arg = 1,
+	                           .type = DI_TYPE_INT,
+	                           .value = {.int_ = 0x6},
+	                       }},
+	                       1);
+	// All filters have to pass
+	handles[INT_AND_BOOL] = listen(emitter, INT_AND_BOOL,
+	                               (struct di_signal_filter[]){
+	                                   {
+	                                       .kind = DI_SIGNAL_FILTER_EQUAL,
+	                                       .arg = 1,
+	                                       .type = DI_TYPE_INT,
+	                                       .value = {.int_ = 2},
+	                                   },
+	                                   {
+	                                       .kind = DI_SIGNAL_FILTER_EQUAL,
+	                                       .arg = 2,
+	                                       .type = DI_TYPE_BOOL,
+	                                       .value = {.bool_ = true},
+	                                   },
+	                               },
+	                               2);
+	handles[FLOAT] = listen(emitter, FLOAT,
+	                        (struct di_signal_filter[]){{
+	                            .kind = DI_SIGNAL_FILTER_EQUAL,
+	                            .arg = 3,
+	                            .type = DI_TYPE_FLOAT,
+	                            .value = {.float_ = 0.5},
+	                        }},
+	                        1);
+
+	emit(emitter, "/etc/hosts", 1, false, 0);
+	emit(emitter, "/etc/passwd", 2, false, 0.5);
+	emit(emitter, "/usr/lib", 2, true, 1);
+	emit(emitter, "/etc", 8, true, 0.5);
+	DI_CHECK(calls[STRING] == 1);
+	DI_CHECK(calls[PREFIX] == 2);
+	DI_CHECK(calls[MASK] == 2);
+	DI_CHECK(calls[INT_AND_BOOL] == 1);
+	DI_CHECK(calls[FLOAT] == 2);
+
+	// Emissions without the filtered argument don't pass
+	DI_CHECK_OK(di_emit(emitter, "ev"));
+	for (int i = 0; i < NLISTENERS; i++) {
+		DI_CHECK_OK(di_call(handles[i], "stop"));
+		di_unref_object(handles[i]);
+	}
+	DI_CHECK(calls[STRING] == 1 && calls[PREFIX] == 2 && calls[FLOAT] == 2);
+
+	// A prefix filter needs a string
+	di_object *error = NULL;
+	auto handle = di_listen_to_filtered(emitter, di_string_borrow_literal("ev"), emitter,
+	                                    (struct di_signal_filter[]){{
+	                                        .kind = DI_SIGNAL_FILTER_PREFIX,
+	                                        .arg = 0,
+	                                        .type = DI_TYPE_INT,
+	                                        .value = {.int_ = 1},
+	                                    }},
+	                                    1, &error);
+	DI_CHECK(handle == NULL);
+	DI_CHECK(error != NULL);
+	di_unref_object(error);
+}
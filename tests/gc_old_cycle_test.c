@@ -0,0 +1,91 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include "common.h"
+
+/// Enough candidates to make the collector do a young only collection right away
+#define NFILLERS 40
+
+static di_object *event_module;
+static di_object *fillers[NFILLERS];
+static di_object *old, *young;
+static di_weak_object *weak_old, *weak_young;
+static int step = 0;
+
+/// Make objects candidates for collection, while they are still referenced
+static void make_candidate(di_object *obj) {
+	di_ref_object(obj);
+	di_unref_object(obj);
+}
+
+/// Fillers become long lived too, so they are replaced by new ones when `fresh` is true
+static void make_fillers_candidates(bool fresh) {
+	for (int i = 0; i < NFILLERS; i++) {
+		if (fresh) {
+			di_unref_object(fillers[i]);
+			fillers[i] = di_new_object_with_type(di_object);
+		}
+		make_candidate(fillers[i]);
+	}
+}
+
+static void next_step(void);
+
+static void on_elapsed(double unused now) {
+	step++;
+	if (step <= 3) {
+		// Age `old`, it survives a young collection each time.
+		make_candidate(old);
+		make_fillers_candidates(false);
+	} else if (step == 4) {
+		young = di_new_object_with_type(di_object);
+		weak_young = di_weakly_ref_object(young);
+		DI_CHECK_OK(di_member_clone(old, "young", young));
+		DI_CHECK_OK(di_member_clone(young, "old", old));
+		// `old` becomes a long lived candidate, and is revived by a collection because
+		// `young` is still referenced.
+		di_unref_object(old);
+		old = NULL;
+	} else if (step == 5) {
+		// Now `young` is the only candidate of the cycle, and it is collected without
+		// going into `old`.
+		di_unref_object(young);
+		young = NULL;
+		make_fillers_candidates(true);
+	} else {
+		// The cycle must be collected eventually
+		scoped_di_object *o = di_upgrade_weak_ref(weak_old);
+		scoped_di_object *y = di_upgrade_weak_ref(weak_young);
+		DI_CHECK(o == NULL);
+		DI_CHECK(y == NULL);
+		di_drop_weak_ref(&weak_old);
+		di_drop_weak_ref(&weak_young);
+		for (int i = 0; i < NFILLERS; i++) {
+			di_unref_object(fillers[i]);
+		}
+		di_unref_object(event_module);
+		return;
+	}
+	next_step();
+}
+
+static void next_step(void) {
+	scoped_di_object *timer = NULL;
+	DI_CHECK_OK(di_callr(event_module, "timer", timer, 0.02));
+	scoped_di_object *handler = (di_object *)di_make_closure(on_elapsed, (), double);
+	auto listen_handle =
+	    di_listen_to(timer, di_string_borrow_literal("elapsed"), handler, NULL);
+	di_unref_object(listen_handle);
+}
+
+/// A cycle made of a long lived object and a young one is collected, even when only the
+/// young object is a candidate.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	DI_CHECK_OK(di_get(di, "event", event_module));
+	for (int i = 0; i < NFILLERS; i++) {
+		fillers[i] = di_new_object_with_type(di_object);
+	}
+	old = di_new_object_with_type(di_object);
+	weak_old = di_weakly_ref_object(old);
+	next_step();
+}
@@ -0,0 +1,57 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include <stdio.h>
+
+#include "common.h"
+
+/// More names than there are bits in the filter of an object
+#define NNAMES 100
+
+static int calls[NNAMES];
+
+static void handler(int64_t i) {
+	calls[i]++;
+}
+
+static di_string signal_name(int i) {
+	char buf[16];
+	int len = snprintf(buf, sizeof(buf), "signal%d", i);
+	return di_string_ndup(buf, (size_t)len);
+}
+
+/// Emitting signals nobody listens to is skipped, but signals somebody listens to are
+/// always delivered.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	scoped_di_object *emitter = di_new_object_with_type(di_object);
+	// Nothing is listening yet
+	DI_CHECK_OK(di_emit(emitter, "signal0", (int64_t)0));
+
+	// Listen to the even numbered signals only
+	di_object *handles[NNAMES] = {0};
+	for (int i = 0; i < NNAMES; i += 2) {
+		scoped_di_string name = signal_name(i);
+		scoped_di_object *h = (di_object *)di_make_closure(handler, ((int64_t)i));
+		handles[i] = di_listen_to(emitter, name, h, NULL);
+	}
+	for (int i = 0; i < NNAMES; i++) {
+		scoped_di_string name = signal_name(i);
+		DI_CHECK_OK(di_emitn(emitter, name, DI_TUPLE_INIT));
+	}
+	for (int i = 0; i < NNAMES; i++) {
+		int expected = i % 2 == 0 ? 1 : 0;
+		DI_CHECK(calls[i] == expected);
+	}
+
+	// Listeners added after all the others are gone are seen too
+	for (int i = 0; i < NNAMES; i += 2) {
+		DI_CHECK_OK(di_call(handles[i], "stop"));
+		di_unref_object(handles[i]);
+	}
+	scoped_di_string name = signal_name(1);
+	scoped_di_object *h = (di_object *)di_make_closure(handler, ((int64_t)1));
+	scoped_di_object *handle = di_listen_to(emitter, name, h, NULL);
+	DI_CHECK_OK(di_emitn(emitter, name, DI_TUPLE_INIT));
+	DI_CHECK(calls[1] == 1);
+	DI_CHECK_OK(di_call(handle, "stop"));
+}
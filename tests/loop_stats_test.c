@@ -0,0 +1,114 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include <time.h>
+
+#include "common.h"
+
+/// How long the output handler runs for
+#define HANDLER_TIME 0.03
+
+static di_object *event_module;
+static di_object *stats;
+static di_object *child;
+static int lines = 0;
+
+static double monotonic_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void on_line(di_string unused line) {
+	double until = monotonic_now() + HANDLER_TIME;
+	while (monotonic_now() < until) {
+	}
+	lines++;
+}
+
+static di_object *source_histogram(const char *name) {
+	scoped_di_object *sources = NULL;
+	di_object *ret = NULL;
+	DI_CHECK_OK(di_get(stats, "sources", sources));
+	DI_CHECK_OK(di_getx(sources, di_string_borrow(name), (di_type[]){DI_TYPE_OBJECT},
+	                    (di_value *)&ret, NULL));
+	return ret;
+}
+
+static void on_child_exit(int unused exit_code, int unused signal) {
+	DI_CHECK(lines == 1);
+
+	// The output is handled inside of the callback of the pipe, the time is only
+	// counted for the child output.
+	scoped_di_object *output = source_histogram("child_output");
+	scoped_di_object *ioev = source_histogram("ioev");
+	uint64_t count;
+	double total;
+	DI_CHECK_OK(di_get(output, "count", count));
+	DI_CHECK_OK(di_get(output, "total", total));
+	DI_CHECK(count >= 1);
+	DI_CHECK(total >= HANDLER_TIME);
+	DI_CHECK_OK(di_get(ioev, "count", count));
+	DI_CHECK_OK(di_get(ioev, "total", total));
+	DI_CHECK(count >= 1);
+	DI_CHECK(total < HANDLER_TIME);
+
+	scoped_di_object *timer = source_histogram("timer");
+	scoped_di_object *lag = NULL;
+	DI_CHECK_OK(di_get(timer, "count", count));
+	DI_CHECK(count >= 1);
+	DI_CHECK_OK(di_get(stats, "lag", lag));
+	DI_CHECK_OK(di_get(lag, "count", count));
+	DI_CHECK(count >= 1);
+
+	DI_CHECK_OK(di_call(stats, "reset"));
+	scoped_di_object *reset = source_histogram("child_output");
+	DI_CHECK_OK(di_get(reset, "count", count));
+	DI_CHECK(count == 0);
+
+	DI_CHECK_OK(di_setx(stats, di_string_borrow_literal("enabled"), DI_TYPE_BOOL,
+	                    (bool[]){false}, NULL));
+	di_unref_object(child);
+	di_unref_object(stats);
+	di_unref_object(event_module);
+}
+
+static void on_elapsed(double unused now) {
+}
+
+/// Callbacks of the event loop are timed, without counting nested callbacks twice.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	DI_CHECK_OK(di_get(di, "event", event_module));
+	DI_CHECK_OK(di_get(event_module, "stats", stats));
+	DI_CHECK_OK(di_setx(stats, di_string_borrow_literal("log_interval"), DI_TYPE_FLOAT,
+	                    (double[]){0}, NULL));
+	DI_CHECK_OK(di_setx(stats, di_string_borrow_literal("enabled"), DI_TYPE_BOOL,
+	                    (bool[]){true}, NULL));
+
+	scoped_di_object *spawn = NULL;
+	DI_CHECK_OK(di_get(di, "spawn", spawn));
+	// The child keeps running after writing its output, so the output is handled
+	// before the child exits.
+	di_string argv[] = {
+	    di_string_borrow_literal("sh"),
+	    di_string_borrow_literal("-c"),
+	    di_string_borrow_literal("echo line; sleep 0.2"),
+	};
+	di_array argv_arr = {.length = 3, .elem_type = DI_TYPE_STRING, .arr = argv};
+	DI_CHECK_OK(di_callr(spawn, "run", child, argv_arr, (bool)false));
+
+	scoped_di_object *line_handler = (di_object *)di_make_closure(on_line, (), di_string);
+	scoped_di_object *exit_handler =
+	    (di_object *)di_make_closure(on_child_exit, (), int, int);
+	di_unref_object(
+	    di_listen_to(child, di_string_borrow_literal("stdout_line"), line_handler, NULL));
+	di_unref_object(
+	    di_listen_to(child, di_string_borrow_literal("exit"), exit_handler, NULL));
+
+	scoped_di_object *timer = NULL;
+	DI_CHECK_OK(di_callr(event_module, "timer", timer, 0.05));
+	scoped_di_object *timer_handler =
+	    (di_object *)di_make_closure(on_elapsed, (), double);
+	di_unref_object(
+	    di_listen_to(timer, di_string_borrow_literal("elapsed"), timer_handler, NULL));
+}
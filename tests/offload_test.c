@@ -0,0 +1,63 @@
+#include <deai/builtins/event.h>
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "common.h"
+
+static di_object *deai;
+static int finished = 0;
+
+static int answer(void *unused data, di_type *rtype, di_value *ret) {
+	*rtype = DI_TYPE_INT;
+	ret->int_ = 42;
+	return 0;
+}
+
+static int fail(void *unused data, di_type *unused rtype, di_value *unused ret) {
+	return -ENOENT;
+}
+
+/// Never finishes before deai exits
+static int block(void *unused data, di_type *unused rtype, di_value *unused ret) {
+	sleep(3600);
+	return 0;
+}
+
+static void job_finished(void) {
+	if (++finished == 2) {
+		// Exiting must not wait for the blocking job
+		DI_CHECK_OK(di_call(deai, "quit"));
+		di_unref_object(deai);
+	}
+}
+
+static void on_answer(int64_t value) {
+	DI_CHECK(value == 42);
+	job_finished();
+}
+
+static void on_failure(di_object *unused error) {
+	job_finished();
+}
+
+/// Results of offloaded functions are handed back through promises, and jobs that are
+/// still running don't block deai from exiting.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	deai = di_ref_object(di);
+	scoped_di_object *event_module = NULL;
+	DI_CHECK_OK(di_get(di, "event", event_module));
+
+	scoped_di_object *blocked = di_offload(event_module, block, NULL);
+
+	scoped_di_object *resolved = di_offload(event_module, answer, NULL);
+	scoped_di_object *on_resolved = (di_object *)di_make_closure(on_answer, (), int64_t);
+	scoped_di_object *then = di_promise_then(resolved, on_resolved);
+
+	scoped_di_object *rejected = di_offload(event_module, fail, NULL);
+	scoped_di_object *on_rejected =
+	    (di_object *)di_make_closure(on_failure, (), di_object *);
+	scoped_di_object *caught = di_promise_catch(rejected, on_rejected);
+}
@@ -0,0 +1,67 @@
+#include <deai/builtins/event.h>
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include <threads.h>
+
+#include "common.h"
+
+#define NMESSAGES 1000
+
+static di_object *event_module;
+static di_object *target;
+static struct di_remote_object *remote;
+static thrd_t thread;
+static int64_t received = 0;
+
+static int post_messages(void *unused arg) {
+	for (int64_t i = 0; i < NMESSAGES; i++) {
+		auto elements = tmalloc(struct di_variant, 1);
+		elements[0] = di_alloc_variant(i);
+		di_post_signal(remote, di_string_dup("count"),
+		               (di_tuple){.length = 1, .elements = elements});
+	}
+	di_drop_remote_object(remote);
+	return 0;
+}
+
+static void on_count(int64_t i) {
+	// Posted signals are emitted in order
+	DI_CHECK(i == received);
+	received++;
+}
+
+static void check_received(double unused now) {
+	DI_CHECK(received == NMESSAGES);
+	di_unref_object(target);
+	di_unref_object(event_module);
+}
+
+static void listen_to_timer(double timeout, void (*fn)(double)) {
+	scoped_di_object *timer = NULL;
+	DI_CHECK_OK(di_callr(event_module, "timer", timer, timeout));
+	scoped_di_object *handler = (di_object *)di_make_closure(fn, (), double);
+	auto listen_handle =
+	    di_listen_to(timer, di_string_borrow_literal("elapsed"), handler, NULL);
+	di_unref_object(listen_handle);
+}
+
+static void join_thread(double unused now) {
+	DI_CHECK(thrd_join(thread, NULL) == thrd_success);
+	// Everything has been posted, give the event loop a chance to handle it
+	listen_to_timer(0.05, check_received);
+}
+
+/// Signals posted from another thread are emitted on the event loop thread.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	DI_CHECK_OK(di_get(di, "event", event_module));
+	target = di_new_object_with_type(di_object);
+	scoped_di_object *handler = (di_object *)di_make_closure(on_count, (), int64_t);
+	auto listen_handle =
+	    di_listen_to(target, di_string_borrow_literal("count"), handler, NULL);
+	di_unref_object(listen_handle);
+
+	remote = di_new_remote_object(event_module, target);
+	DI_CHECK(thrd_create(&thread, post_messages, NULL) == thrd_success);
+	listen_to_timer(0.1, join_thread);
+}
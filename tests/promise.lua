@@ -68,11 +68,52 @@ end)
 a:resolve(1)
 b:resolve(4)
 
+-- Handlers are called in the order their promises are settled
+local order = {}
+local fifo = {}
+for i = 1, 3 do
+    fifo[i] = di.event:new_promise()
+    fifo[i]:then_(function(v)
+        table.insert(order, v)
+    end)
+end
+for i = 1, 3 do
+    fifo[i]:resolve(i)
+end
+
+-- join_promises rejects if any of its promises rejects
+local join_rejected = false
+a = di.event:new_promise()
+b = di.event:new_promise()
+c = di.event:join_promises({a,b})
+c:then_(function(t)
+    print("join resolved despite rejection")
+    di:exit(1)
+end)
+:catch(function(e)
+    print("join rejected:", e)
+    if tostring(e) ~= "join" then
+        di:exit(1)
+    end
+    join_rejected = true
+end)
+a:resolve(1)
+local error = { error = "join" }
+setmetatable(error, { __tostring = function(self) return self.error end })
+b:reject(error)
+
 di.event:timer(0.5):once("elapsed", function()
-    print(resolved_1, resolved_2, resolved_c, resolved_any, resolved_chain)
+    print(resolved_1, resolved_2, resolved_c, resolved_any, resolved_chain, join_rejected)
     if not resolved_1 or not resolved_2 or not resolved_c or not resolved_any or not resolved_chain then
         di:exit(1)
     end
+    if not join_rejected then
+        di:exit(1)
+    end
+    print("order", table.concat(order, " "))
+    if #order ~= 3 or order[1] ~= 1 or order[2] ~= 2 or order[3] ~= 3 then
+        di:exit(1)
+    end
 end)
 
 unresolved = di.event:new_promise()
@@ -0,0 +1,88 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include <string.h>
+#include <threads.h>
+
+#include "common.h"
+
+static di_shared_string copies[2];
+static di_shared_array shared_array, shared_array_copy;
+
+static int share_string(void *unused arg) {
+	copies[0] = di_share_string(di_string_borrow_literal("shared between threads"));
+	copies[1] = di_shared_string_ref(copies[0]);
+	return 0;
+}
+
+static int share_array(void *unused arg) {
+	di_string *strings = tmalloc(di_string, 2);
+	strings[0] = di_string_dup("first");
+	strings[1] = di_string_dup("second");
+	shared_array = di_share_array((di_array){2, strings, DI_TYPE_STRING});
+	shared_array_copy = di_shared_array_ref(shared_array);
+	return 0;
+}
+
+static void check_strings(di_array arr, const char *first) {
+	DI_CHECK(arr.length == 2);
+	DI_CHECK(arr.elem_type == DI_TYPE_STRING);
+	di_string *strings = arr.arr;
+	DI_CHECK(di_string_eq(strings[0], di_string_borrow(first)));
+	DI_CHECK(di_string_eq(strings[1], di_string_borrow_literal("second")));
+}
+
+/// Copies of a value made on one thread can be freed on another.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	thrd_t thread;
+	DI_CHECK(thrd_create(&thread, share_string, NULL) == thrd_success);
+	DI_CHECK(thrd_join(thread, NULL) == thrd_success);
+
+	DI_CHECK(copies[0].string.data == copies[1].string.data);
+	di_shared_string_unref(copies[0]);
+	// The other copy must still be valid, and null terminated
+	DI_CHECK(di_string_eq(copies[1].string,
+	                      di_string_borrow_literal("shared between threads")));
+	DI_CHECK(strcmp(copies[1].string.data, "shared between threads") == 0);
+	di_shared_string_unref(copies[1]);
+
+	// Shared arrays are dropped on another thread, and copied when taken while they are
+	// still shared.
+	DI_CHECK(thrd_create(&thread, share_array, NULL) == thrd_success);
+	DI_CHECK(thrd_join(thread, NULL) == thrd_success);
+	DI_CHECK(shared_array_copy.array.arr == shared_array.array.arr);
+	di_shared_array_unref(shared_array_copy);
+	check_strings(shared_array.array, "first");
+
+	auto owned = di_shared_array_take(di_shared_array_ref(shared_array));
+	DI_CHECK(owned.arr != shared_array.array.arr);
+	di_string *strings = owned.arr;
+	di_free_string(strings[0]);
+	strings[0] = di_string_dup("changed");
+	check_strings(owned, "changed");
+	check_strings(shared_array.array, "first");
+	di_free_array(owned);
+
+	owned = di_shared_array_take(shared_array);
+	check_strings(owned, "first");
+	di_free_array(owned);
+
+	// Tuples are shared the same way
+	di_tuple tuple = {
+	    .length = 2,
+	    .elements = tmalloc(di_variant, 2),
+	};
+	tuple.elements[0] = di_alloc_variant((int64_t)1);
+	tuple.elements[1] = di_alloc_variant(di_string_dup("tuple"));
+	auto shared_tuple = di_share_tuple(tuple);
+	auto shared_tuple_copy = di_shared_tuple_ref(shared_tuple);
+	di_shared_tuple_unref(shared_tuple);
+	auto owned_tuple = di_shared_tuple_take(shared_tuple_copy);
+	DI_CHECK(owned_tuple.length == 2);
+	DI_CHECK(owned_tuple.elements[0].type == DI_TYPE_INT);
+	DI_CHECK(owned_tuple.elements[0].value->int_ == 1);
+	DI_CHECK(owned_tuple.elements[1].type == DI_TYPE_STRING);
+	DI_CHECK(di_string_eq(owned_tuple.elements[1].value->string,
+	                      di_string_borrow_literal("tuple")));
+	di_free_tuple(owned_tuple);
+}
@@ -0,0 +1,62 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include "common.h"
+
+static di_object *emitter;
+static di_object *handle_b, *handle_d;
+static int calls_a = 0, calls_b = 0, calls_c = 0, calls_d = 0;
+
+static void handler_d(void) {
+	calls_d++;
+}
+
+static void handler_a(void) {
+	calls_a++;
+	if (calls_a != 1) {
+		return;
+	}
+	// Remove a handler that hasn't been called yet, and add a new one, in the middle
+	// of an emission.
+	DI_CHECK_OK(di_call(handle_b, "stop"));
+	scoped_di_object *d = (di_object *)di_make_closure(handler_d, ());
+	handle_d = di_listen_to(emitter, di_string_borrow_literal("ev"), d, NULL);
+}
+
+static void handler_b(void) {
+	calls_b++;
+}
+
+static void handler_c(void) {
+	calls_c++;
+}
+
+/// Handlers are called in the order they were added. Handlers removed during an emission
+/// are not called anymore, and handlers added during an emission are only called from
+/// the next one.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	emitter = di_new_object_with_type(di_object);
+	scoped_di_object *a = (di_object *)di_make_closure(handler_a, ());
+	scoped_di_object *b = (di_object *)di_make_closure(handler_b, ());
+	scoped_di_object *c = (di_object *)di_make_closure(handler_c, ());
+	auto name = di_string_borrow_literal("ev");
+	scoped_di_object *handle_a = di_listen_to(emitter, name, a, NULL);
+	handle_b = di_listen_to(emitter, name, b, NULL);
+	scoped_di_object *handle_c = di_listen_to(emitter, name, c, NULL);
+
+	DI_CHECK_OK(di_emit(emitter, "ev"));
+	DI_CHECK(calls_a == 1 && calls_b == 0 && calls_c == 1 && calls_d == 0);
+
+	DI_CHECK_OK(di_emit(emitter, "ev"));
+	DI_CHECK(calls_a == 2 && calls_b == 0 && calls_c == 2 && calls_d == 1);
+
+	// Stopping a handler twice is harmless
+	DI_CHECK_OK(di_call(handle_b, "stop"));
+	DI_CHECK_OK(di_call(handle_d, "stop"));
+	DI_CHECK_OK(di_emit(emitter, "ev"));
+	DI_CHECK(calls_a == 3 && calls_c == 3 && calls_d == 1);
+
+	di_unref_object(handle_b);
+	di_unref_object(handle_d);
+	di_unref_object(emitter);
+}
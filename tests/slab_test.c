@@ -0,0 +1,50 @@
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include <threads.h>
+
+#include "common.h"
+
+#define NOBJECTS 1000
+
+static di_object *objects[NOBJECTS];
+
+static int allocate_objects(void *unused arg) {
+	for (int i = 0; i < NOBJECTS; i++) {
+		objects[i] = di_new_object_with_type(di_object);
+	}
+	return 0;
+}
+
+/// Number of pooled blocks in use on this thread
+static uint64_t blocks_in_use(di_object *di) {
+	scoped_di_object *stats = NULL;
+	di_array slab;
+	DI_CHECK_OK(di_get(di, "stats", stats));
+	DI_CHECK_OK(di_get(stats, "slab", slab));
+	uint64_t ret = 0;
+	for (uint64_t i = 0; i < slab.length; i++) {
+		uint64_t in_use;
+		DI_CHECK_OK(di_get(((di_object **)slab.arr)[i], "in_use", in_use));
+		ret += in_use;
+	}
+	di_free_array(slab);
+	return ret;
+}
+
+/// Objects allocated on one thread and freed on another are returned to the pool they
+/// came from.
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	uint64_t before = blocks_in_use(di);
+
+	thrd_t thread;
+	DI_CHECK(thrd_create(&thread, allocate_objects, NULL) == thrd_success);
+	DI_CHECK(thrd_join(thread, NULL) == thrd_success);
+	for (int i = 0; i < NOBJECTS; i++) {
+		di_unref_object(objects[i]);
+	}
+
+	// Nothing was allocated from the pools of this thread, so nothing should be freed
+	// into them either.
+	DI_CHECK(blocks_in_use(di) == before);
+}
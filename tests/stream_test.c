@@ -0,0 +1,104 @@
+#include <string.h>
+
+#include <deai/deai.h>
+#include <deai/helper.h>
+
+#include "common.h"
+
+static di_object *event_module;
+static di_weak_object *weak_stopped, *weak_running;
+static int merged = 0;
+static int debounced = 0;
+
+static void on_merged(int64_t unused value) {
+	merged++;
+}
+
+static void on_debounced(int64_t unused value) {
+	debounced++;
+}
+
+static di_object *new_stream(const char *op, di_object *src, di_object *handler,
+                             di_object **handle) {
+	di_object *stream = NULL;
+	if (strcmp(op, "merge") == 0) {
+		di_array sources = {.length = 1, .elem_type = DI_TYPE_OBJECT, .arr = &src};
+		DI_CHECK_OK(di_callr(event_module, "merge", stream, sources,
+		                     di_string_borrow_literal("ev")));
+	} else {
+		DI_CHECK_OK(di_callr(event_module, op, stream, src,
+		                     di_string_borrow_literal("ev"), 0.1));
+	}
+	*handle = di_listen_to(stream, di_string_borrow_literal("event"), handler, NULL);
+	return stream;
+}
+
+/// Stopping the only listener of a stream stops it from listening to its sources, so
+/// listening again doesn't duplicate the emissions.
+static void test_stop_and_listen_again(void) {
+	scoped_di_object *src = di_new_object_with_type(di_object);
+	scoped_di_object *handler = (di_object *)di_make_closure(on_merged, (), int64_t);
+	di_object *handle;
+	scoped_di_object *stream = new_stream("merge", src, handler, &handle);
+
+	for (int i = 1; i <= 3; i++) {
+		DI_CHECK_OK(di_emit(src, "ev", (int64_t)i));
+		DI_CHECK(merged == i);
+		DI_CHECK_OK(di_call(handle, "stop"));
+		di_unref_object(handle);
+
+		DI_CHECK_OK(di_emit(src, "ev", (int64_t)i));
+		DI_CHECK(merged == i);
+		handle = di_listen_to(stream, di_string_borrow_literal("event"), handler, NULL);
+	}
+	DI_CHECK_OK(di_call(handle, "stop"));
+	di_unref_object(handle);
+}
+
+/// Streams with a running timer are collected once they are no longer referenced, and
+/// don't fire afterwards.
+static void test_collect_streams(void) {
+	scoped_di_object *src = di_new_object_with_type(di_object);
+	scoped_di_object *handler = (di_object *)di_make_closure(on_debounced, (), int64_t);
+
+	// A stopped stream doesn't arm its timer when its source emits
+	di_object *handle;
+	scoped_di_object *stopped = new_stream("debounce", src, handler, &handle);
+	DI_CHECK_OK(di_emit(src, "ev", (int64_t)1));
+	DI_CHECK_OK(di_call(handle, "stop"));
+	di_unref_object(handle);
+	DI_CHECK_OK(di_emit(src, "ev", (int64_t)2));
+	weak_stopped = di_weakly_ref_object(stopped);
+
+	// A stream that is still listened to, with its timer armed. The listen handle is
+	// dropped without being stopped, so the stream and its source form a cycle.
+	scoped_di_object *running = new_stream("debounce", src, handler, &handle);
+	DI_CHECK_OK(di_emit(src, "ev", (int64_t)3));
+	di_unref_object(handle);
+	weak_running = di_weakly_ref_object(running);
+}
+
+static void check_collected(double unused now) {
+	scoped_di_object *stopped = di_upgrade_weak_ref(weak_stopped);
+	scoped_di_object *running = di_upgrade_weak_ref(weak_running);
+	DI_CHECK(stopped == NULL);
+	DI_CHECK(running == NULL);
+	DI_CHECK(debounced == 0);
+	di_drop_weak_ref(&weak_stopped);
+	di_drop_weak_ref(&weak_running);
+	di_unref_object(event_module);
+}
+
+DEAI_PLUGIN_ENTRY_POINT(di) {
+	DI_CHECK_OK(di_get(di, "event", event_module));
+	test_stop_and_listen_again();
+	test_collect_streams();
+
+	scoped_di_object *timer = NULL;
+	DI_CHECK_OK(di_callr(event_module, "timer", timer, 0.3));
+	scoped_di_object *on_elapsed =
+	    (di_object *)di_make_closure(check_collected, (), double);
+	auto timer_handle =
+	    di_listen_to(timer, di_string_borrow_literal("elapsed"), on_elapsed, NULL);
+	di_unref_object(timer_handle);
+}
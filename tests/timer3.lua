@@ -0,0 +1,64 @@
+-- Many timers sharing the timer wheel, some due in the same tick
+di.event.timer_slack = 0.01
+if di.event.timer_slack ~= 0.01 then
+    di:exit(1)
+end
+
+local fired = 0
+local latest = 0
+for i = 1, 1000 do
+    local timeout = (i % 50) / 100
+    di.event:timer(timeout):once("elapsed", function()
+        -- Timers fire in the order they are due, give or take the slack
+        if timeout + 0.01 < latest then
+            di:exit(1)
+        end
+        if timeout > latest then
+            latest = timeout
+        end
+        fired = fired + 1
+    end)
+end
+
+-- With a much shorter tick, the same timers are spread over all levels of the wheel, and
+-- the longest ones don't fit in it at all. They have to be moved down as they get closer,
+-- and still fire in order, on time.
+local timeouts = { 0.000005, 0.0003, 0.002, 0.02, 0.3, 1.0, 1.8 }
+local deep_fired = 0
+di.event:timer(0):once("elapsed", function(start)
+    -- Changing the tick moves all the started timers into a new wheel
+    di.event.timer_slack = 0.0000001
+    for i, timeout in ipairs(timeouts) do
+        di.event:timer(timeout):once("elapsed", function(now)
+            print("deep timer", timeout, now - start)
+            if now < start + timeout - 0.000001 or now > start + timeout + 0.1 then
+                di:exit(1)
+            end
+            if deep_fired ~= i - 1 then
+                di:exit(1)
+            end
+            deep_fired = i
+        end)
+    end
+end)
+
+-- A stopped timer never fires
+local stopped = di.event:timer(0.1)
+local lh = stopped:on("elapsed", function()
+    di:exit(1)
+end)
+lh:stop()
+
+di.event:timer(1):once("elapsed", function()
+    if fired ~= 1000 then
+        di:exit(1)
+    end
+    print("all fired")
+end)
+
+di.event:timer(2.2):once("elapsed", function()
+    if deep_fired ~= #timeouts then
+        di:exit(1)
+    end
+    print("all deep timers fired")
+end)
@@ -0,0 +1,29 @@
+-- Write a trace, and check it looks like a trace event JSON array
+local path = os.tmpname()
+if di.trace:start(path) ~= 0 or not di.trace.enabled then
+    di:exit(1)
+end
+-- Only one trace at a time
+if di.trace:start(path) == 0 then
+    di:exit(1)
+end
+
+-- Recorded as an emission, and a call to a lua function
+di.event:timer(0.05):once("elapsed", function() end)
+di.event:timer(0.1):once("elapsed", function()
+    di.trace:stop()
+    if di.trace.enabled then
+        di:exit(1)
+    end
+
+    local file = io.open(path)
+    local content = file:read("*a")
+    file:close()
+    os.remove(path)
+    if not content:match("^%[.*\"ph\":\"X\".*%]%s*$") or
+       not content:find("\"name\":\"emit\"", 1, true) or
+       not content:find("\"name\":\"lua\"", 1, true) then
+        di:exit(1)
+    end
+    print("trace written")
+end)
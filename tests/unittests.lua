@@ -4,4 +4,5 @@ function run_unit_tests(obj)
     end
 end
 
+run_unit_tests(di)
 run_unit_tests(di.dbus)
@@ -0,0 +1,200 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "timer_wheel.h"
+
+// Level `l` has slots spanning DI_TIMER_WHEEL_SLOTS^l ticks each. An entry is put in the
+// coarsest level whose slot still starts after the current tick, and is moved to a finer
+// level when the start of its slot is reached.
+
+/// Slot index of entries beyond the last level
+#define DI_TIMER_WHEEL_OVERFLOW (DI_TIMER_WHEEL_LEVELS * DI_TIMER_WHEEL_SLOTS)
+/// Slot index of entries moved to a list of expired entries
+#define DI_TIMER_WHEEL_EXPIRED (DI_TIMER_WHEEL_OVERFLOW + 1)
+/// Slot index of entries not in any wheel
+#define DI_TIMER_WHEEL_NONE (DI_TIMER_WHEEL_OVERFLOW + 2)
+
+static inline unsigned int di_timer_wheel_shift(unsigned int level) {
+	return level * DI_TIMER_WHEEL_BITS;
+}
+
+static inline uint64_t rotate_right(uint64_t x, unsigned int n) {
+	return (x >> n) | (x << ((64 - n) & 63));
+}
+
+void di_timer_wheel_init(struct di_timer_wheel *wheel, uint64_t now) {
+	wheel->now = now;
+	wheel->count = 0;
+	for (unsigned int l = 0; l < DI_TIMER_WHEEL_LEVELS; l++) {
+		wheel->occupied[l] = 0;
+		for (unsigned int i = 0; i < DI_TIMER_WHEEL_SLOTS; i++) {
+			INIT_LIST_HEAD(&wheel->slots[l][i]);
+		}
+	}
+	INIT_LIST_HEAD(&wheel->overflow);
+}
+
+void di_timer_wheel_entry_init(struct di_timer_wheel_entry *entry) {
+	INIT_LIST_HEAD(&entry->siblings);
+	entry->expiry = 0;
+	entry->slot = DI_TIMER_WHEEL_NONE;
+}
+
+bool di_timer_wheel_entry_pending(const struct di_timer_wheel_entry *entry) {
+	return entry->slot != DI_TIMER_WHEEL_NONE;
+}
+
+/// Put an entry into the slot for its expiry, which must not be before the current tick.
+static void di_timer_wheel_place(struct di_timer_wheel *wheel,
+                                 struct di_timer_wheel_entry *entry) {
+	assert(entry->expiry >= wheel->now);
+	uint64_t delta = entry->expiry - wheel->now;
+	for (unsigned int l = 0; l < DI_TIMER_WHEEL_LEVELS; l++) {
+		if (delta >> di_timer_wheel_shift(l + 1) == 0) {
+			unsigned int index =
+			    (entry->expiry >> di_timer_wheel_shift(l)) & (DI_TIMER_WHEEL_SLOTS - 1);
+			list_add_tail(&entry->siblings, &wheel->slots[l][index]);
+			wheel->occupied[l] |= UINT64_C(1) << index;
+			entry->slot = l * DI_TIMER_WHEEL_SLOTS + index;
+			return;
+		}
+	}
+	list_add_tail(&entry->siblings, &wheel->overflow);
+	entry->slot = DI_TIMER_WHEEL_OVERFLOW;
+}
+
+void di_timer_wheel_add(struct di_timer_wheel *wheel, struct di_timer_wheel_entry *entry,
+                        uint64_t expiry) {
+	di_timer_wheel_remove(wheel, entry);
+	// The slot of the current tick has already been processed
+	entry->expiry = expiry > wheel->now ? expiry : wheel->now + 1;
+	di_timer_wheel_place(wheel, entry);
+	wheel->count++;
+}
+
+void di_timer_wheel_remove(struct di_timer_wheel *wheel,
+                           struct di_timer_wheel_entry *entry) {
+	if (entry->slot == DI_TIMER_WHEEL_NONE) {
+		return;
+	}
+	list_del_init(&entry->siblings);
+	if (entry->slot < DI_TIMER_WHEEL_OVERFLOW) {
+		unsigned int l = entry->slot / DI_TIMER_WHEEL_SLOTS;
+		unsigned int index = entry->slot % DI_TIMER_WHEEL_SLOTS;
+		if (list_empty(&wheel->slots[l][index])) {
+			wheel->occupied[l] &= ~(UINT64_C(1) << index);
+		}
+	}
+	if (entry->slot != DI_TIMER_WHEEL_EXPIRED) {
+		wheel->count--;
+	}
+	entry->slot = DI_TIMER_WHEEL_NONE;
+}
+
+uint64_t di_timer_wheel_next(const struct di_timer_wheel *wheel) {
+	if (wheel->count == 0) {
+		return UINT64_MAX;
+	}
+	uint64_t next = UINT64_MAX;
+	for (unsigned int l = 0; l < DI_TIMER_WHEEL_LEVELS; l++) {
+		if (wheel->occupied[l] == 0) {
+			continue;
+		}
+		// Slots of this level are processed when the current tick reaches their start,
+		// look for the first non-empty one after the current tick.
+		uint64_t base = (wheel->now >> di_timer_wheel_shift(l)) + 1;
+		uint64_t pending =
+		    rotate_right(wheel->occupied[l], base & (DI_TIMER_WHEEL_SLOTS - 1));
+		uint64_t tick = (base + (uint64_t)__builtin_ctzll(pending))
+		                << di_timer_wheel_shift(l);
+		if (tick < next) {
+			next = tick;
+		}
+	}
+	if (!list_empty(&wheel->overflow)) {
+		uint64_t tick = ((wheel->now >> di_timer_wheel_shift(DI_TIMER_WHEEL_LEVELS)) + 1)
+		                << di_timer_wheel_shift(DI_TIMER_WHEEL_LEVELS);
+		if (tick < next) {
+			next = tick;
+		}
+	}
+	return next;
+}
+
+/// Put all entries of `list` into the slots for their expiry again
+static void di_timer_wheel_cascade(struct di_timer_wheel *wheel, struct list_head *list) {
+	struct list_head entries;
+	INIT_LIST_HEAD(&entries);
+	list_splice_init(list, &entries);
+	struct di_timer_wheel_entry *entry, *next;
+	list_for_each_entry_safe (entry, next, &entries, siblings) {
+		di_timer_wheel_place(wheel, entry);
+	}
+}
+
+void di_timer_wheel_advance(struct di_timer_wheel *wheel, uint64_t now,
+                            struct list_head *expired) {
+	while (true) {
+		uint64_t tick = di_timer_wheel_next(wheel);
+		if (tick > now) {
+			break;
+		}
+		wheel->now = tick;
+
+		// Move entries down from the coarser levels first, some of them could be due
+		// in this very tick.
+		uint64_t top_mask =
+		    (UINT64_C(1) << di_timer_wheel_shift(DI_TIMER_WHEEL_LEVELS)) - 1;
+		if ((tick & top_mask) == 0) {
+			di_timer_wheel_cascade(wheel, &wheel->overflow);
+		}
+		for (unsigned int l = DI_TIMER_WHEEL_LEVELS - 1; l > 0; l--) {
+			uint64_t mask = (UINT64_C(1) << di_timer_wheel_shift(l)) - 1;
+			if ((tick & mask) != 0) {
+				continue;
+			}
+			unsigned int index =
+			    (tick >> di_timer_wheel_shift(l)) & (DI_TIMER_WHEEL_SLOTS - 1);
+			wheel->occupied[l] &= ~(UINT64_C(1) << index);
+			di_timer_wheel_cascade(wheel, &wheel->slots[l][index]);
+		}
+
+		unsigned int index = tick & (DI_TIMER_WHEEL_SLOTS - 1);
+		struct di_timer_wheel_entry *entry;
+		list_for_each_entry (entry, &wheel->slots[0][index], siblings) {
+			assert(entry->expiry == tick);
+			entry->slot = DI_TIMER_WHEEL_EXPIRED;
+			wheel->count--;
+		}
+		wheel->occupied[0] &= ~(UINT64_C(1) << index);
+		list_splice_tail_init(&wheel->slots[0][index], expired);
+	}
+	if (now > wheel->now) {
+		wheel->now = now;
+	}
+}
+
+void di_timer_wheel_drain(struct di_timer_wheel *wheel, struct list_head *entries) {
+	for (unsigned int l = 0; l < DI_TIMER_WHEEL_LEVELS; l++) {
+		for (unsigned int i = 0; i < DI_TIMER_WHEEL_SLOTS; i++) {
+			struct di_timer_wheel_entry *entry;
+			list_for_each_entry (entry, &wheel->slots[l][i], siblings) {
+				entry->slot = DI_TIMER_WHEEL_EXPIRED;
+			}
+			list_splice_tail_init(&wheel->slots[l][i], entries);
+		}
+		wheel->occupied[l] = 0;
+	}
+	struct di_timer_wheel_entry *entry;
+	list_for_each_entry (entry, &wheel->overflow, siblings) {
+		entry->slot = DI_TIMER_WHEEL_EXPIRED;
+	}
+	list_splice_tail_init(&wheel->overflow, entries);
+	wheel->count = 0;
+}
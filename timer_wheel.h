@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "list.h"
+
+/// A hierarchical timer wheel. Time is measured in ticks, entries due in the same tick
+/// expire together. Adding and removing entries are O(1), entries far in the future are
+/// moved to finer levels as their expiry approaches.
+
+#define DI_TIMER_WHEEL_BITS 6
+#define DI_TIMER_WHEEL_SLOTS (1 << DI_TIMER_WHEEL_BITS)
+#define DI_TIMER_WHEEL_LEVELS 4
+
+struct di_timer_wheel_entry {
+	struct list_head siblings;
+	/// The tick this entry expires at
+	uint64_t expiry;
+	/// Index of the slot this entry is in, see `di_timer_wheel_entry_init`
+	unsigned int slot;
+};
+
+struct di_timer_wheel {
+	/// The last tick that has been processed
+	uint64_t now;
+	/// Number of entries in the wheel
+	unsigned int count;
+	/// Bitmap of non-empty slots, for each level
+	uint64_t occupied[DI_TIMER_WHEEL_LEVELS];
+	struct list_head slots[DI_TIMER_WHEEL_LEVELS][DI_TIMER_WHEEL_SLOTS];
+	/// Entries too far in the future for any of the levels
+	struct list_head overflow;
+};
+
+/// Initialize an empty wheel, whose current tick is `now`.
+void di_timer_wheel_init(struct di_timer_wheel *wheel, uint64_t now);
+/// Initialize an entry that is not in any wheel.
+void di_timer_wheel_entry_init(struct di_timer_wheel_entry *entry);
+/// Whether the entry is in a wheel, or in a list of expired entries not yet handled.
+bool di_timer_wheel_entry_pending(const struct di_timer_wheel_entry *entry);
+/// Add an entry to expire at tick `expiry`. Entries that are already due expire in the
+/// next tick.
+void di_timer_wheel_add(struct di_timer_wheel *wheel, struct di_timer_wheel_entry *entry,
+                        uint64_t expiry);
+/// Remove an entry from the wheel, or from the list of expired entries it was moved to.
+/// Does nothing if the entry is not pending.
+void di_timer_wheel_remove(struct di_timer_wheel *wheel,
+                           struct di_timer_wheel_entry *entry);
+/// Advance the wheel to tick `now`, and move all entries expired by then to the end of
+/// `expired`, in the order of their expiry.
+void di_timer_wheel_advance(struct di_timer_wheel *wheel, uint64_t now,
+                            struct list_head *expired);
+/// The earliest tick at which `di_timer_wheel_advance` has work to do, this could be
+/// earlier than the expiry of any entry. Returns UINT64_MAX if the wheel is empty.
+uint64_t di_timer_wheel_next(const struct di_timer_wheel *wheel);
+/// Remove all entries from the wheel, and append them to `entries`, as if they have all
+/// expired.
+void di_timer_wheel_drain(struct di_timer_wheel *wheel, struct list_head *entries);
@@ -0,0 +1,338 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deai/builtins/log.h>
+#include <deai/helper.h>
+#include <deai/trace.h>
+
+#include "common.h"
+#include "di_internal.h"
+#include "list.h"
+
+/// Number of spans each thread can buffer, must be a power of 2. Spans recorded while
+/// the buffer is full are dropped.
+#define DI_TRACE_BUFFER_SIZE 8192
+#define DI_TRACE_DETAIL_SIZE 40
+/// How often, in milliseconds, the writer thread flushes the buffers
+#define DI_TRACE_FLUSH_INTERVAL 100
+
+struct di_trace_span {
+	const char *name;
+	uint64_t start;
+	uint64_t duration;
+	char detail[DI_TRACE_DETAIL_SIZE];
+};
+
+/// A single producer, single consumer ring buffer. Spans are added by the thread owning
+/// the buffer, and taken out by the writer thread.
+struct di_trace_buffer {
+	struct list_head siblings;
+	pid_t tid;
+	/// Position of the next span to be added, only written by the owning thread
+	atomic_uint_fast64_t head;
+	/// Position of the next span to be written out, only written by the writer thread
+	atomic_uint_fast64_t tail;
+	atomic_uint_fast64_t dropped;
+	struct di_trace_span spans[DI_TRACE_BUFFER_SIZE];
+};
+
+atomic_bool di_tracing = false;
+
+/// Threads keep using their buffers across tracing sessions. A buffer is freed when its
+/// thread exits, by the destructor of `thread_buffer_key`.
+static thread_local struct di_trace_buffer *thread_buffer = NULL;
+static tss_t thread_buffer_key;
+
+static struct {
+	/// Protects `buffers`, and the file while the writer thread is running
+	mtx_t lock;
+	cnd_t wake;
+	/// All the buffers ever created
+	struct list_head buffers;
+	FILE *out;
+	thrd_t writer;
+	bool running;
+	bool quit;
+	/// Whether no span has been written yet in this session
+	bool first;
+	/// Timestamps in the file are relative to this
+	uint64_t origin;
+} tracer;
+
+uint64_t di_trace_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static struct di_trace_buffer *di_trace_thread_buffer(void) {
+	if (thread_buffer == NULL) {
+		thread_buffer = tmalloc(struct di_trace_buffer, 1);
+		thread_buffer->tid = gettid();
+		mtx_lock(&tracer.lock);
+		list_add_tail(&thread_buffer->siblings, &tracer.buffers);
+		mtx_unlock(&tracer.lock);
+		tss_set(thread_buffer_key, thread_buffer);
+	}
+	return thread_buffer;
+}
+
+void di_trace_end(const char *name, di_string detail, uint64_t start) {
+	// Tracing could be stopped by the span itself
+	if (start == 0 || !atomic_load_explicit(&di_tracing, memory_order_relaxed)) {
+		return;
+	}
+	uint64_t end = di_trace_now();
+	auto buf = di_trace_thread_buffer();
+	auto head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+	auto tail = atomic_load_explicit(&buf->tail, memory_order_acquire);
+	if (head - tail >= DI_TRACE_BUFFER_SIZE) {
+		atomic_fetch_add_explicit(&buf->dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	auto span = &buf->spans[head % DI_TRACE_BUFFER_SIZE];
+	span->name = name;
+	span->start = start;
+	span->duration = end - start;
+	size_t len = detail.length < DI_TRACE_DETAIL_SIZE - 1 ? detail.length
+	                                                         : DI_TRACE_DETAIL_SIZE - 1;
+	if (len != 0) {
+		memcpy(span->detail, detail.data, len);
+	}
+	span->detail[len] = '\0';
+	atomic_store_explicit(&buf->head, head + 1, memory_order_release);
+
+	if (head + 1 - tail == DI_TRACE_BUFFER_SIZE / 2) {
+		// Don't wait for the next flush, the writer could miss this, but it will wake
+		// up on its own anyway.
+		cnd_signal(&tracer.wake);
+	}
+}
+
+static void di_trace_write_string(FILE *out, const char *str) {
+	fputc('"', out);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			fputc('\\', out);
+			fputc(*str, out);
+		} else if ((unsigned char)*str < 0x20) {
+			fprintf(out, "\\u%04x", (unsigned char)*str);
+		} else {
+			fputc(*str, out);
+		}
+	}
+	fputc('"', out);
+}
+
+/// Write out the spans buffered in `buf`. Called with the lock held, while the trace file
+/// is open.
+static void di_trace_flush_buffer(struct di_trace_buffer *buf) {
+	pid_t pid = getpid();
+	auto tail = atomic_load_explicit(&buf->tail, memory_order_relaxed);
+	auto head = atomic_load_explicit(&buf->head, memory_order_acquire);
+	for (; tail != head; tail++) {
+		auto span = &buf->spans[tail % DI_TRACE_BUFFER_SIZE];
+		fputs(tracer.first ? "\n" : ",\n", tracer.out);
+		tracer.first = false;
+		fputs("{\"name\":", tracer.out);
+		di_trace_write_string(tracer.out, span->name);
+		fprintf(tracer.out,
+		        ",\"cat\":\"deai\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+		        "\"tid\":%d",
+		        (double)(int64_t)(span->start - tracer.origin) / 1e3,
+		        (double)span->duration / 1e3, pid, buf->tid);
+		if (span->detail[0] != '\0') {
+			fputs(",\"args\":{\"detail\":", tracer.out);
+			di_trace_write_string(tracer.out, span->detail);
+			fputc('}', tracer.out);
+		}
+		fputc('}', tracer.out);
+	}
+	atomic_store_explicit(&buf->tail, tail, memory_order_release);
+}
+
+/// Write out all buffered spans. Called with the lock held, while the trace file is open.
+static void di_trace_flush(void) {
+	struct di_trace_buffer *buf;
+	list_for_each_entry (buf, &tracer.buffers, siblings) {
+		di_trace_flush_buffer(buf);
+	}
+	fflush(tracer.out);
+}
+
+/// Destructor of `thread_buffer_key`, called when a thread that recorded spans exits.
+static void di_trace_thread_exit(void *data) {
+	struct di_trace_buffer *buf = data;
+	mtx_lock(&tracer.lock);
+	if (tracer.out != NULL) {
+		// Keep the spans recorded by this thread
+		di_trace_flush_buffer(buf);
+	}
+	list_del(&buf->siblings);
+	mtx_unlock(&tracer.lock);
+	free(buf);
+}
+
+static int di_trace_writer_main(void *unused arg) {
+	mtx_lock(&tracer.lock);
+	while (!tracer.quit) {
+		struct timespec deadline;
+		timespec_get(&deadline, TIME_UTC);
+		deadline.tv_nsec += DI_TRACE_FLUSH_INTERVAL * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		cnd_timedwait(&tracer.wake, &tracer.lock, &deadline);
+		di_trace_flush();
+	}
+	mtx_unlock(&tracer.lock);
+	return 0;
+}
+
+static uint64_t di_trace_dropped(void) {
+	uint64_t dropped = 0;
+	struct di_trace_buffer *buf;
+	mtx_lock(&tracer.lock);
+	list_for_each_entry (buf, &tracer.buffers, siblings) {
+		dropped += atomic_load_explicit(&buf->dropped, memory_order_relaxed);
+	}
+	mtx_unlock(&tracer.lock);
+	return dropped;
+}
+
+/// Start tracing
+///
+/// EXPORT: deai:Trace.start(path: :string): :integer
+///
+/// Start writing a trace to the file at `path`, which is overwritten. Spans are recorded
+/// for signal emissions, calls, lua functions, garbage collection, promise dispatches
+/// and file descriptor events. Returns 0 on success, or a negative error code, e.g. if
+/// tracing is already started.
+static int di_trace_start(di_object *unused trace, di_string path) {
+	if (tracer.running) {
+		return -EBUSY;
+	}
+	scopedp(char) *path_str = di_string_to_chars_alloc(path);
+	tracer.out = fopen(path_str, "w");
+	if (tracer.out == NULL) {
+		return -errno;
+	}
+	fputs("[", tracer.out);
+
+	// Allocate the buffer of the event loop thread now, instead of in the first span
+	di_trace_thread_buffer();
+
+	// Spans that ended while the last session was being stopped are stale
+	struct di_trace_buffer *buf;
+	mtx_lock(&tracer.lock);
+	list_for_each_entry (buf, &tracer.buffers, siblings) {
+		atomic_store(&buf->tail, atomic_load(&buf->head));
+		atomic_store(&buf->dropped, 0);
+	}
+	mtx_unlock(&tracer.lock);
+	tracer.first = true;
+	tracer.quit = false;
+	tracer.origin = di_trace_now();
+	if (thrd_create(&tracer.writer, di_trace_writer_main, NULL) != thrd_success) {
+		mtx_lock(&tracer.lock);
+		fclose(tracer.out);
+		tracer.out = NULL;
+		mtx_unlock(&tracer.lock);
+		return -ENOMEM;
+	}
+	tracer.running = true;
+	atomic_store(&di_tracing, true);
+	return 0;
+}
+
+/// Stop tracing
+///
+/// EXPORT: deai:Trace.stop(): :void
+///
+/// Write out the remaining spans and close the trace file. Tracing is also stopped when
+/// deai exits.
+void di_trace_stop(void) {
+	if (!tracer.running) {
+		return;
+	}
+	atomic_store(&di_tracing, false);
+	mtx_lock(&tracer.lock);
+	tracer.quit = true;
+	cnd_signal(&tracer.wake);
+	mtx_unlock(&tracer.lock);
+	thrd_join(tracer.writer, NULL);
+
+	// Pick up what was recorded after the last flush. Exiting threads write out their
+	// spans while the file is open, so it is closed with the lock held.
+	mtx_lock(&tracer.lock);
+	di_trace_flush();
+	fputs("\n]\n", tracer.out);
+	fclose(tracer.out);
+	tracer.out = NULL;
+	mtx_unlock(&tracer.lock);
+	tracer.running = false;
+
+	auto dropped = di_trace_dropped();
+	if (dropped != 0) {
+		log_warn("%" PRIu64 " spans were dropped from the trace, because the buffers "
+		         "were full",
+		         dropped);
+	}
+}
+
+static void di_trace_stop_method(di_object *unused trace) {
+	di_trace_stop();
+}
+
+static bool di_trace_get_enabled(di_object *unused trace) {
+	return tracer.running;
+}
+
+static uint64_t di_trace_get_dropped(di_object *unused trace) {
+	return di_trace_dropped();
+}
+
+/// Tracing
+///
+/// EXPORT: trace: deai:Trace
+///
+/// TYPE: deai:Trace
+///
+/// Record what deai is doing into a trace file, which can be viewed in chrome://tracing
+/// or Perfetto. Tracing is cheap enough to be used on a live session, but spans are
+/// dropped if they are recorded faster than they can be written out.
+///
+/// EXPORT: deai:Trace.enabled: :bool
+///
+/// Whether tracing is started.
+///
+/// EXPORT: deai:Trace.dropped: :unsigned
+///
+/// Number of spans dropped in the current, or the last, tracing session.
+di_object *di_new_trace(void) {
+	mtx_init(&tracer.lock, mtx_plain);
+	cnd_init(&tracer.wake);
+	INIT_LIST_HEAD(&tracer.buffers);
+	DI_CHECK(tss_create(&thread_buffer_key, di_trace_thread_exit) == thrd_success);
+
+	auto trace = di_new_object_with_type(di_object);
+	di_set_type(trace, "deai:Trace");
+	DI_CHECK_OK(di_method(trace, "start", di_trace_start, di_string));
+	DI_CHECK_OK(di_method(trace, "stop", di_trace_stop_method));
+	DI_CHECK_OK(di_getter(trace, enabled, di_trace_get_enabled));
+	DI_CHECK_OK(di_getter(trace, dropped, di_trace_get_dropped));
+	return trace;
+}
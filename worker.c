@@ -0,0 +1,412 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <deai/builtins/event.h>
+#include <deai/error.h>
+#include <deai/helper.h>
+#include <deai/type.h>
+
+#include <ev.h>
+
+#include "common.h"        // IWYU pragma: keep
+#include "list.h"
+#include "os.h"
+#include "worker.h"
+
+/// Maximum number of worker threads. New threads are only started when all existing
+/// ones are busy.
+#define DI_WORKER_MAX_THREADS 4
+
+struct di_worker_job {
+	struct list_head siblings;
+	di_offload_fn fn;
+	void *data;
+	/// Only touched on the event loop thread, NULL if the pool was freed before the job
+	/// finished.
+	di_object *promise;
+
+	int rc;
+	di_type rtype;
+	di_value ret;
+};
+
+/// Worker threads are detached, so a long running job doesn't block deai from exiting.
+/// The pool is freed by whichever of its owner and its workers is the last to leave.
+struct di_worker_pool {
+	/// Signaled by workers when there are finished jobs
+	ev_async done_ev;
+	struct ev_loop *loop;
+	/// The event module this pool belongs to, not referenced.
+	di_object *event_module;
+	/// An anonymous root that keeps the event module alive while there are outstanding
+	/// jobs. Weakly referenced, so the pool doesn't keep its own event module alive.
+	di_weak_object *keep_alive;
+	/// Number of submitted jobs whose results haven't been handled yet. Only touched on
+	/// the event loop thread.
+	unsigned int outstanding;
+
+	/// Protects everything below
+	mtx_t lock;
+	cnd_t has_work;
+	/// Jobs waiting for a worker
+	struct list_head pending;
+	unsigned int npending;
+	/// Jobs being run by workers
+	struct list_head running;
+	/// Finished jobs waiting to be handled by the event loop thread
+	struct list_head done;
+	/// Number of workers waiting for jobs
+	unsigned int nidle;
+	/// Number of workers that haven't exited yet
+	unsigned int nthreads;
+	/// Set when the pool is freed by its owner, workers exit once the queued jobs are run
+	bool quit;
+};
+
+static void di_destroy_worker_pool(struct di_worker_pool *pool) {
+	cnd_destroy(&pool->has_work);
+	mtx_destroy(&pool->lock);
+	free(pool);
+}
+
+static int di_worker_main(void *arg) {
+	struct di_worker_pool *pool = arg;
+	mtx_lock(&pool->lock);
+	while (true) {
+		if (list_empty(&pool->pending)) {
+			// Queued jobs are always run before quitting, because they own their data.
+			if (pool->quit) {
+				break;
+			}
+			pool->nidle++;
+			cnd_wait(&pool->has_work, &pool->lock);
+			pool->nidle--;
+			continue;
+		}
+
+		auto job = list_first_entry(&pool->pending, struct di_worker_job, siblings);
+		list_move_tail(&job->siblings, &pool->running);
+		pool->npending--;
+		mtx_unlock(&pool->lock);
+
+		job->rtype = DI_TYPE_NIL;
+		job->rc = job->fn(job->data, &job->rtype, &job->ret);
+
+		mtx_lock(&pool->lock);
+		if (pool->quit) {
+			// Nobody is waiting for the result anymore, and the event loop might be gone.
+			list_del(&job->siblings);
+			if (job->rc >= 0) {
+				di_free_value(job->rtype, &job->ret);
+			}
+			free(job);
+			continue;
+		}
+		list_move_tail(&job->siblings, &pool->done);
+		ev_async_send(pool->loop, &pool->done_ev);
+	}
+	bool last = --pool->nthreads == 0;
+	mtx_unlock(&pool->lock);
+	if (last) {
+		di_destroy_worker_pool(pool);
+	}
+	return 0;
+}
+
+static void di_worker_done_cb(EV_P_ ev_async *w, int revents) {
+	struct di_worker_pool *pool = (void *)w;
+	struct list_head done;
+	INIT_LIST_HEAD(&done);
+
+	mtx_lock(&pool->lock);
+	list_splice_init(&pool->done, &done);
+	mtx_unlock(&pool->lock);
+
+	struct di_worker_job *job, *njob;
+	list_for_each_entry_safe (job, njob, &done, siblings) {
+		if (job->rc < 0) {
+			scoped_di_object *error = di_new_error("%s", strerror(-job->rc));
+			di_promise_reject(job->promise, error);
+		} else {
+			auto result = (struct di_variant){.type = job->rtype, .value = &job->ret};
+			di_promise_resolve(job->promise, result);
+			di_free_value(job->rtype, &job->ret);
+		}
+		di_unref_object(job->promise);
+		free(job);
+		pool->outstanding--;
+	}
+
+	if (pool->outstanding == 0) {
+		ev_async_stop(EV_A_ w);
+		scoped_di_object *keep_alive = di_upgrade_weak_ref(pool->keep_alive);
+		di_drop_weak_ref(&pool->keep_alive);
+		pool->keep_alive = NULL;
+		if (keep_alive != NULL) {
+			di_unpin_object(keep_alive);
+		}
+	}
+}
+
+struct di_worker_pool *di_new_worker_pool(struct ev_loop *loop, di_object *event_module) {
+	auto pool = tmalloc(struct di_worker_pool, 1);
+	ev_async_init(&pool->done_ev, di_worker_done_cb);
+	pool->loop = loop;
+	pool->event_module = event_module;
+	DI_CHECK(mtx_init(&pool->lock, mtx_plain) == thrd_success);
+	DI_CHECK(cnd_init(&pool->has_work) == thrd_success);
+	INIT_LIST_HEAD(&pool->pending);
+	INIT_LIST_HEAD(&pool->running);
+	INIT_LIST_HEAD(&pool->done);
+	return pool;
+}
+
+void di_worker_pool_submit(struct di_worker_pool *pool, di_offload_fn fn, void *data,
+                           di_object *promise) {
+	auto job = tmalloc(struct di_worker_job, 1);
+	job->fn = fn;
+	job->data = data;
+	job->promise = di_ref_object(promise);
+	if (pool->outstanding++ == 0) {
+		ev_async_start(pool->loop, &pool->done_ev);
+		scoped_di_object *keep_alive = di_new_object_with_type_name(
+		    sizeof(di_object), alignof(di_object), "deai.event:PendingOffloads");
+		di_member_clone(keep_alive, "event_module", pool->event_module);
+		di_pin_object(keep_alive);
+		pool->keep_alive = di_weakly_ref_object(keep_alive);
+	}
+
+	mtx_lock(&pool->lock);
+	list_add_tail(&job->siblings, &pool->pending);
+	pool->npending++;
+	thrd_t thread;
+	if (pool->npending > pool->nidle && pool->nthreads < DI_WORKER_MAX_THREADS &&
+	    thrd_create(&thread, di_worker_main, pool) == thrd_success) {
+		thrd_detach(thread);
+		pool->nthreads++;
+	}
+	DI_CHECK(pool->nthreads > 0, "Failed to start worker thread");
+	cnd_signal(&pool->has_work);
+	mtx_unlock(&pool->lock);
+}
+
+/// Drop the promises of jobs in `jobs`, they are not going to be resolved.
+static void di_worker_drop_promises(struct list_head *jobs) {
+	struct di_worker_job *job;
+	list_for_each_entry (job, jobs, siblings) {
+		di_unref_object(job->promise);
+		job->promise = NULL;
+	}
+}
+
+void di_free_worker_pool(struct di_worker_pool *pool) {
+	ev_async_stop(pool->loop, &pool->done_ev);
+	if (pool->keep_alive != NULL) {
+		di_drop_weak_ref(&pool->keep_alive);
+	}
+
+	mtx_lock(&pool->lock);
+	pool->quit = true;
+	cnd_broadcast(&pool->has_work);
+	// Jobs that haven't finished are left to the workers, which free them when they are
+	// done. Their promises are dropped here, because workers can't touch objects.
+	di_worker_drop_promises(&pool->pending);
+	di_worker_drop_promises(&pool->running);
+
+	struct di_worker_job *job, *njob;
+	list_for_each_entry_safe (job, njob, &pool->done, siblings) {
+		if (job->rc >= 0) {
+			di_free_value(job->rtype, &job->ret);
+		}
+		di_unref_object(job->promise);
+		free(job);
+	}
+	bool last = pool->nthreads == 0;
+	mtx_unlock(&pool->lock);
+	if (last) {
+		di_destroy_worker_pool(pool);
+	}
+}
+
+#define MAX_OFFLOAD_ARGS 2
+
+/// A blocking operation available through `event.offload`. All of them take strings as
+/// arguments.
+struct di_offload_op {
+	const char *name;
+	int nargs;
+	int (*fn)(const di_string *args, di_type *rt, di_value *ret);
+};
+
+struct di_offload_op_job {
+	const struct di_offload_op *op;
+	/// Plain copies of the arguments, not shared with anything on the event loop thread
+	di_string args[MAX_OFFLOAD_ARGS];
+};
+
+static int di_offload_listdir(const di_string *args, di_type *rt, di_value *ret) {
+	scopedp(char) *path = di_string_to_chars_alloc(args[0]);
+	if (path == NULL) {
+		return -ENOENT;
+	}
+	*rt = DI_TYPE_ARRAY;
+	ret->array = di_read_dir(path);
+	return 0;
+}
+
+static int di_offload_read_file(const di_string *args, di_type *rt, di_value *ret) {
+	scopedp(char) *path = di_string_to_chars_alloc(args[0]);
+	if (path == NULL) {
+		return -ENOENT;
+	}
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	size_t length = 0, capacity = 4096;
+	char *buf = malloc(capacity);
+	while (true) {
+		if (length == capacity) {
+			capacity *= 2;
+			buf = trealloc(buf, capacity);
+		}
+		auto nread = read(fd, buf + length, capacity - length);
+		if (nread < 0 && errno == EINTR) {
+			continue;
+		}
+		if (nread < 0) {
+			int rc = -errno;
+			free(buf);
+			close(fd);
+			return rc;
+		}
+		if (nread == 0) {
+			break;
+		}
+		length += (size_t)nread;
+	}
+	close(fd);
+
+	*rt = DI_TYPE_STRING;
+	ret->string = (di_string){.data = buf, .length = length};
+	return 0;
+}
+
+static int di_offload_write_file(const di_string *args, di_type *rt, di_value *ret) {
+	scopedp(char) *path = di_string_to_chars_alloc(args[0]);
+	if (path == NULL) {
+		return -ENOENT;
+	}
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	size_t written = 0;
+	while (written < args[1].length) {
+		auto nwritten = write(fd, args[1].data + written, args[1].length - written);
+		if (nwritten < 0 && errno == EINTR) {
+			continue;
+		}
+		if (nwritten < 0) {
+			int rc = -errno;
+			close(fd);
+			return rc;
+		}
+		written += (size_t)nwritten;
+	}
+	if (close(fd) != 0) {
+		return -errno;
+	}
+	*rt = DI_TYPE_NIL;
+	return 0;
+}
+
+static const struct di_offload_op offload_ops[] = {
+    {"listdir", 1, di_offload_listdir},
+    {"read_file", 1, di_offload_read_file},
+    {"write_file", 2, di_offload_write_file},
+};
+
+static void di_free_offload_op_job(struct di_offload_op_job *job) {
+	for (int i = 0; i < MAX_OFFLOAD_ARGS; i++) {
+		free((char *)job->args[i].data);
+	}
+	free(job);
+}
+
+static int di_run_offload_op(void *data, di_type *rt, di_value *ret) {
+	struct di_offload_op_job *job = data;
+	int rc = job->op->fn(job->args, rt, ret);
+	di_free_offload_op_job(job);
+	return rc;
+}
+
+/// Run a blocking operation on a worker thread
+///
+/// EXPORT: event.offload(op: :string, ...): deai:Promise
+///
+/// Run one of the built-in blocking operations without blocking the event loop. Returns
+/// a promise that resolves to the result of the operation, or is rejected if the
+/// operation fails.
+///
+/// Available operations are:
+///
+/// - listdir(path) names of the entries in a directory, like `os.listdir`
+/// - read_file(path) the whole content of a file, as a string
+/// - write_file(path, content) replace the content of a file, creating it if needed
+int di_offload_builtin(di_object *o, di_type *rt, di_value *ret, di_tuple args) {
+	// The first argument is the event module
+	if (args.length < 2 || args.elements[0].type != DI_TYPE_OBJECT) {
+		return -EINVAL;
+	}
+
+	di_string name;
+	if (di_type_conversion(args.elements[1].type, args.elements[1].value,
+	                       DI_TYPE_STRING, (di_value *)&name, true) != 0) {
+		return -EINVAL;
+	}
+	const struct di_offload_op *op = NULL;
+	for (size_t i = 0; i < ARRAY_SIZE(offload_ops); i++) {
+		if (di_string_eq(name, di_string_borrow(offload_ops[i].name))) {
+			op = &offload_ops[i];
+			break;
+		}
+	}
+	if (op == NULL) {
+		di_throw(di_new_error("Unknown offload operation %.*s", (int)name.length,
+		                      name.data));
+	}
+	if (args.length - 2 != op->nargs) {
+		di_throw(di_new_error("Offload operation %s takes %d arguments, got %d", op->name,
+		                      op->nargs, (int)args.length - 2));
+	}
+
+	auto job = tmalloc(struct di_offload_op_job, 1);
+	job->op = op;
+	for (int i = 0; i < op->nargs; i++) {
+		di_string arg;
+		if (di_type_conversion(args.elements[i + 2].type, args.elements[i + 2].value,
+		                       DI_TYPE_STRING, (di_value *)&arg, true) != 0) {
+			di_free_offload_op_job(job);
+			return -EINVAL;
+		}
+		if (arg.length != 0) {
+			job->args[i] = di_string_ndup(arg.data, arg.length);
+		}
+	}
+
+	*rt = DI_TYPE_OBJECT;
+	ret->object = di_offload(args.elements[0].value->object, di_run_offload_op, job);
+	return 0;
+}
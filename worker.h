@@ -0,0 +1,29 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Copyright (c) 2026, Yuxuan Shui <yshuiv7@gmail.com> */
+
+#pragma once
+#include <deai/builtins/event.h>
+#include <deai/deai.h>
+
+/// A pool of threads running blocking functions off the event loop thread. Threads are
+/// started on demand, and results are handed back to the event loop thread, where the
+/// promises of finished jobs are resolved.
+struct di_worker_pool;
+struct ev_loop;
+
+/// Create a pool for `event_module`, which is kept alive while there are outstanding jobs
+struct di_worker_pool *di_new_worker_pool(struct ev_loop *loop, di_object *event_module);
+/// Queue `fn` to be called with `data` on a worker thread, and resolve `promise` with its
+/// result. The event loop is kept alive until the result is handled.
+void di_worker_pool_submit(struct di_worker_pool *pool, di_offload_fn fn, void *data,
+                           di_object *promise);
+/// Free `pool` without waiting for its jobs. Promises of unfinished jobs are never
+/// resolved. Queued jobs are still run, and worker threads exit after that, dropping
+/// the results.
+void di_free_worker_pool(struct di_worker_pool *pool);
+
+/// Call method of `event.offload`
+int di_offload_builtin(di_object *o, di_type *rt, di_value *ret, di_tuple args);